@@ -0,0 +1,355 @@
+/*
+ * x2x-agent: injects the input x2x sends it (see agent.h) into the X
+ * display it runs next to, so that only a one way stream crosses the
+ * link between x2x and a far away display.
+ *
+ *   x2x-agent [-display <DISPLAY>] -listen <[HOST:]PORT | SOCKET PATH>
+ *
+ * One x2x at a time is served; keys and buttons it leaves down are
+ * released when it goes away.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <X11/Xlib.h>
+#include <X11/extensions/XTest.h>
+#include <X11/extensions/dpms.h>
+#include "agent.h"
+
+#define N_KEYCODES  256
+#define N_BUTTONS   32
+
+static char    *programStr = "x2x-agent";
+static char    *dpyName = NULL;
+static char    *listenAddress = NULL;
+
+static Display *dpy;
+static Bool    keysDown[N_KEYCODES];
+static Bool    buttonsDown[N_BUTTONS];
+static int     screen, x, y;
+static Window  focusWin = None;
+static int     focusRevert;
+
+static void    Usage(void);
+static void    ParseCommandLine(int, char **);
+static int     Listen(char *);
+static void    Serve(int);
+static int     Decode(unsigned char *, int);
+static int     GetNumber(unsigned char **, unsigned char *, long *);
+static void    ReleaseAll(void);
+static int     IgnoreError(Display *, XErrorEvent *);
+
+int main(argc, argv)
+int  argc;
+char **argv;
+{
+  int listenFd, fd;
+  int dummy;
+
+  ParseCommandLine(argc, argv);
+  if (!(dpy = XOpenDisplay(dpyName))) {
+    fprintf(stderr, "%s - error: can not open display %s\n",
+            programStr, XDisplayName(dpyName));
+    exit(2);
+  }
+  if (!XTestQueryExtension(dpy, &dummy, &dummy, &dummy, &dummy)) {
+    fprintf(stderr,
+            "%s - error: display %s does not support the test extension\n",
+            programStr, XDisplayName(dpyName));
+    exit(3);
+  }
+  XSetErrorHandler(IgnoreError); /* e.g. a focus window gone */
+
+  if ((listenFd = Listen(listenAddress)) < 0)
+    exit(3);
+  for (;;) {
+    if ((fd = accept(listenFd, NULL, NULL)) < 0) {
+      if (errno == EINTR)
+        continue;
+      perror(programStr);
+      exit(1);
+    }
+    Serve(fd);
+    close(fd);
+    ReleaseAll();
+  } /* END for */
+
+} /* END main */
+
+static void Usage()
+{
+  printf("Usage: x2x-agent [-display <DISPLAY>] "
+         "-listen <[HOST:]PORT | SOCKET PATH>\n");
+  exit(4);
+
+} /* END Usage */
+
+static void ParseCommandLine(argc, argv)
+int  argc;
+char **argv;
+{
+  int arg;
+
+  for (arg = 1; arg < argc; ++arg) {
+    if (!strcasecmp(argv[arg], "-display")) {
+      if (++arg >= argc) Usage();
+      dpyName = argv[arg];
+    } else if (!strcasecmp(argv[arg], "-listen")) {
+      if (++arg >= argc) Usage();
+      listenAddress = argv[arg];
+    } else {
+      Usage();
+    }
+  } /* END for */
+  if (!listenAddress)
+    Usage();
+
+} /* END ParseCommandLine */
+
+/**********
+ * socket for x2x to connect to: a path for a Unix domain socket, else
+ * a TCP port, on the loopback interface unless a host is given.
+ * Whoever reaches it can type into the display: all interfaces only
+ * when asked for, as 0.0.0.0:PORT.
+ **********/
+static int Listen(address)
+char *address;
+{
+  struct sockaddr_un unAddr;
+  struct addrinfo hints, *pAddrs, *pAddr;
+  char   *copy, *host, *port;
+  int    fd = -1;
+  int    one = 1;
+
+  if (strchr(address, '/')) { /* Unix domain socket */
+    unlink(address);
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) >= 0) {
+      memset(&unAddr, 0, sizeof(unAddr));
+      unAddr.sun_family = AF_UNIX;
+      strncpy(unAddr.sun_path, address, sizeof(unAddr.sun_path) - 1);
+      if (bind(fd, (struct sockaddr *)&unAddr, sizeof(unAddr)) < 0) {
+        close(fd);
+        fd = -1;
+      }
+    }
+  } else { /* [host:]port */
+    copy = (char *)malloc(strlen(address) + 1);
+    strcpy(copy, address);
+    if ((port = strrchr(copy, ':'))) {
+      *port++ = '\0';
+      host = copy;
+    } else { /* loopback */
+      port = copy;
+      host = NULL;
+    }
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (!getaddrinfo(host, port, &hints, &pAddrs)) {
+      for (pAddr = pAddrs; pAddr; pAddr = pAddr->ai_next) {
+        if ((fd = socket(pAddr->ai_family, pAddr->ai_socktype,
+                         pAddr->ai_protocol)) < 0)
+          continue;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, pAddr->ai_addr, pAddr->ai_addrlen) == 0)
+          break;
+        close(fd);
+        fd = -1;
+      } /* END for */
+      freeaddrinfo(pAddrs);
+    }
+    free(copy);
+  } /* END if Unix ... else ... */
+
+  if ((fd >= 0) && (listen(fd, 1) < 0)) {
+    close(fd);
+    fd = -1;
+  }
+  if (fd < 0)
+    fprintf(stderr, "%s - error: can not listen on %s\n",
+            programStr, address);
+  return fd;
+
+} /* END Listen */
+
+/**********
+ * inject what one x2x sends until it goes away
+ **********/
+static void Serve(fd)
+int fd;
+{
+  unsigned char buf[AGENT_BUF_SIZE];
+  int  len = 0, n, used;
+  Bool greeted = False;
+
+  screen = x = y = 0;
+  for (;;) {
+    if ((n = read(fd, buf + len, sizeof(buf) - len)) < 0) {
+      if (errno == EINTR)
+        continue;
+      return;
+    }
+    if (n == 0) /* x2x went away */
+      return;
+    len += n;
+
+    if (!greeted) {
+      if (len < AGENT_GREETING)
+        continue;
+      if (memcmp(buf, AGENT_MAGIC, AGENT_GREETING - 1) ||
+          (buf[AGENT_GREETING - 1] != AGENT_VERSION)) {
+        fprintf(stderr, "%s - error: not x2x, or another version\n",
+                programStr);
+        return;
+      }
+      greeted = True;
+      memmove(buf, buf + AGENT_GREETING, len - AGENT_GREETING);
+      len -= AGENT_GREETING;
+    } /* END if greeting */
+
+    /* a message cut at the end of the read waits for the rest */
+    if ((used = Decode(buf, len)) < 0)
+      return;
+    memmove(buf, buf + used, len - used);
+    len -= used;
+    XFlush(dpy);
+  } /* END for */
+
+} /* END Serve */
+
+/**********
+ * inject the complete messages in buf, return the bytes they take or
+ * -1 on garbage
+ **********/
+static int Decode(buf, len)
+unsigned char *buf;
+int len;
+{
+  unsigned char *pBuf = buf, *pEnd = buf + len, *pMsg;
+  long a, b;
+  int  dummy;
+  CARD16 state;
+  BOOL onoff;
+  int  status;
+
+/* a number, or back to the start of a message cut short */
+#define GET_NUMBER(N) \
+  if ((status = GetNumber(&pBuf, pEnd, &(N))) <= 0) \
+    return (status < 0) ? -1 : pMsg - buf
+
+  while (pBuf < pEnd) {
+    pMsg = pBuf++;
+    switch (*pMsg) {
+    case AGENT_MOTION:
+      GET_NUMBER(a);
+      GET_NUMBER(b);
+      x += a;
+      y += b;
+      XTestFakeMotionEvent(dpy, screen, x, y, 0);
+      break;
+    case AGENT_SCREEN:
+      GET_NUMBER(a);
+      if ((a < -1) || (a >= ScreenCount(dpy))) /* -1: the current one */
+        return -1;
+      screen = a;
+      x = y = 0;
+      break;
+    case AGENT_KEY_DOWN:
+    case AGENT_KEY_UP:
+      GET_NUMBER(a);
+      if ((a < 0) || (a >= N_KEYCODES))
+        return -1;
+      keysDown[a] = (*pMsg == AGENT_KEY_DOWN);
+      XTestFakeKeyEvent(dpy, a, keysDown[a], 0);
+      break;
+    case AGENT_BUTTON_DOWN:
+    case AGENT_BUTTON_UP:
+      GET_NUMBER(a);
+      if ((a < 0) || (a >= N_BUTTONS))
+        return -1;
+      buttonsDown[a] = (*pMsg == AGENT_BUTTON_DOWN);
+      XTestFakeButtonEvent(dpy, a, buttonsDown[a], 0);
+      break;
+    case AGENT_WAKE:
+      if (DPMSQueryExtension(dpy, &dummy, &dummy) &&
+          DPMSInfo(dpy, &state, &onoff) && onoff && (state != DPMSModeOn))
+        DPMSForceLevel(dpy, DPMSModeOn);
+      break;
+    case AGENT_LEAVE:
+      XGetInputFocus(dpy, &focusWin, &focusRevert);
+      XSetInputFocus(dpy, PointerRoot, 0, CurrentTime);
+      break;
+    case AGENT_ENTER:
+      if (focusWin != None)
+        XSetInputFocus(dpy, focusWin, focusRevert, CurrentTime);
+      break;
+    default:
+      fprintf(stderr, "%s - error: bad message %d\n", programStr, *pMsg);
+      return -1;
+    } /* END switch */
+  } /* END while */
+  return pBuf - buf;
+
+} /* END Decode */
+
+/**********
+ * 1 with a number, 0 if it is cut short, -1 if it is too long
+ **********/
+static int GetNumber(ppBuf, pEnd, pNumber)
+unsigned char **ppBuf, *pEnd;
+long *pNumber;
+{
+  unsigned char *pBuf = *ppBuf;
+  unsigned long n = 0;
+  int shift = 0;
+
+  do {
+    if (pBuf >= pEnd)
+      return 0;
+    if (shift > 28)
+      return -1;
+    n |= (unsigned long)(*pBuf & 0x7f) << shift;
+    shift += 7;
+  } while (*pBuf++ & 0x80);
+  *pNumber = AGENT_UNZIGZAG(n);
+  *ppBuf = pBuf;
+  return 1;
+
+} /* END GetNumber */
+
+static void ReleaseAll()
+{
+  int counter;
+
+  for (counter = 0; counter < N_KEYCODES; ++counter)
+    if (keysDown[counter]) {
+      XTestFakeKeyEvent(dpy, counter, False, 0);
+      keysDown[counter] = False;
+    }
+  for (counter = 0; counter < N_BUTTONS; ++counter)
+    if (buttonsDown[counter]) {
+      XTestFakeButtonEvent(dpy, counter, False, 0);
+      buttonsDown[counter] = False;
+    }
+  XFlush(dpy);
+
+} /* END ReleaseAll */
+
+static int IgnoreError(errDpy, pEv)
+Display *errDpy;
+XErrorEvent *pEv;
+{
+  return 0;
+
+} /* END IgnoreError */
@@ -0,0 +1,36 @@
+/*
+ * agent.h: wire protocol between x2x and x2x-agent.
+ *
+ * x2x sends, the agent injects with XTest on its display, nothing comes
+ * back.  The stream starts with AGENT_MAGIC and AGENT_VERSION, then
+ * holds messages of one opcode byte followed by their operands.  x2x
+ * writes whatever it has batched each time it would have flushed the
+ * display.
+ *
+ * Numbers are variable length: 7 bits per byte, low bits first, the
+ * high bit set on every byte but the last.  Motion is sent relative to
+ * the last position sent on the same screen, zigzag encoded so that
+ * small moves either way take one byte per axis.
+ */
+
+#define AGENT_MAGIC       "X2XA"
+#define AGENT_VERSION     1
+#define AGENT_GREETING    5 /* magic and version */
+
+#define AGENT_MOTION      1 /* dx, dy */
+#define AGENT_SCREEN      2 /* screen; motion starts again from 0,0 */
+#define AGENT_KEY_DOWN    3 /* keycode */
+#define AGENT_KEY_UP      4 /* keycode */
+#define AGENT_BUTTON_DOWN 5 /* button */
+#define AGENT_BUTTON_UP   6 /* button */
+#define AGENT_WAKE        7 /* turn the monitor on (DPMS) */
+#define AGENT_LEAVE       8 /* save the input focus, then follow the pointer */
+#define AGENT_ENTER       9 /* restore the saved input focus */
+
+/* longest message: opcode and two numbers of 5 bytes */
+#define AGENT_MAX_MSG     11
+
+#define AGENT_BUF_SIZE    4096
+
+#define AGENT_ZIGZAG(N)   (((unsigned long)(N) << 1) ^ ((N) < 0 ? ~0UL : 0UL))
+#define AGENT_UNZIGZAG(U) ((long)((U) >> 1) ^ -(long)((U) & 1))
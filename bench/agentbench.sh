@@ -0,0 +1,50 @@
+#!/bin/sh
+#
+# x2x-agent check: x2x from one Xvfb server to another, with the input
+# for "to" going through an x2x-agent on a loopback TCP port.
+#
+# Crosses the edge, holds a key and a button down on "from", then kills
+# x2x with both still down.  Prints the milliseconds until the motion,
+# the key and the button show up on "to", and until the agent, having
+# lost x2x, lets go of them.  Fails if one of them does not happen.
+#
+# X2X, X2X_AGENT, EDGEBENCH and PORT override the defaults.
+#
+
+X2X=${X2X:-./x2x}
+X2X_AGENT=${X2X_AGENT:-./x2x-agent}
+EDGEBENCH=${EDGEBENCH:-./edgebench}
+PORT=${PORT:-7047}
+
+A=:84
+B=:85
+SOCKETS=/tmp/.X11-unix
+
+pids=
+cleanup() {
+    [ -n "$pids" ] && kill $pids 2>/dev/null
+    wait 2>/dev/null
+}
+trap cleanup EXIT INT TERM
+
+for dpy in $A $B; do
+    Xvfb $dpy -nolisten tcp -screen 0 1024x768x24 >/dev/null 2>&1 &
+    pids="$pids $!"
+    tries=0
+    until [ -S $SOCKETS/X${dpy#:} ]; do
+        tries=$((tries + 1))
+        [ $tries -gt 50 ] && { echo "$0: Xvfb $dpy did not start" >&2; exit 1; }
+        sleep 0.1
+    done
+done
+
+$X2X_AGENT -display $B -listen 127.0.0.1:$PORT &
+pids="$pids $!"
+sleep 0.2
+$X2X -from $A -to $B -east -agent 127.0.0.1:$PORT >/dev/null 2>&1 &
+x2x=$!
+pids="$pids $x2x"
+sleep 1 # for x2x to set up
+
+echo "motion-ms key-ms button-ms release-ms"
+$EDGEBENCH agent -from $A -to $B -kill $x2x || { echo "FAILED"; exit 1; }
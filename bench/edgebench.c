@@ -0,0 +1,571 @@
+/*
+ * edgebench: edge crossing latency of x2x over a slow link.
+ *
+ *   edgebench lag -listen SOCKET -to SOCKET -delay MS
+ *   edgebench cross -from D -to D -via D [-n N]
+ *   edgebench move -from D -to D [-n N]
+ *   edgebench agent -from D -to D -kill PID
+ *
+ * "lag" relays connections from one Unix domain socket to another,
+ * each way MS/2 ms late, so that a display behind it is MS ms of round
+ * trip away.  "cross" drives the pointer of the "from" display of an
+ * x2x -east over the edge and back N times and prints, in ms, the
+ * median time until the pointer moves on the "to" display (connect)
+ * and until x2x lets go of the keyboard of "from" (disconnect), and
+ * the round trip to the "via" display x2x talks to.  "move" crosses
+ * once, then moves the pointer of "from" N times and prints the median
+ * and the longest time, in ms, until it moves on "to".  "agent", for an
+ * x2x (process PID) whose "to" input goes through x2x-agent, crosses,
+ * holds a key and a button down on "from", kills x2x and prints the
+ * time, in ms, until the motion, the key, the button and their release
+ * by the agent show on "to".
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <X11/Xlib.h>
+#include <X11/keysym.h>
+#include <X11/extensions/XTest.h>
+
+#define MODE_LAG   0
+#define MODE_CROSS 1
+#define MODE_MOVE  2
+#define MODE_AGENT 3
+
+#define LAG_BUF    65536
+#define LAG_CHUNKS 256     /* chunks in flight each way */
+#define CROSS_N    20
+#define TIMEOUT    5000.0  /* ms, for x2x to react */
+
+/* bytes on their way, due at a time */
+typedef struct {
+  double due;
+  int    len;
+  char   *data;
+} CHUNK;
+
+/* one way of a relayed connection */
+typedef struct {
+  int   inFd, outFd;
+  CHUNK chunks[LAG_CHUNKS];
+  int   head, count;
+} LANE;
+
+static char    *progName;
+static int     mode;
+static char    *listenPath = NULL, *toPath = NULL;
+static double  delay = 30.0;
+static char    *fromName = NULL, *toName = NULL, *viaName = NULL;
+static int     nCrossings = CROSS_N;
+static int     x2xPid = 0;
+
+static void    Usage(void);
+static void    ParseCommandLine(int, char **);
+static double  Now(void);
+static int     UnixSocket(char *, Bool);
+static int     Lag(void);
+static void    Relay(int, int);
+static Bool    Pump(LANE *, double);
+static int     Cross(void);
+static Bool    CrossOver(Display *, Display *, double *);
+static int     Move(void);
+static int     Agent(void);
+static Bool    WaitInput(Display *, int, unsigned int, Bool);
+static Bool    WaitPointer(Display *, int);
+static int     PointerX(Display *);
+static Bool    WaitUngrab(Display *);
+static int     CompareMs(const void *, const void *);
+
+int main(argc, argv)
+int  argc;
+char **argv;
+{
+  progName = argv[0];
+  ParseCommandLine(argc, argv);
+  return (mode == MODE_LAG) ? Lag() : (mode == MODE_MOVE) ? Move() :
+    (mode == MODE_AGENT) ? Agent() : Cross();
+
+} /* END main */
+
+static void Usage()
+{
+  printf("Usage: %s lag -listen <SOCKET> -to <SOCKET> -delay <MS>\n",
+         progName);
+  printf("       %s cross -from <DISPLAY> -to <DISPLAY> -via <DISPLAY> "
+         "[-n <N>]\n", progName);
+  printf("       %s move -from <DISPLAY> -to <DISPLAY> [-n <N>]\n", progName);
+  printf("       %s agent -from <DISPLAY> -to <DISPLAY> -kill <PID>\n",
+         progName);
+  exit(2);
+
+} /* END Usage */
+
+static void ParseCommandLine(argc, argv)
+int  argc;
+char **argv;
+{
+  int arg;
+
+  if (argc < 2)
+    Usage();
+  if (!strcasecmp(argv[1], "lag"))
+    mode = MODE_LAG;
+  else if (!strcasecmp(argv[1], "cross"))
+    mode = MODE_CROSS;
+  else if (!strcasecmp(argv[1], "move"))
+    mode = MODE_MOVE;
+  else if (!strcasecmp(argv[1], "agent"))
+    mode = MODE_AGENT;
+  else
+    Usage();
+
+  for (arg = 2; arg < argc; ++arg) {
+    if (!strcasecmp(argv[arg], "-listen")) {
+      if (++arg >= argc) Usage();
+      listenPath = argv[arg];
+    } else if (!strcasecmp(argv[arg], "-to")) {
+      if (++arg >= argc) Usage();
+      toPath = toName = argv[arg];
+    } else if (!strcasecmp(argv[arg], "-delay")) {
+      if (++arg >= argc) Usage();
+      delay = atof(argv[arg]);
+    } else if (!strcasecmp(argv[arg], "-from")) {
+      if (++arg >= argc) Usage();
+      fromName = argv[arg];
+    } else if (!strcasecmp(argv[arg], "-via")) {
+      if (++arg >= argc) Usage();
+      viaName = argv[arg];
+    } else if (!strcasecmp(argv[arg], "-n")) {
+      if (++arg >= argc) Usage();
+      if ((nCrossings = atoi(argv[arg])) <= 0) Usage();
+    } else if (!strcasecmp(argv[arg], "-kill")) {
+      if (++arg >= argc) Usage();
+      if ((x2xPid = atoi(argv[arg])) <= 0) Usage();
+    } else {
+      Usage();
+    }
+  } /* END for */
+  if ((mode == MODE_LAG) ? (!listenPath || !toPath) :
+      (!fromName || !toName || ((mode == MODE_CROSS) && !viaName) ||
+       ((mode == MODE_AGENT) && !x2xPid)))
+    Usage();
+
+} /* END ParseCommandLine */
+
+static double Now()
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return (tv.tv_sec * 1000.0) + (tv.tv_usec / 1000.0);
+
+} /* END Now */
+
+/**********
+ * a socket listening on path, or connected to it
+ **********/
+static int UnixSocket(path, doListen)
+char *path;
+Bool doListen;
+{
+  struct sockaddr_un addr;
+  int fd;
+
+  if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    return -1;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+  if (doListen) {
+    unlink(path);
+    if ((bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) ||
+        (listen(fd, 8) < 0)) {
+      close(fd);
+      return -1;
+    }
+  } else if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+
+} /* END UnixSocket */
+
+/**********
+ * relay every connection, in a process of its own
+ **********/
+static int Lag()
+{
+  int listenFd, inFd, outFd;
+
+  signal(SIGCHLD, SIG_IGN);
+  if ((listenFd = UnixSocket(listenPath, True)) < 0) {
+    fprintf(stderr, "%s: can not listen on %s\n", progName, listenPath);
+    return 1;
+  }
+  for (;;) {
+    if ((inFd = accept(listenFd, NULL, NULL)) < 0) {
+      if (errno == EINTR)
+        continue;
+      return 1;
+    }
+    if ((outFd = UnixSocket(toPath, False)) < 0) {
+      close(inFd);
+      continue;
+    }
+    if (fork() == 0) {
+      close(listenFd);
+      Relay(inFd, outFd);
+      exit(0);
+    }
+    close(inFd);
+    close(outFd);
+  } /* END for */
+
+} /* END Lag */
+
+static void Relay(clientFd, serverFd)
+int clientFd, serverFd;
+{
+  LANE          lanes[2];
+  struct pollfd fds[2];
+  double        now, next;
+  int           counter;
+
+  memset(lanes, 0, sizeof(lanes));
+  lanes[0].inFd = lanes[1].outFd = clientFd;
+  lanes[0].outFd = lanes[1].inFd = serverFd;
+  for (;;) {
+    now = Now();
+    next = -1;
+    for (counter = 0; counter < 2; ++counter) {
+      if (!Pump(&lanes[counter], now))
+        return;
+      fds[counter].fd = lanes[counter].inFd;
+      fds[counter].events = (lanes[counter].count < LAG_CHUNKS) ? POLLIN : 0;
+      if (lanes[counter].count &&
+          ((next < 0) ||
+           (lanes[counter].chunks[lanes[counter].head].due < next)))
+        next = lanes[counter].chunks[lanes[counter].head].due;
+    }
+    poll(fds, 2, (next < 0) ? -1 : (int)(next - now) + 1);
+    now = Now();
+    for (counter = 0; counter < 2; ++counter) {
+      LANE  *pLane = &lanes[counter];
+      CHUNK *pChunk;
+      char  buf[LAG_BUF];
+      int   len;
+
+      if (!(fds[counter].revents & (POLLIN | POLLHUP)))
+        continue;
+      if ((len = read(pLane->inFd, buf, sizeof(buf))) <= 0)
+        return;
+      pChunk = &(pLane->chunks[(pLane->head + pLane->count) % LAG_CHUNKS]);
+      pChunk->due = now + (delay / 2);
+      pChunk->len = len;
+      pChunk->data = (char *)malloc(len);
+      memcpy(pChunk->data, buf, len);
+      ++(pLane->count);
+    } /* END for counter */
+  } /* END for */
+
+} /* END Relay */
+
+/**********
+ * write out the chunks that are due, False once the other end is gone
+ **********/
+static Bool Pump(pLane, now)
+LANE   *pLane;
+double now;
+{
+  CHUNK *pChunk;
+
+  while (pLane->count &&
+         ((pChunk = &(pLane->chunks[pLane->head]))->due <= now)) {
+    if (write(pLane->outFd, pChunk->data, pChunk->len) != pChunk->len)
+      return False;
+    free(pChunk->data);
+    pLane->head = (pLane->head + 1) % LAG_CHUNKS;
+    --(pLane->count);
+  }
+  return True;
+
+} /* END Pump */
+
+static int Cross()
+{
+  Display *fromDpy, *toDpy, *viaDpy;
+  int     height, counter;
+  double  start, rtt;
+  double  *connMs, *discMs;
+
+  if (!(fromDpy = XOpenDisplay(fromName)) ||
+      !(toDpy = XOpenDisplay(toName)) ||
+      !(viaDpy = XOpenDisplay(viaName))) {
+    fprintf(stderr, "%s: can not open the displays\n", progName);
+    return 1;
+  }
+  height = DisplayHeight(fromDpy, DefaultScreen(fromDpy));
+  connMs = (double *)malloc(sizeof(double) * nCrossings);
+  discMs = (double *)malloc(sizeof(double) * nCrossings);
+
+  start = Now();
+  for (counter = 0; counter < 10; ++counter)
+    XSync(viaDpy, False);
+  rtt = (Now() - start) / 10;
+
+  for (counter = 0; counter < nCrossings; ++counter) {
+    if (!CrossOver(fromDpy, toDpy, &start))
+      break;
+    connMs[counter] = Now() - start;
+
+    /* x2x put the pointer of "from" by its west edge: back over it */
+    usleep(50000);
+    start = Now();
+    XTestFakeMotionEvent(fromDpy, -1, 0, height / 2, 0);
+    XFlush(fromDpy);
+    if (!WaitUngrab(fromDpy))
+      break;
+    discMs[counter] = Now() - start;
+    usleep(50000);
+  } /* END for */
+  if (counter < nCrossings) {
+    fprintf(stderr, "%s: x2x did not cross\n", progName);
+    return 1;
+  }
+
+  qsort(connMs, nCrossings, sizeof(double), CompareMs);
+  qsort(discMs, nCrossings, sizeof(double), CompareMs);
+  printf("%.3f %.3f %.3f\n", connMs[nCrossings / 2], discMs[nCrossings / 2],
+         rtt);
+  return 0;
+
+} /* END Cross */
+
+/**********
+ * from the middle of "from" over its east edge, until the pointer
+ * moves on "to"; *pStart is when it went over
+ **********/
+static Bool CrossOver(fromDpy, toDpy, pStart)
+Display *fromDpy, *toDpy;
+double  *pStart;
+{
+  int width = DisplayWidth(fromDpy, DefaultScreen(fromDpy));
+  int height = DisplayHeight(fromDpy, DefaultScreen(fromDpy));
+  int toWidth = DisplayWidth(toDpy, DefaultScreen(toDpy));
+
+  XTestFakeMotionEvent(fromDpy, -1, width / 2, height / 2, 0);
+  XWarpPointer(toDpy, None, DefaultRootWindow(toDpy), 0, 0, 0, 0,
+               toWidth - 1, 0);
+  XSync(toDpy, False);
+  XSync(fromDpy, False);
+  *pStart = Now();
+  XTestFakeMotionEvent(fromDpy, -1, width - 1, height / 2, 0);
+  XFlush(fromDpy);
+  return WaitPointer(toDpy, toWidth - 1);
+
+} /* END CrossOver */
+
+static int Move()
+{
+  Display *fromDpy, *toDpy;
+  int     width, height, counter, toX;
+  double  start;
+  double  *moveMs;
+
+  if (!(fromDpy = XOpenDisplay(fromName)) ||
+      !(toDpy = XOpenDisplay(toName))) {
+    fprintf(stderr, "%s: can not open the displays\n", progName);
+    return 1;
+  }
+  width = DisplayWidth(fromDpy, DefaultScreen(fromDpy));
+  height = DisplayHeight(fromDpy, DefaultScreen(fromDpy));
+  moveMs = (double *)malloc(sizeof(double) * nCrossings);
+
+  if (!CrossOver(fromDpy, toDpy, &start)) {
+    fprintf(stderr, "%s: x2x did not cross\n", progName);
+    return 1;
+  }
+  usleep(50000);
+  /* to and fro around the middle, clear of the edges */
+  for (counter = 0; counter < nCrossings; ++counter) {
+    toX = PointerX(toDpy);
+    start = Now();
+    XTestFakeMotionEvent(fromDpy, -1, (width / 2) + ((counter & 1) ? 50 : -50),
+                         height / 2, 0);
+    XFlush(fromDpy);
+    if (!WaitPointer(toDpy, toX))
+      break;
+    moveMs[counter] = Now() - start;
+    usleep(10000);
+  } /* END for */
+
+  /* back over the west edge */
+  XTestFakeMotionEvent(fromDpy, -1, 0, height / 2, 0);
+  XFlush(fromDpy);
+  if (counter < nCrossings) {
+    fprintf(stderr, "%s: the pointer did not follow\n", progName);
+    return 1;
+  }
+
+  qsort(moveMs, nCrossings, sizeof(double), CompareMs);
+  printf("%.3f %.3f\n", moveMs[nCrossings / 2], moveMs[nCrossings - 1]);
+  return 0;
+
+} /* END Move */
+
+static int Agent()
+{
+  Display *fromDpy, *toDpy;
+  int     fromKey, toKey;
+  double  start, motionMs, keyMs, buttonMs, releaseMs;
+
+  if (!(fromDpy = XOpenDisplay(fromName)) ||
+      !(toDpy = XOpenDisplay(toName))) {
+    fprintf(stderr, "%s: can not open the displays\n", progName);
+    return 1;
+  }
+  fromKey = XKeysymToKeycode(fromDpy, XK_a);
+  toKey = XKeysymToKeycode(toDpy, XK_a);
+
+  if (!CrossOver(fromDpy, toDpy, &start)) {
+    fprintf(stderr, "%s: x2x did not cross\n", progName);
+    return 1;
+  }
+  motionMs = Now() - start;
+  usleep(50000);
+
+  start = Now();
+  XTestFakeKeyEvent(fromDpy, fromKey, True, 0);
+  XFlush(fromDpy);
+  if (!WaitInput(toDpy, toKey, 0, True)) {
+    fprintf(stderr, "%s: the key did not go down\n", progName);
+    return 1;
+  }
+  keyMs = Now() - start;
+
+  start = Now();
+  XTestFakeButtonEvent(fromDpy, 1, True, 0);
+  XFlush(fromDpy);
+  if (!WaitInput(toDpy, 0, Button1Mask, True)) {
+    fprintf(stderr, "%s: the button did not go down\n", progName);
+    return 1;
+  }
+  buttonMs = Now() - start;
+
+  /* the agent loses x2x with both down */
+  start = Now();
+  kill(x2xPid, SIGKILL);
+  if (!WaitInput(toDpy, toKey, Button1Mask, False)) {
+    fprintf(stderr, "%s: the agent did not let go\n", progName);
+    return 1;
+  }
+  releaseMs = Now() - start;
+
+  XTestFakeButtonEvent(fromDpy, 1, False, 0);
+  XTestFakeKeyEvent(fromDpy, fromKey, False, 0);
+  XSync(fromDpy, False);
+  printf("%.3f %.3f %.3f %.3f\n", motionMs, keyMs, buttonMs, releaseMs);
+  return 0;
+
+} /* END Agent */
+
+/**********
+ * poll dpy until key (unless 0) and the buttons in mask are all down,
+ * or all up
+ **********/
+static Bool WaitInput(dpy, key, mask, down)
+Display      *dpy;
+int          key;
+unsigned int mask;
+Bool         down;
+{
+  double       start = Now();
+  char         keys[32];
+  Window       root, child;
+  int          rootX, rootY, winX, winY;
+  unsigned int state;
+  Bool         keyDown;
+
+  while (Now() - start < TIMEOUT) {
+    XQueryKeymap(dpy, keys);
+    keyDown = key && (keys[key >> 3] & (1 << (key & 7)));
+    XQueryPointer(dpy, DefaultRootWindow(dpy), &root, &child, &rootX, &rootY,
+                  &winX, &winY, &state);
+    if (down ? ((keyDown || !key) && ((state & mask) == mask)) :
+        (!keyDown && !(state & mask)))
+      return True;
+    usleep(200);
+  }
+  return False;
+
+} /* END WaitInput */
+
+/**********
+ * poll the pointer of dpy until it leaves x
+ **********/
+static Bool WaitPointer(dpy, x)
+Display *dpy;
+int     x;
+{
+  double start = Now();
+
+  while (Now() - start < TIMEOUT) {
+    if (PointerX(dpy) != x)
+      return True;
+    usleep(200);
+  }
+  return False;
+
+} /* END WaitPointer */
+
+static int PointerX(dpy)
+Display *dpy;
+{
+  Window       root, child;
+  int          rootX, rootY, winX, winY;
+  unsigned int mask;
+
+  XQueryPointer(dpy, DefaultRootWindow(dpy), &root, &child, &rootX, &rootY,
+                &winX, &winY, &mask);
+  return rootX;
+
+} /* END PointerX */
+
+/**********
+ * poll until the keyboard of dpy is free to grab
+ **********/
+static Bool WaitUngrab(dpy)
+Display *dpy;
+{
+  double start = Now();
+
+  while (Now() - start < TIMEOUT) {
+    if (XGrabKeyboard(dpy, DefaultRootWindow(dpy), False, GrabModeAsync,
+                      GrabModeAsync, CurrentTime) == GrabSuccess) {
+      XUngrabKeyboard(dpy, CurrentTime);
+      XSync(dpy, False);
+      return True;
+    }
+    usleep(200);
+  }
+  return False;
+
+} /* END WaitUngrab */
+
+static int CompareMs(a, b)
+const void *a, *b;
+{
+  double diff = *(const double *)a - *(const double *)b;
+
+  return (diff < 0) ? -1 : (diff > 0);
+
+} /* END CompareMs */
@@ -0,0 +1,64 @@
+#!/bin/sh
+#
+# Edge crossing benchmark: x2x from one Xvfb server to another behind
+# "edgebench lag", which delays everything between them, for a few
+# round trip times.
+#
+# Prints one line per delay: the round trip to the "to" display as
+# measured, then the median milliseconds for the pointer to show up on
+# "to" after crossing the edge (connect) and for "from" to be given
+# back after crossing back (disconnect), and the connect time in round
+# trips.
+#
+# X2X, EDGEBENCH, DELAYS and CROSSINGS override the defaults.
+#
+
+X2X=${X2X:-./x2x}
+EDGEBENCH=${EDGEBENCH:-./edgebench}
+DELAYS=${DELAYS:-"0 10 30 100"}
+CROSSINGS=${CROSSINGS:-20}
+
+A=:81
+B=:82
+L=:83 # B, far away
+SOCKETS=/tmp/.X11-unix
+
+pids=
+cleanup() {
+    [ -n "$pids" ] && kill $pids 2>/dev/null
+    wait 2>/dev/null
+}
+trap cleanup EXIT INT TERM
+
+for dpy in $A $B; do
+    Xvfb $dpy -nolisten tcp -screen 0 1024x768x24 >/dev/null 2>&1 &
+    pids="$pids $!"
+    tries=0
+    until [ -S $SOCKETS/X${dpy#:} ]; do
+        tries=$((tries + 1))
+        [ $tries -gt 50 ] && { echo "$0: Xvfb $dpy did not start" >&2; exit 1; }
+        sleep 0.1
+    done
+done
+
+printf "%-8s %s\n" delay-ms "rtt-ms connect-ms disconnect-ms connect-rtts"
+for delay in $DELAYS; do
+    $EDGEBENCH lag -listen $SOCKETS/X${L#:} -to $SOCKETS/X${B#:} \
+        -delay $delay &
+    lag=$!
+    sleep 0.2
+    $X2X -from $A -to $L -east >/dev/null 2>&1 &
+    x2x=$!
+    sleep 1 # for x2x to set up, over the slow link
+
+    result=$($EDGEBENCH cross -from $A -to $B -via $L -n $CROSSINGS) ||
+        result="FAILED"
+
+    kill $x2x $lag 2>/dev/null
+    wait $x2x $lag 2>/dev/null
+    rm -f $SOCKETS/X${L#:}
+    echo $result | awk -v delay=$delay '
+        NF == 3 { printf "%-8s %s %s %s %.2f\n", delay, $3, $1, $2,
+                  ($3 > 0) ? $1 / $3 : 0; next }
+        { printf "%-8s %s\n", delay, $0 }'
+done
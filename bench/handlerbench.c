@@ -0,0 +1,260 @@
+/*
+ * handlerbench: CPU cost of the x2x input handlers, without X servers.
+ *
+ *   handlerbench [-events N]
+ *
+ * x2x.c is compiled in here and linked against bench/xstubs.c, which
+ * replaces the XTEST requests, XFlush, XWarpPointer and the keysym
+ * lookups.  The handlers run on synthetic events for these scenarios,
+ * each with 1, 4 and 32 shadows:
+ *
+ *   motion  pointer moves inside a screen
+ *   key     a key pressed and released
+ *   button  a button pressed and released
+ *   edge    pointer crosses between the two screens of the "to" display
+ *
+ * and print nanoseconds and, where the kernel lets us count them,
+ * instructions per event ("-" otherwise).
+ *
+ * Built with --enable-rtt-audit, a round trip to an X server in any of
+ * the handlers is an error, and handlerbench exits 1 naming the call.
+ */
+
+#define main x2x_main /* x2x's own main is not used */
+#include "../x2x.c"
+#undef main
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#define BENCH_WIDTH    1920
+#define BENCH_HEIGHT   1080
+#define BENCH_SCREENS  2
+#define BENCH_EVENTS   1000000L
+
+#define SCENARIO_MOTION 0
+#define SCENARIO_KEY    1
+#define SCENARIO_BUTTON 2
+#define SCENARIO_EDGE   3
+
+static char    *scenarioNames[] = { "motion", "key", "button", "edge" };
+static int     shadowCounts[] = { 1, 4, 32 };
+
+static long    nEvents = BENCH_EVENTS;
+static char    stubDisplay; /* a Display only the stubs see */
+
+static void    BenchUsage(void);
+static PNODE   BenchNode(int);
+static void    BenchTables(PNODE);
+static void    RunEvents(int, long);
+static int     OpenCounter(void);
+static long long ReadCounter(int);
+
+int main(argc, argv)
+int  argc;
+char **argv;
+{
+  int       scenario, counter, counterFd;
+  long long start, elapsed, instructions;
+
+  for (counter = 1; counter < argc; ++counter) {
+    if (!strcasecmp(argv[counter], "-events")) {
+      if (++counter >= argc) BenchUsage();
+      if ((nEvents = atol(argv[counter])) <= 0) BenchUsage();
+    } else {
+      BenchUsage();
+    }
+  } /* END for */
+
+  counterFd = OpenCounter();
+  printf("%-8s %7s %10s %12s\n", "scenario", "shadows", "ns/event",
+         "instr/event");
+  for (scenario = SCENARIO_MOTION; scenario <= SCENARIO_EDGE; ++scenario) {
+    for (counter = 0;
+         counter < sizeof(shadowCounts) / sizeof(shadowCounts[0]);
+         ++counter) {
+      BenchNode(shadowCounts[counter]);
+#ifdef RTT_AUDIT
+      auditForbid = True;
+#endif
+      RunEvents(scenario, nEvents / 10); /* warm up */
+
+      instructions = ReadCounter(counterFd);
+      start = TraceNow();
+      RunEvents(scenario, nEvents);
+      elapsed = TraceNow() - start;
+      instructions = ReadCounter(counterFd) - instructions;
+#ifdef RTT_AUDIT
+      auditForbid = False;
+#endif
+
+      printf("%-8s %7d %10.1f ", scenarioNames[scenario],
+             shadowCounts[counter], (double)elapsed / nEvents);
+      if (counterFd >= 0)
+        printf("%12.0f\n", (double)instructions / nEvents);
+      else
+        printf("%12s\n", "-");
+    } /* END for counter */
+  } /* END for scenario */
+  return 0;
+
+} /* END main */
+
+static void BenchUsage()
+{
+  printf("Usage: handlerbench [-events <N>]\n");
+  exit(2);
+
+} /* END BenchUsage */
+
+/**********
+ * the state x2x has once connected to a "to" display of two screens
+ * with nShadows displays (itself included) to drive
+ **********/
+static PNODE BenchNode(nShadows)
+int nShadows;
+{
+  PNODE   pNode;
+  PSHADOW pShadow;
+  int     counter;
+
+  pNode = (PNODE)xmalloc(sizeof(NODE));
+  pNode->name = "stub";
+  pNode->dpy = (Display *)&stubDisplay;
+  pNode->fromEdge = EDGE_WEST;
+  for (counter = 0; counter < nShadows; ++counter) {
+    pShadow = (PSHADOW)xmalloc(sizeof(SHADOW));
+    pShadow->name = "stub";
+    pShadow->dpy = (Display *)&stubDisplay;
+    pShadow->agentFd = -1;
+    pShadow->DPMSstatus = 0;
+    pShadow->pNext = pNode->shadows;
+    pNode->shadows = pShadow;
+  } /* END for */
+  pNode->nButtons = 5;
+  for (counter = 0; counter <= N_BUTTONS; ++counter)
+    pNode->inverseMap[counter] = counter;
+  BenchTables(pNode);
+
+  dpyInfo.fromDpy = (Display *)&stubDisplay;
+  dpyInfo.mode = X2X_CONNECTED;
+  dpyInfo.vertical = False;
+  dpyInfo.fromIncrCoord = 3;
+  dpyInfo.fromDecrCoord = BENCH_WIDTH - 4;
+  dpyInfo.lastFromCoord = BENCH_WIDTH / 2;
+  dpyInfo.lastCrossCoord = BENCH_HEIGHT / 2;
+  ActivateNode(&dpyInfo, pNode);
+  return pNode;
+
+} /* END BenchNode */
+
+/**********
+ * one to one tables, each screen of the "to" display beside the other,
+ * as BuildTables makes them
+ **********/
+static void BenchTables(pNode)
+PNODE pNode;
+{
+  int screenNum, counter;
+
+  pNode->nScreens = BENCH_SCREENS;
+  pNode->xTables = (short **)xmalloc(sizeof(short *) * BENCH_SCREENS);
+  pNode->yTables = (short **)xmalloc(sizeof(short *) * BENCH_SCREENS);
+  for (screenNum = 0; screenNum < BENCH_SCREENS; ++screenNum) {
+    pNode->xTables[screenNum] =
+      (short *)xmalloc(sizeof(short) * BENCH_WIDTH);
+    pNode->yTables[screenNum] =
+      (short *)xmalloc(sizeof(short) * BENCH_HEIGHT);
+    for (counter = 0; counter < BENCH_WIDTH; ++counter)
+      pNode->xTables[screenNum][counter] = counter;
+    for (counter = 0; counter < BENCH_HEIGHT; ++counter)
+      pNode->yTables[screenNum][counter] = counter;
+    if (screenNum != 0)
+      for (counter = 0; counter <= 1; ++counter)
+        pNode->xTables[screenNum][counter] = COORD_DECR;
+    if ((screenNum + 1) < BENCH_SCREENS)
+      for (counter = BENCH_WIDTH - 3; counter < BENCH_WIDTH; ++counter)
+        pNode->xTables[screenNum][counter] = COORD_INCR;
+  } /* END for screenNum */
+
+} /* END BenchTables */
+
+static void RunEvents(scenario, n)
+int  scenario;
+long n;
+{
+  XEvent ev;
+  long   counter;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.xany.display = (Display *)&stubDisplay;
+  for (counter = 0; counter < n; ++counter) {
+    switch (scenario) {
+    case SCENARIO_MOTION: /* small moves back and forth, on screen 0 */
+      ev.xmotion.type = MotionNotify;
+      ev.xmotion.same_screen = True;
+      ev.xmotion.x_root = (BENCH_WIDTH / 2) + (counter & 15);
+      ev.xmotion.y_root = (BENCH_HEIGHT / 2) + (counter & 7);
+      ProcessMotionNotify(NULL, &dpyInfo, &ev.xmotion);
+      break;
+    case SCENARIO_KEY:
+      ev.xkey.type = (counter & 1) ? KeyRelease : KeyPress;
+      ev.xkey.keycode = 38 + ((counter >> 1) & 7);
+      ProcessKeyEvent(ev.xany.display, &dpyInfo, &ev.xkey);
+      break;
+    case SCENARIO_BUTTON:
+      ev.xbutton.type = (counter & 1) ? ButtonRelease : ButtonPress;
+      ev.xbutton.button = Button1;
+      if (counter & 1)
+        ProcessButtonRelease(ev.xany.display, &dpyInfo, &ev.xbutton);
+      else
+        ProcessButtonPress(ev.xany.display, &dpyInfo, &ev.xbutton);
+      break;
+    case SCENARIO_EDGE: /* over the right edge of screen 0 and back */
+      ev.xmotion.type = MotionNotify;
+      ev.xmotion.same_screen = True;
+      ev.xmotion.x_root = (dpyInfo.toScreen == 0) ? BENCH_WIDTH - 1 : 0;
+      ev.xmotion.y_root = BENCH_HEIGHT / 2;
+      ProcessMotionNotify(NULL, &dpyInfo, &ev.xmotion);
+      break;
+    } /* END switch */
+  } /* END for */
+
+} /* END RunEvents */
+
+/**********
+ * count the instructions of this process, -1 if not allowed
+ **********/
+static int OpenCounter()
+{
+#ifdef __linux__
+  struct perf_event_attr attr;
+  int fd;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof(attr);
+  attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  if ((fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0)) < 0)
+    return -1;
+  return fd;
+#else
+  return -1;
+#endif
+
+} /* END OpenCounter */
+
+static long long ReadCounter(fd)
+int fd;
+{
+  long long count = 0;
+
+  if ((fd < 0) || (read(fd, &count, sizeof(count)) != sizeof(count)))
+    return 0;
+  return count;
+
+} /* END ReadCounter */
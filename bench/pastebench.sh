@@ -0,0 +1,81 @@
+#!/bin/sh
+#
+# Input during a paste: x2x between two Xvfb servers, the pointer
+# moved on one ("edgebench move") and followed on the other, first
+# idle, then while a large selection goes from the first to the second.
+#
+# Prints the median and longest milliseconds for the pointer to follow,
+# idle and during the paste, and the paste itself (bytes, first-ms,
+# total-ms).  Exits 1 if the paste fails, ends before the moves do, or
+# a move takes longer than LIMIT ms.
+#
+# X2X, SELBENCH, EDGEBENCH, SIZE, MOVES and LIMIT override the defaults.
+#
+
+X2X=${X2X:-./x2x}
+SELBENCH=${SELBENCH:-./selbench}
+EDGEBENCH=${EDGEBENCH:-./edgebench}
+SIZE=${SIZE:-50000000}
+MOVES=${MOVES:-50}
+LIMIT=${LIMIT:-100}
+
+A=:74
+B=:75
+
+pids=
+cleanup() {
+    [ -n "$pids" ] && kill $pids 2>/dev/null
+    wait 2>/dev/null
+}
+trap cleanup EXIT INT TERM
+
+for dpy in $A $B; do
+    Xvfb $dpy -nolisten tcp -screen 0 1024x768x24 >/dev/null 2>&1 &
+    pids="$pids $!"
+    tries=0
+    until $SELBENCH ping -display $dpy 2>/dev/null; do
+        tries=$((tries + 1))
+        [ $tries -gt 50 ] && { echo "$0: Xvfb $dpy did not start" >&2; exit 1; }
+        sleep 0.1
+    done
+done
+
+$X2X -from $A -to $B -east -selcache 0 >/dev/null 2>&1 &
+pids="$pids $!"
+sleep 0.3
+
+idle=$($EDGEBENCH move -from $A -to $B -n $MOVES) || exit 1
+
+$SELBENCH own -display $A -target STRING -size $SIZE &
+pids="$pids $!"
+sleep 0.3 # for x2x to take over the selection on the other side
+
+out=$(mktemp)
+trap 'cleanup; rm -f $out' EXIT INT TERM
+( $SELBENCH get -display $B -target STRING -size $SIZE || echo FAILED ) \
+    > $out &
+paste=$!
+sleep 0.1 # the transfer under way
+busy=$($EDGEBENCH move -from $A -to $B -n $MOVES) || exit 1
+kill -0 $paste 2>/dev/null && during=yes || during=no
+wait $paste
+result=$(cat $out)
+
+printf "%-6s %s\n" "" "median-ms max-ms"
+printf "%-6s %s\n" idle "$idle"
+printf "%-6s %s\n" paste "$busy"
+printf "%-6s %s\n" bytes "$result (bytes first-ms total-ms)"
+
+status=0
+case "$result" in
+    FAILED*) echo "$0: the paste failed" >&2; status=1 ;;
+esac
+if [ $during = no ]; then
+    echo "$0: the paste ended before the moves; raise SIZE" >&2
+    status=1
+fi
+if [ $(echo "$busy" | awk -v limit=$LIMIT '{ print ($2 > limit) }') = 1 ]; then
+    echo "$0: the pointer took over $LIMIT ms to follow" >&2
+    status=1
+fi
+exit $status
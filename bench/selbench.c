@@ -0,0 +1,280 @@
+/*
+ * selbench: selection owner and requestor for benchmarking the
+ * selection forwarding of x2x.
+ *
+ *   selbench ping -display D
+ *   selbench own -display D -selection S -target T -size N
+ *   selbench get -display D -selection S -target T -size N
+ *
+ * "own" serves N bytes of text for target T (and TARGETS) until killed,
+ * with INCR if they do not fit one request.  "get" converts the
+ * selection and prints the bytes received, the time to the first byte
+ * and the total time in milliseconds; it fails if it did not get N
+ * bytes.  "ping" succeeds once the display can be opened.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+
+#define MODE_PING 0
+#define MODE_OWN  1
+#define MODE_GET  2
+
+/* a conversion nobody answers */
+#define TIMEOUT 120
+
+static char    *progName;
+static int     mode;
+static char    *dpyName = NULL;
+static char    *selName = "PRIMARY";
+static char    *targetName = "STRING";
+static long    size = 0;
+
+static Display *dpy;
+static Window  win;
+static Atom    selAtom, targetAtom, targetsAtom, incrAtom, propAtom;
+
+static void    Usage(void);
+static void    ParseCommandLine(int, char **);
+static double  Now(void);
+static Time    GetTimestamp(void);
+static int     Own(void);
+static int     Get(void);
+
+int main(argc, argv)
+int  argc;
+char **argv;
+{
+  progName = argv[0];
+  ParseCommandLine(argc, argv);
+
+  if (!(dpy = XOpenDisplay(dpyName)))
+    return 1;
+  if (mode == MODE_PING) {
+    XCloseDisplay(dpy);
+    return 0;
+  }
+
+  win = XCreateSimpleWindow(dpy, XDefaultRootWindow(dpy), 0, 0, 1, 1, 0,
+                            0, 0);
+  XSelectInput(dpy, win, PropertyChangeMask);
+  selAtom     = XInternAtom(dpy, selName, False);
+  targetAtom  = XInternAtom(dpy, targetName, False);
+  targetsAtom = XInternAtom(dpy, "TARGETS", False);
+  incrAtom    = XInternAtom(dpy, "INCR", False);
+  propAtom    = XInternAtom(dpy, "_SELBENCH", False);
+
+  alarm(TIMEOUT);
+  return (mode == MODE_OWN) ? Own() : Get();
+
+} /* END main */
+
+static void Usage()
+{
+  printf("Usage: %s ping|own|get [options]\n", progName);
+  printf("       -display <DISPLAY>\n");
+  printf("       -selection <SELECTION> (default PRIMARY)\n");
+  printf("       -target <TARGET> (default STRING)\n");
+  printf("       -size <BYTES>\n");
+  exit(2);
+
+} /* END Usage */
+
+static void ParseCommandLine(argc, argv)
+int  argc;
+char **argv;
+{
+  int arg;
+
+  if (argc < 2)
+    Usage();
+  if (!strcasecmp(argv[1], "ping"))
+    mode = MODE_PING;
+  else if (!strcasecmp(argv[1], "own"))
+    mode = MODE_OWN;
+  else if (!strcasecmp(argv[1], "get"))
+    mode = MODE_GET;
+  else
+    Usage();
+
+  for (arg = 2; arg < argc; ++arg) {
+    if (!strcasecmp(argv[arg], "-display")) {
+      if (++arg >= argc) Usage();
+      dpyName = argv[arg];
+    } else if (!strcasecmp(argv[arg], "-selection")) {
+      if (++arg >= argc) Usage();
+      selName = argv[arg];
+    } else if (!strcasecmp(argv[arg], "-target")) {
+      if (++arg >= argc) Usage();
+      targetName = argv[arg];
+    } else if (!strcasecmp(argv[arg], "-size")) {
+      if (++arg >= argc) Usage();
+      size = atol(argv[arg]);
+    } else {
+      Usage();
+    }
+  } /* END for */
+
+} /* END ParseCommandLine */
+
+static double Now()
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return (tv.tv_sec * 1000.0) + (tv.tv_usec / 1000.0);
+
+} /* END Now */
+
+/**********
+ * a server time stamp, as x2x gets it for its own selections
+ **********/
+static Time GetTimestamp()
+{
+  XEvent ev;
+
+  XChangeProperty(dpy, win, propAtom, XA_STRING, 8, PropModeAppend,
+                  NULL, 0);
+  do {
+    XNextEvent(dpy, &ev);
+  } while ((ev.type != PropertyNotify) || (ev.xproperty.atom != propAtom));
+  return ev.xproperty.time;
+
+} /* END GetTimestamp */
+
+/**********
+ * serve the selection until killed
+ **********/
+static int Own()
+{
+  XEvent        ev;
+  XSelectionRequestEvent *pReq;
+  XSelectionEvent notify;
+  unsigned char *data;
+  long          chunk, offset = 0;
+  long          counter;
+  Window        incrWin = None;
+  Atom          incrProp = None;
+  Atom          targets[2];
+
+  data = (unsigned char *)malloc(size ? size : 1);
+  for (counter = 0; counter < size; ++counter)
+    data[counter] = 'a' + (counter % 26);
+  chunk = (XMaxRequestSize(dpy) << 2) - 100;
+
+  XSetSelectionOwner(dpy, selAtom, win, GetTimestamp());
+  if (XGetSelectionOwner(dpy, selAtom) != win)
+    return 1;
+  alarm(0);
+
+  for (;;) {
+    XNextEvent(dpy, &ev);
+    if ((ev.type == PropertyNotify) && (ev.xproperty.state == PropertyDelete)
+        && (ev.xproperty.window == incrWin)
+        && (ev.xproperty.atom == incrProp)) {
+      /* requestor took a chunk: the next one, zero length at the end */
+      counter = (size - offset < chunk) ? size - offset : chunk;
+      XChangeProperty(dpy, incrWin, incrProp, targetAtom, 8,
+                      PropModeReplace, data + offset, counter);
+      offset += counter;
+      if (counter == 0) {
+        XSelectInput(dpy, incrWin, NoEventMask);
+        incrWin = None;
+      }
+      XFlush(dpy);
+      continue;
+    }
+    if (ev.type != SelectionRequest)
+      continue;
+
+    pReq = &(ev.xselectionrequest);
+    notify.type      = SelectionNotify;
+    notify.display   = dpy;
+    notify.requestor = pReq->requestor;
+    notify.selection = pReq->selection;
+    notify.target    = pReq->target;
+    notify.property  = (pReq->property == None) ?
+      pReq->target : pReq->property;
+    notify.time      = pReq->time;
+
+    if (pReq->target == targetsAtom) {
+      targets[0] = targetsAtom;
+      targets[1] = targetAtom;
+      XChangeProperty(dpy, pReq->requestor, notify.property, XA_ATOM, 32,
+                      PropModeReplace, (unsigned char *)targets, 2);
+    } else if (pReq->target != targetAtom) {
+      notify.property = None;
+    } else if (size <= chunk) {
+      XChangeProperty(dpy, pReq->requestor, notify.property, targetAtom, 8,
+                      PropModeReplace, data, size);
+    } else if (incrWin == None) {
+      incrWin  = pReq->requestor;
+      incrProp = notify.property;
+      offset   = 0;
+      XSelectInput(dpy, incrWin, PropertyChangeMask);
+      XChangeProperty(dpy, incrWin, incrProp, incrAtom, 32,
+                      PropModeReplace, (unsigned char *)&size, 1);
+    } else { /* one INCR transfer at a time */
+      notify.property = None;
+    }
+    XSendEvent(dpy, pReq->requestor, False, 0, (XEvent *)&notify);
+    XFlush(dpy);
+  } /* END for */
+
+} /* END Own */
+
+/**********
+ * convert the selection once and time it
+ **********/
+static int Get()
+{
+  XEvent        ev;
+  Atom          type;
+  int           format;
+  unsigned long nitems, after;
+  unsigned char *prop;
+  long          received = 0;
+  double        start, first = 0.0;
+  Bool          incr = False;
+
+  start = Now();
+  XConvertSelection(dpy, selAtom, targetAtom, propAtom, win, CurrentTime);
+  do {
+    XNextEvent(dpy, &ev);
+  } while (ev.type != SelectionNotify);
+  if (ev.xselection.property == None)
+    return 1;
+
+  for (;;) {
+    if (XGetWindowProperty(dpy, win, propAtom, 0L, 0x1fffffffL, True,
+                           AnyPropertyType, &type, &format, &nitems, &after,
+                           &prop) != Success)
+      return 1;
+    if (prop)
+      XFree(prop);
+    if (type == incrAtom) {
+      incr = True;
+    } else {
+      if (first == 0.0)
+        first = Now();
+      received += nitems * (format >> 3);
+      if (!incr || (nitems == 0))
+        break;
+    }
+    /* wait for the next chunk */
+    do {
+      XNextEvent(dpy, &ev);
+    } while ((ev.type != PropertyNotify) ||
+             (ev.xproperty.atom != propAtom) ||
+             (ev.xproperty.state != PropertyNewValue));
+  } /* END for */
+
+  printf("%ld %.3f %.3f\n", received, first - start, Now() - start);
+  return (received == size) ? 0 : 1;
+
+} /* END Get */
@@ -0,0 +1,90 @@
+#!/bin/sh
+#
+# Selection forwarding benchmark: x2x between two Xvfb servers, a
+# selbench owner on one and a selbench requestor on the other, for
+# growing sizes, both directions and STRING and UTF8_STRING.
+#
+# Prints one line per case: direction, target, bytes, milliseconds to
+# the first byte and in total, peak RSS of x2x in kB, and round trips
+# of x2x to the requesting display if xtrace is installed ("-" if not).
+#
+# X2X, SELBENCH, SIZES, TARGETS and SELECTION override the defaults.
+#
+
+X2X=${X2X:-./x2x}
+SELBENCH=${SELBENCH:-./selbench}
+SIZES=${SIZES:-"10 1000 100000 1000000 10000000 100000000"}
+TARGETS=${TARGETS:-"STRING UTF8_STRING"}
+SELECTION=${SELECTION:-PRIMARY}
+
+A=:71
+B=:72
+T=:73 # xtrace in front of the requesting display
+
+pids=
+cleanup() {
+    [ -n "$pids" ] && kill $pids 2>/dev/null
+    wait 2>/dev/null
+}
+trap cleanup EXIT INT TERM
+
+for dpy in $A $B; do
+    Xvfb $dpy -nolisten tcp -screen 0 1024x768x24 >/dev/null 2>&1 &
+    pids="$pids $!"
+    tries=0
+    until $SELBENCH ping -display $dpy 2>/dev/null; do
+        tries=$((tries + 1))
+        [ $tries -gt 50 ] && { echo "$0: Xvfb $dpy did not start" >&2; exit 1; }
+        sleep 0.1
+    done
+done
+
+haveXtrace=no
+command -v xtrace >/dev/null 2>&1 && haveXtrace=yes
+
+# run one case: from-display (owner), to-display (requestor), target, size
+run() {
+    owner=$1 requestor=$2 target=$3 size=$4
+    log=$(mktemp)
+
+    if [ $haveXtrace = yes ]; then
+        xtrace -n -d $requestor -D $T -o $log >/dev/null 2>&1 &
+        tracer=$!
+        sleep 0.2
+        reqDpy=$T
+    else
+        tracer=
+        reqDpy=$requestor
+    fi
+    $X2X -from $owner -to $reqDpy -east -selcache 0 >/dev/null 2>&1 &
+    x2x=$!
+    sleep 0.3
+    $SELBENCH own -display $owner -selection $SELECTION -target $target \
+        -size $size &
+    owner_pid=$!
+    sleep 0.3 # for x2x to take over the selection on the other side
+
+    result=$($SELBENCH get -display $requestor -selection $SELECTION \
+             -target $target -size $size) || result="FAILED"
+    rss=$(awk '/^VmHWM/ { print $2 }' /proc/$x2x/status 2>/dev/null)
+
+    kill $owner_pid $x2x $tracer 2>/dev/null
+    wait $owner_pid $x2x $tracer 2>/dev/null
+    if [ -n "$tracer" ]; then
+        rtts=$(grep -c "reply" $log)
+    else
+        rtts=-
+    fi
+    rm -f $log
+
+    printf "%-8s %-12s %s %s %s\n" "$5" $target "$result" "${rss:--}" $rtts
+}
+
+printf "%-8s %-12s %s\n" direction target \
+    "bytes first-ms total-ms x2x-peak-kB round-trips"
+for target in $TARGETS; do
+    for size in $SIZES; do
+        run $A $B $target $size "a->b"
+        run $B $A $target $size "b->a"
+    done
+done
@@ -0,0 +1,182 @@
+/*
+ * transbench: speed of the selection text conversions, without X.
+ *
+ *   transbench [-mb N]
+ *
+ * Makes N MB (64 by default) of ASCII text, of Latin-1 text with one
+ * letter in 20 accented, and of that text in UTF-8, and runs on each
+ * the check x2x does (kind), UTF-8 to Latin-1 and Latin-1 to UTF-8 with
+ * every implementation this CPU has: scalar, SSE2 and AVX2.  Kind is not
+ * run on Latin-1: it stops at the first accented letter.  It prints
+ * MB of input per second, the best of 5 runs ("-" if the CPU lacks
+ * one), and exits 1 if two implementations do not give the same result.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "../transcode.h"
+
+#define BENCH_MB    64
+#define BENCH_RUNS  5
+
+#define OP_KIND     0
+#define OP_TOLATIN1 1
+#define OP_TOUTF8   2
+
+#define INPUT_LATIN1 1
+
+static char    *opNames[] = { "kind", "to-latin1", "to-utf8" };
+static char    *inputNames[] = { "ascii", "latin1", "utf8" };
+static char    *simdNames[] = { "scalar", "sse2", "avx2" };
+
+static size_t  size = (size_t)BENCH_MB << 20;
+
+static void    Usage(void);
+static double  Now(void);
+static void    MakeText(unsigned char *, size_t, int);
+static size_t  RunOp(int, unsigned char *, size_t, unsigned char *);
+
+int main(argc, argv)
+int  argc;
+char **argv;
+{
+  unsigned char *inputs[3], *out, *expected;
+  size_t  lens[3], outLen, expectedLen;
+  int     counter, op, input, simd, run, best;
+  double  start, ms, bestMs;
+  int     status = 0;
+
+  for (counter = 1; counter < argc; ++counter) {
+    if (!strcasecmp(argv[counter], "-mb")) {
+      if (++counter >= argc) Usage();
+      if ((size = (size_t)atol(argv[counter]) << 20) == 0) Usage();
+    } else {
+      Usage();
+    }
+  } /* END for */
+
+  best = TranscodeSimd(-1);
+  for (input = 0; input < 2; ++input) {
+    inputs[input] = (unsigned char *)malloc(size);
+    MakeText(inputs[input], size, input);
+    lens[input] = size;
+  }
+  inputs[2] = (unsigned char *)malloc(2 * size);
+  lens[2] = Latin1ToUtf8(inputs[1], size, inputs[2]);
+  out = (unsigned char *)malloc(2 * lens[2]);
+  expected = (unsigned char *)malloc(2 * lens[2]);
+  if (!inputs[0] || !inputs[1] || !inputs[2] || !out || !expected) {
+    fprintf(stderr, "transbench: out of memory\n");
+    return 2;
+  }
+
+  printf("%-10s %-7s", "op", "input");
+  for (simd = SIMD_NONE; simd <= SIMD_AVX2; ++simd)
+    printf(" %9s", simdNames[simd]);
+  printf("   (MB/s)\n");
+  for (op = OP_KIND; op <= OP_TOUTF8; ++op) {
+    for (input = 0; input < 3; ++input) {
+      if ((op == OP_KIND) && (input == INPUT_LATIN1))
+        continue; /* not a scan of the input */
+      printf("%-10s %-7s", opNames[op], inputNames[input]);
+      expectedLen = 0;
+      for (simd = SIMD_NONE; simd <= SIMD_AVX2; ++simd) {
+        if (simd > best) {
+          printf(" %9s", "-");
+          continue;
+        }
+        TranscodeSimd(simd);
+        bestMs = 0;
+        for (run = 0; run < BENCH_RUNS; ++run) {
+          start = Now();
+          outLen = RunOp(op, inputs[input], lens[input], out);
+          ms = Now() - start;
+          if ((run == 0) || (ms < bestMs))
+            bestMs = ms;
+        } /* END for run */
+        if (bestMs < 0.001) /* too quick to time */
+          bestMs = 0.001;
+        printf(" %9.0f", (lens[input] / 1048576.0) / (bestMs / 1000.0));
+
+        if (simd == SIMD_NONE) {
+          memcpy(expected, out, outLen);
+          expectedLen = outLen;
+        } else if ((outLen != expectedLen) ||
+                   memcmp(out, expected, outLen)) {
+          printf(" <- differs from scalar");
+          status = 1;
+        }
+      } /* END for simd */
+      printf("\n");
+    } /* END for input */
+  } /* END for op */
+  return status;
+
+} /* END main */
+
+static void Usage()
+{
+  printf("Usage: transbench [-mb <N>]\n");
+  exit(2);
+
+} /* END Usage */
+
+static double Now()
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return (tv.tv_sec * 1000.0) + (tv.tv_usec / 1000.0);
+
+} /* END Now */
+
+/**********
+ * words of 2 to 9 letters, accented (Latin-1) one letter in 20 unless
+ * ascii
+ **********/
+static void MakeText(text, len, latin1)
+unsigned char *text;
+size_t len;
+int    latin1;
+{
+  size_t n;
+  int    word = 0;
+
+  srand(7);
+  for (n = 0; n < len; ++n) {
+    if (word == 0) {
+      word = 2 + (rand() % 8);
+      text[n] = (n % 80 < 70) ? ' ' : '\n';
+    } else {
+      text[n] = (latin1 && (rand() % 20 == 0)) ?
+        0xe0 + (rand() % 32) : 'a' + (rand() % 26);
+      --word;
+    }
+  } /* END for */
+
+} /* END MakeText */
+
+/**********
+ * bytes put into out; kind puts the kind
+ **********/
+static size_t RunOp(op, in, len, out)
+int    op;
+unsigned char *in;
+size_t len;
+unsigned char *out;
+{
+  size_t used;
+
+  switch (op) {
+  case OP_KIND:
+    out[0] = TextKind(in, len);
+    return 1;
+  case OP_TOLATIN1:
+    return Utf8ToLatin1(in, len, out, &used);
+  default:
+    return Latin1ToUtf8(in, len, out);
+  } /* END switch */
+
+} /* END RunOp */
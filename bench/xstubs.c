@@ -0,0 +1,106 @@
+/*
+ * xstubs: the X calls on the input path of x2x, replaced at link time
+ * for handlerbench.  They only count, so that a benchmark measures the
+ * handlers and not the X servers; being in their own file they stay
+ * real calls, as into Xlib.
+ */
+
+#include <X11/Xlib.h>
+#include <X11/XKBlib.h>
+#include <X11/extensions/XTest.h>
+
+#define STUB_KEYCODE 38 /* any key the stub maps every keysym to */
+
+long stubRequests = 0; /* requests that would have gone to a server */
+long stubFlushes  = 0;
+
+int XTestFakeMotionEvent(dpy, screen, x, y, delay)
+Display       *dpy;
+int           screen, x, y;
+unsigned long delay;
+{
+  ++stubRequests;
+  return 1;
+
+} /* END XTestFakeMotionEvent */
+
+int XTestFakeKeyEvent(dpy, keycode, isPress, delay)
+Display       *dpy;
+unsigned int  keycode;
+Bool          isPress;
+unsigned long delay;
+{
+  ++stubRequests;
+  return 1;
+
+} /* END XTestFakeKeyEvent */
+
+int XTestFakeButtonEvent(dpy, button, isPress, delay)
+Display       *dpy;
+unsigned int  button;
+Bool          isPress;
+unsigned long delay;
+{
+  ++stubRequests;
+  return 1;
+
+} /* END XTestFakeButtonEvent */
+
+int XFlush(dpy)
+Display *dpy;
+{
+  ++stubFlushes;
+  return 1;
+
+} /* END XFlush */
+
+/* no event is ever read behind the one being handled */
+int XEventsQueued(dpy, mode)
+Display *dpy;
+int     mode;
+{
+  return 0;
+
+} /* END XEventsQueued */
+
+/* requests are not numbered: no event is older than a warp */
+unsigned long XNextRequest(dpy)
+Display *dpy;
+{
+  return 0;
+
+} /* END XNextRequest */
+
+int XWarpPointer(dpy, srcWin, dstWin, srcX, srcY, srcWidth, srcHeight,
+                 dstX, dstY)
+Display      *dpy;
+Window       srcWin, dstWin;
+int          srcX, srcY;
+unsigned int srcWidth, srcHeight;
+int          dstX, dstY;
+{
+  ++stubRequests;
+  return 1;
+
+} /* END XWarpPointer */
+
+KeyCode XKeysymToKeycode(dpy, keysym)
+Display *dpy;
+KeySym  keysym;
+{
+  return (keysym == NoSymbol) ? 0 : STUB_KEYCODE;
+
+} /* END XKeysymToKeycode */
+
+/* prototype style: a narrow KeyCode can not be declared the old way */
+KeySym XkbKeycodeToKeysym(Display *dpy,
+#if NeedWidePrototypes
+                          unsigned int keycode,
+#else
+                          KeyCode keycode,
+#endif
+                          int group, int level)
+{
+  return (KeySym)('a' + (keycode % 26));
+
+} /* END XkbKeycodeToKeysym */
@@ -0,0 +1,275 @@
+/*
+ * transcode: STRING (ISO Latin-1) and UTF8_STRING (UTF-8) text, one
+ * into the other, for the selections x2x relays.
+ *
+ * Runs of ASCII, the bulk of most text and the same in both encodings,
+ * are found and copied 32 (AVX2) or 16 (SSE2) bytes at a time, else 8
+ * at a time in a word; the other characters go one by one.  Which of
+ * these runs is decided at the first call, from what the CPU has.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include "transcode.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TRANSCODE_X86
+#include <immintrin.h>
+#endif
+
+static int     simdLevel = -1; /* until the CPU is asked */
+
+static size_t  AsciiRun(const unsigned char *, size_t, unsigned char *);
+static size_t  AsciiScalar(const unsigned char *, size_t, unsigned char *);
+#ifdef TRANSCODE_X86
+static size_t  AsciiSse2(const unsigned char *, size_t, unsigned char *);
+static size_t  AsciiAvx2(const unsigned char *, size_t, unsigned char *);
+#endif
+static int     Utf8Char(const unsigned char *, size_t, unsigned long *);
+
+/**********
+ * TEXT_ASCII, TEXT_UTF8 or TEXT_OTHER; a character cut short at the end
+ * is not UTF-8
+ **********/
+int TextKind(in, len)
+const unsigned char *in;
+size_t len;
+{
+  size_t i = 0;
+  unsigned long code;
+  int n, kind = TEXT_ASCII;
+
+  while ((i += AsciiRun(in + i, len - i, NULL)) < len) {
+    if ((n = Utf8Char(in + i, len - i, &code)) <= 0)
+      return TEXT_OTHER;
+    kind = TEXT_UTF8;
+    i += n;
+  } /* END while */
+  return kind;
+
+} /* END TextKind */
+
+/**********
+ * out has room for 2 * len bytes; returns the bytes put there
+ **********/
+size_t Latin1ToUtf8(in, len, out)
+const unsigned char *in;
+size_t len;
+unsigned char *out;
+{
+  size_t i = 0, o = 0, run;
+
+  while (i < len) {
+    run = AsciiRun(in + i, len - i, out + o);
+    i += run;
+    o += run;
+    for (; (i < len) && (in[i] >= 0x80); ++i) {
+      out[o++] = 0xc0 | (in[i] >> 6);
+      out[o++] = 0x80 | (in[i] & 0x3f);
+    }
+  } /* END while */
+  return o;
+
+} /* END Latin1ToUtf8 */
+
+/**********
+ * out has room for len bytes; returns the bytes put there.  Characters
+ * beyond Latin-1 and each byte that is not UTF-8 become TEXT_BAD_CHAR.
+ * A character cut short at the end is left, *pUsed tells where it
+ * starts.
+ **********/
+size_t Utf8ToLatin1(in, len, out, pUsed)
+const unsigned char *in;
+size_t len;
+unsigned char *out;
+size_t *pUsed;
+{
+  size_t i = 0, o = 0, run;
+  unsigned long code;
+  int n = 1;
+
+  while ((i < len) && n) {
+    run = AsciiRun(in + i, len - i, out + o);
+    i += run;
+    o += run;
+    while ((i < len) && (in[i] >= 0x80)) {
+      if ((n = Utf8Char(in + i, len - i, &code)) == 0)
+        break; /* cut short */
+      if (n < 0) {
+        out[o++] = TEXT_BAD_CHAR;
+        ++i;
+      } else {
+        out[o++] = (code <= 0xff) ? code : TEXT_BAD_CHAR;
+        i += n;
+      }
+    } /* END while not ASCII */
+  } /* END while */
+  *pUsed = i;
+  return o;
+
+} /* END Utf8ToLatin1 */
+
+/**********
+ * use SIMD_NONE, SIMD_SSE2 or SIMD_AVX2 if the CPU has it, the best
+ * there is for -1; returns the one used
+ **********/
+int TranscodeSimd(level)
+int level;
+{
+  int best = SIMD_NONE;
+
+#ifdef TRANSCODE_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2"))
+    best = SIMD_SSE2;
+  if (__builtin_cpu_supports("avx2"))
+    best = SIMD_AVX2;
+#endif
+  simdLevel = ((level < 0) || (level > best)) ? best : level;
+  return simdLevel;
+
+} /* END TranscodeSimd */
+
+/**********
+ * bytes of ASCII at the start of in, copied to out unless it is NULL.
+ * out may get up to a vector of bytes beyond them.
+ **********/
+static size_t AsciiRun(in, len, out)
+const unsigned char *in;
+size_t len;
+unsigned char *out;
+{
+  if (simdLevel < 0)
+    TranscodeSimd(-1);
+  switch (simdLevel) {
+#ifdef TRANSCODE_X86
+  case SIMD_AVX2:
+    return AsciiAvx2(in, len, out);
+  case SIMD_SSE2:
+    return AsciiSse2(in, len, out);
+#endif
+  default:
+    return AsciiScalar(in, len, out);
+  } /* END switch */
+
+} /* END AsciiRun */
+
+static size_t AsciiScalar(in, len, out)
+const unsigned char *in;
+size_t len;
+unsigned char *out;
+{
+  unsigned long long word;
+  size_t n;
+
+  for (n = 0; n + sizeof(word) <= len; n += sizeof(word)) {
+    memcpy(&word, in + n, sizeof(word));
+    if (word & 0x8080808080808080ULL)
+      break;
+    if (out)
+      memcpy(out + n, &word, sizeof(word));
+  } /* END for */
+  for (; (n < len) && (in[n] < 0x80); ++n)
+    if (out)
+      out[n] = in[n];
+  return n;
+
+} /* END AsciiScalar */
+
+#ifdef TRANSCODE_X86
+static size_t __attribute__((target("sse2"))) AsciiSse2(in, len, out)
+const unsigned char *in;
+size_t len;
+unsigned char *out;
+{
+  __m128i block;
+  unsigned int mask;
+  size_t n;
+
+  for (n = 0; n + 16 <= len; n += 16) {
+    block = _mm_loadu_si128((const __m128i *)(in + n));
+    if (out)
+      _mm_storeu_si128((__m128i *)(out + n), block);
+    if ((mask = _mm_movemask_epi8(block)))
+      return n + __builtin_ctz(mask);
+  } /* END for */
+  return n + AsciiScalar(in + n, len - n, out ? out + n : NULL);
+
+} /* END AsciiSse2 */
+
+static size_t __attribute__((target("avx2"))) AsciiAvx2(in, len, out)
+const unsigned char *in;
+size_t len;
+unsigned char *out;
+{
+  __m256i block;
+  unsigned int mask;
+  size_t n;
+
+  for (n = 0; n + 32 <= len; n += 32) {
+    block = _mm256_loadu_si256((const __m256i *)(in + n));
+    if (out)
+      _mm256_storeu_si256((__m256i *)(out + n), block);
+    if ((mask = _mm256_movemask_epi8(block)))
+      return n + __builtin_ctz(mask);
+  } /* END for */
+  return n + AsciiSse2(in + n, len - n, out ? out + n : NULL);
+
+} /* END AsciiAvx2 */
+#endif /* TRANSCODE_X86 */
+
+/**********
+ * the bytes of the UTF-8 character in starts with, 0 if it is cut
+ * short, -1 if it is not one (overlong forms and surrogates are not)
+ **********/
+static int Utf8Char(in, len, pCode)
+const unsigned char *in;
+size_t len;
+unsigned long *pCode;
+{
+  unsigned char lo = 0x80, hi = 0xbf; /* of the second byte */
+  unsigned long code;
+  int need, counter;
+
+  if (in[0] < 0x80) {
+    *pCode = in[0];
+    return 1;
+  } else if (in[0] < 0xc2) { /* continuation, or overlong */
+    return -1;
+  } else if (in[0] < 0xe0) {
+    need = 2;
+    code = in[0] & 0x1f;
+  } else if (in[0] < 0xf0) {
+    need = 3;
+    code = in[0] & 0x0f;
+    if (in[0] == 0xe0)
+      lo = 0xa0;
+    else if (in[0] == 0xed)
+      hi = 0x9f;
+  } else if (in[0] < 0xf5) {
+    need = 4;
+    code = in[0] & 0x07;
+    if (in[0] == 0xf0)
+      lo = 0x90;
+    else if (in[0] == 0xf4)
+      hi = 0x8f;
+  } else {
+    return -1;
+  }
+
+  for (counter = 1; counter < need; ++counter) {
+    if (counter >= len)
+      return 0;
+    if ((in[counter] < lo) || (in[counter] > hi))
+      return -1;
+    code = (code << 6) | (in[counter] & 0x3f);
+    lo = 0x80;
+    hi = 0xbf;
+  } /* END for */
+  *pCode = code;
+  return need;
+
+} /* END Utf8Char */
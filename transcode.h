@@ -0,0 +1,30 @@
+/*
+ * transcode: the two text encodings of selections, STRING (ISO Latin-1)
+ * and UTF8_STRING (UTF-8), one into the other.
+ */
+
+#ifndef X2X_TRANSCODE_H
+#define X2X_TRANSCODE_H
+
+#include <stddef.h>
+
+/* what TextKind finds */
+#define TEXT_ASCII      0  /* the same in both encodings */
+#define TEXT_UTF8       1  /* well formed UTF-8, not all ASCII */
+#define TEXT_OTHER      2  /* not UTF-8: taken as Latin-1 */
+
+/* what Latin-1 can not say, and what is not UTF-8 */
+#define TEXT_BAD_CHAR   '?'
+
+/* implementations, fastest last */
+#define SIMD_NONE       0
+#define SIMD_SSE2       1
+#define SIMD_AVX2       2
+
+int    TextKind(const unsigned char *, size_t);
+size_t Latin1ToUtf8(const unsigned char *, size_t, unsigned char *);
+size_t Utf8ToLatin1(const unsigned char *, size_t, unsigned char *,
+                    size_t *);
+int    TranscodeSimd(int);
+
+#endif /* X2X_TRANSCODE_H */
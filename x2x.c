@@ -78,13 +78,30 @@
 
 
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <string.h>
 #include <unistd.h>
 #include <signal.h>
 #include <errno.h>
+#include <sys/time.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 #include <X11/Xlib.h>
+#include <X11/Xlibint.h> /* pipelined requests */
+#undef xmalloc /* Xthreads.h's, not ours */
 #include <X11/Xresource.h>
 #include <X11/Xutil.h>
 #include <X11/cursorfont.h>
@@ -94,6 +111,18 @@
 #include <X11/extensions/dpms.h>
 #include <X11/keysym.h>
 #include <X11/XKBlib.h>
+#include "agent.h"
+#include "transcode.h"
+#ifdef HAVE_BARRIERS
+#include <X11/extensions/Xfixes.h>
+#include <X11/extensions/XInput2.h>
+#endif
+#ifdef HAVE_XFIXES
+#include <X11/extensions/Xfixes.h>
+#endif
+#ifdef HAVE_RANDR
+#include <X11/extensions/Xrandr.h>
+#endif
 
 #ifdef WIN_2_X
 #define _WIN32_WINNT 0x0500
@@ -111,6 +140,7 @@ extern Status DPMSForceLevel(Display *, unsigned short);
 #define DPMSQueryExtension(DPY, EVBASE, ERBASE) TRUE
 #else
 #include <X11/extensions/dpms.h>
+#include <X11/extensions/dpmsproto.h> /* DPMSInfo without waiting */
 #endif
 
 
@@ -127,6 +157,22 @@ extern Status DPMSForceLevel(Display *, unsigned short);
 
 #define UTF8_STRING "UTF8_STRING"
 
+/* atoms interned at startup with one request per display: the "to"
+   display needs the first N_TO_ATOMS */
+#define ATOM_UTF8_STRING        0
+#define ATOM_PING               1
+#define ATOM_INCR               2
+#define ATOM_MULTIPLE           3
+#define ATOM_CLIPBOARD          4
+#define N_TO_ATOMS              5
+#define ATOM_WM_PROTOCOLS       5
+#define ATOM_WM_DELETE_WINDOW   6
+#define ATOM_NET_WM_WINDOW_TYPE 7
+#define ATOM_NET_WM_WINDOW_TYPE_DOCK 8
+#define ATOM_NET_WM_STRUT       9
+#define ATOM_NET_WM_WINDOW_OPACITY 10
+#define N_STARTUP_ATOMS         11
+
 /**********
  * definitions for edge
  **********/
@@ -136,40 +182,195 @@ extern Status DPMSForceLevel(Display *, unsigned short);
 #define EDGE_EAST   3 /* from display is on the east side of to display */
 #define EDGE_WEST   4 /* from display is on the west side of to display */
 
+static int oppositeEdge[] = { EDGE_NONE, EDGE_SOUTH, EDGE_NORTH,
+                              EDGE_WEST, EDGE_EAST };
+
 /**********
  * stuff for selection forwarding
  **********/
+/* selections relayed between the displays */
+#define SEL_PRIMARY     0
+#define SEL_CLIPBOARD   1
+#define N_SELECTIONS    2
+
+/* an atom of one display and the atom of the same name on the other */
+typedef struct _atommap {
+  struct _atommap *pNext;
+  Atom atom;
+  Atom otherAtom;
+} ATOMMAP, *PATOMMAP;
+
+#define ATOMMAP_SIZE    64 /* hash buckets */
+
+/* atoms for prefetching: our property, then targets not to prefetch */
+#define PF_PROPERTY     0
+#define PF_TARGETS      1
+#define N_PFATOMS       8
+
+/* selection data as read, shared by the cache, a conversion and the
+   writes queued for its requestors: the last of them frees it */
+typedef struct _seldata {
+  int     refs;
+  unsigned char *data;  /* freed with XFree */
+} SELDATA, *PSELDATA;
+
+/* selection data for a requestor, written once the input to the same
+   display is out */
+typedef struct _bulk {
+  struct _bulk *pNext;
+  XSelectionRequestEvent ev; /* requestor window and property */
+  Atom    type;
+  int     format;
+  PSELDATA pData;       /* held until written */
+  unsigned char *data;  /* the items to write, in pData */
+  unsigned long nitems;
+  unsigned long offset; /* items written so far */
+  Bool    notify;       /* SelectionNotify once written: it may go in
+                           pieces, the requestor only reads it then */
+} BULK, *PBULK;
+
 typedef struct _dpyxtra {
   Display *otherDpy;
-  int  sState;
+  int  sState[N_SELECTIONS];
+  Atom selAtom[N_SELECTIONS];
   Atom pingAtom;
   Bool pingInProg;
   Window propWin;
+  Atom incrAtom;
+  Atom multipleAtom;
+  PATOMMAP atomMap[ATOMMAP_SIZE]; /* atoms translated so far */
+  Time ownerTime[N_SELECTIONS]; /* when the owner got it, 0 if unknown */
+  Atom *xferAtoms;    /* transfer properties on propWin */
+  int  nXferAtoms;
+  /* prefetch of a selection newly owned on this display */
+  int  pfSel;         /* -1 if none */
+  Time pfTime;        /* of the conversions */
+  Time pfOwnerTime;
+  Atom pfTarget;      /* being converted */
+  Atom *pfTargets;    /* offered by the owner */
+  int  pfNTargets, pfNext;
+  Bool pfDrain;       /* an INCR answer being thrown away */
+  Atom pfAtoms[N_PFATOMS];
+  PBULK pBulk, pBulkLast; /* selection data not written yet */
 } DPYXTRA, *PDPYXTRA;
 
+/* a converted selection kept for repeated requests from dpy */
+typedef struct _selcache {
+  struct _selcache *pNext;
+  Display *dpy;       /* requesting display */
+  int     sel;
+  Atom    target;     /* as requested on dpy */
+  Time    ownerTime;  /* of the owner on the other display */
+  Atom    type;       /* translated for dpy, as is the data */
+  int     format;
+  unsigned long nitems;
+  PSELDATA pData;
+  long    size;       /* bytes charged against the cache */
+} SELCACHE, *PSELCACHE;
+
+/* a requestor waiting for a conversion */
+typedef struct _selreq {
+  struct _selreq *pNext;
+  XSelectionRequestEvent ev;
+  Bool    dstReady;     /* requestor has taken the last chunk */
+  unsigned long offset; /* INCR_DST: items sent so far */
+} SELREQ, *PSELREQ;
+
+/* a conversion asked of the owner on dpy, into its own property on
+   propWin, for every requestor of the same selection and target */
+typedef struct _xfer {
+  struct _xfer *pNext;
+  Display *dpy;         /* of the owner */
+  int     sel;
+  Atom    target;       /* as requested on the other display */
+  Atom    asked;        /* of the owner: target, or the other text */
+  Atom    property;
+  Time    time;         /* of the conversion, 0 until pinged */
+  Time    ownerTime;    /* for the cache */
+  int     incr;
+  Bool    srcReady;     /* owner has put up the next chunk, or the first
+                           while the INCR property was read */
+  struct _propread *pRead; /* property being read, NULL if none */
+  Atom    type;         /* translated, as is the data */
+  int     format;
+  PSELDATA pData;       /* INCR_DST: property being sent */
+  unsigned long nitems;
+  unsigned char carry[4]; /* INCR_SRC: UTF-8 cut between two chunks */
+  int     nCarry;
+  PSELREQ pReqs;
+} XFER, *PXFER;
+
+/* conversions in flight before the oldest waiting one is dropped */
+#define MAX_XFERS       32
+
 #define FAKE_KEY    0
 #define FAKE_BUTTON 1
 
 #define N_BUTTONS   20
 
+/* a grab another client holds: ms between tries, and how many */
+#define GRAB_RETRY_MS  50
+#define GRAB_RETRIES   20
+
+/* requests remembered whose errors are not reported */
+#define N_QUIET     8
+
 #define MAX_BUTTONMAPEVENTS 20
 
 #define GETDPYXTRA(DPY,PDPYINFO)\
    (((DPY) == (PDPYINFO)->fromDpy) ?\
     &((PDPYINFO)->fromDpyXtra) : &((PDPYINFO)->toDpyXtra))
 
+#define UTF8_ATOM(DPY,PDPYINFO)\
+   (((DPY) == (PDPYINFO)->fromDpy) ?\
+    (PDPYINFO)->fromDpyUtf8String : (PDPYINFO)->toDpyUtf8String)
+
 /* values for sState */
 #define SELSTATE_ON     0
 #define SELSTATE_OFF    1
 #define SELSTATE_WAIT   2
 
+/* values for incr: ICCCM INCR transfer of a conversion */
+#define INCR_NONE       0
+#define INCR_SRC        1 /* owner sends chunks, relayed one at a time */
+#define INCR_DST        2 /* whole property read, sent out in chunks */
+
+/* largest property written in one piece, in bytes */
+#define INCR_CHUNK(DPY) ((XMaxRequestSize(DPY) << 2) - 100)
+
+/* selection data written or read at a time, in bytes: input to a
+   display waits behind no more than this */
+#define BULK_CHUNK      65536
+
+/* size in client memory of a property item */
+#define ITEM_SIZE(FORMAT) (((FORMAT) == 32) ? sizeof(long) :\
+                           ((FORMAT) == 16) ? sizeof(short) : 1)
+
 /* special values for translated coordinates */
 #define COORD_INCR     -1
 #define COORD_DECR     -2
 #define SPECIAL_COORD(COORD) (((COORD) < 0) ? (COORD) : 0)
 
-/* max unreasonable coordinates before accepting it */
-#define MAX_UNREASONABLES 10
+/* log levels, most severe first */
+#define LOG_NONE      -1
+#define LOG_ERROR     0
+#define LOG_WARN      1
+#define LOG_INFO      2
+#define LOG_DEBUG     3
+
+/* log records kept in memory (a power of 2), their arguments, and room
+   for copies of their string arguments */
+#define LOG_RING_SIZE 4096
+#define LOG_MAX_ARGS  8
+#define LOG_STR_SIZE  64
+
+/* -trace: spans a thread keeps before writing them out */
+#define TRACE_RING_SIZE 4096
+
+/* time a span: free unless tracing */
+#define TRACE_START(T)  ((T) = traceFp ? TraceNow() : 0)
+#define TRACE_END(T, NAME, ARG) \
+  do { if (T) TraceSpan((NAME), (ARG), (T)); } while (0)
 
 /**********
  * structures for recording state of buttons and keys
@@ -182,10 +383,68 @@ typedef struct _fakestr {
 } FAKE, *PFAKE;
 
 
+/* reply to a pipelined request, copied in as it comes */
+typedef struct _pipeReply {
+  struct _pipeReply *pNext; /* waiting for the next PipeSync */
+  _XAsyncHandler handler;
+  Display       *dpy;
+  unsigned long seq;
+  unsigned long fence; /* request PipeSync waits on, 0 if another's */
+  Bool          done;  /* False if an error came instead */
+  union {
+    xGenericReply            generic;
+    xGetInputFocusReply      focus;
+    xGetKeyboardControlReply keyboard;
+    xGrabPointerReply        grab;
+#ifndef WIN_2_X
+    xDPMSInfoReply           dpms;
+#endif
+  } reply;
+} PIPEREPLY, *PPIPEREPLY;
+
+#define GRABBED(PREPLY) \
+  ((PREPLY)->done && ((PREPLY)->reply.grab.status == GrabSuccess))
+
+/* GetProperty requests of a read in flight at once */
+#define READ_SLICES     4
+
+/* a request for BULK_CHUNK bytes of a property, from offset on */
+typedef struct _slice {
+  _XAsyncHandler handler;
+  struct _propread *pRead;
+  unsigned long seq;
+  long    offset;       /* in 4 byte units */
+  Bool    pending;      /* reply not in yet */
+} SLICE;
+
+/* a selection property read for a conversion without waiting: the
+   slices are asked for READ_SLICES at a time, their replies go in as
+   Xlib reads them and PumpReads carries on once all are in */
+typedef struct _propread {
+  struct _propread *pNext;
+  struct _dpyinfo *pDpyInfo;
+  PXFER   pXfer;        /* NULL once it is given up */
+  Display *dpy;
+  Window  win;
+  Atom    property;
+  SLICE   slices[READ_SLICES];
+  Bool    sized;        /* the first reply is in */
+  Bool    failed;
+  Atom    type;
+  int     format;
+  unsigned long nitems;
+  unsigned char *data;  /* as XGetWindowProperty has it */
+  long    size;         /* bytes, on the wire */
+  long    asked;        /* bytes asked for so far */
+} PROPREAD, *PPROPREAD;
+
 /**********
  * display information
  **********/
-typedef struct {
+typedef struct _dpyinfo {
+  struct _dpyinfo *pNext; /* next "from" display driving the same "to" */
+  char    *name;
+
   /* stuff on "from" display */
   Display *fromDpy;
   Atom    fromDpyUtf8String;
@@ -194,24 +453,32 @@ typedef struct {
   Window  big;
   Window  selWinFrom;
   int     selRevFrom;
+  PIPEREPLY grabPointer, grabKeyboard;
+  int     grabRetries;
+  double  grabRetryAt; /* ms, 0 if not to try again */
   GC      textGC;
   Atom    wmpAtom, wmdwAtom;
   Atom    netWmWindowTypeAtom, netWmWindowTypeDockAtom;
   Atom    netWmStrutAtom;
   Cursor  grabCursor;
+#ifdef HAVE_BARRIERS
+  PointerBarrier barrier; /* edge trigger instead of the trigger window */
+  int     xiOpcode;
+#endif
   Font    fid;
+  Bool    fontPending; /* fid to be loaded when first drawn */
   int     width, height, twidth, theight, tascent;
+  int     fromWidth, fromHeight;
   Bool    vertical;
   int     lastFromCoord;
-  int     unreasonableDelta;
+  int     lastCrossCoord; /* same for the other axis (layout graph) */
+  unsigned long warpSerial; /* of the last warp: motion before it is stale */
 
 #ifdef WIN_2_X
-  int     unreasonableCount;
   /* From display info for Windows */
   HWND    bigwindow;
   HWND    edgewindow;
   int     onedge;
-  int     fromWidth, fromHeight;
   int     wdelta;
   int     lastFromY;
   HWND    hwndNextViewer;
@@ -235,7 +502,7 @@ typedef struct {
   Atom    toDpyTargets;
   Window  selWinTo;
   int     selRevTo;
-  unsigned int inverseMap[N_BUTTONS + 1]; /* inverse of button mapping */
+  unsigned int *inverseMap; /* inverse of button mapping (active node) */
 
   /* state of connection */
   int     signal;		/* gort signal? */
@@ -243,6 +510,7 @@ typedef struct {
   int     eventMask;		/* trigger */
 
   /* coordinate conversion stuff */
+  struct _node *pNode; /* active node of the layout graph */
   int     toScreen;
   int     nScreens;
   short   **xTables; /* precalculated conversion tables */
@@ -251,31 +519,130 @@ typedef struct {
   int     fromDiscCoord;
   int     fromIncrCoord; /* location of cursor after incr/decr ops */
   int     fromDecrCoord;
+  int     fromCrossIncrCoord; /* same, after crossing a side link */
+  int     fromCrossDecrCoord;
 
   /* selection forwarding info */
   DPYXTRA fromDpyXtra;
   DPYXTRA toDpyXtra;
-  Display *sDpy;
-  XSelectionRequestEvent sEv;
-  Time    sTime;
+  PXFER   pXfers; /* oldest first */
+  PSELCACHE pSelCache; /* most recently used first */
+  long    selCacheSize;
 
   /* for recording state of buttons and keys */
   PFAKE   pFakeThings;
 
 } DPYINFO, *PDPYINFO;
 
-static DPYINFO dpyInfo;
+static DPYINFO dpyInfo; /* first "from" display, others follow it */
+static PDPYINFO activeSource = &dpyInfo; /* one the tables map from */
+
+/* selections are forwarded for the first "from" display only */
+#define FORWARDS_SEL(PDPYINFO) (doSel && ((PDPYINFO) == &dpyInfo))
 
 /* shadow displays */
+/* scales coordinates of a "to" screen onto a shadow screen of another
+   size; shadows with the same pair of sizes share one */
+typedef struct _scaleMap {
+  struct _scaleMap *pNext;
+  int     refs;
+  int     fromWidth, fromHeight; /* "to" screen */
+  int     toWidth, toHeight;     /* shadow screen */
+  short   *xMap, *yMap;
+} SCALEMAP, *PSCALEMAP;
+
 typedef struct _shadow {
   struct _shadow *pNext;
   char    *name;
   Display *dpy;
   long    led_mask;
+  PIPEREPLY leds;     /* asked for with those of "from" */
   Bool    flush;
   int     DPMSstatus; /* -1: not queried, 0: not supported, 1: supported */
+  int     dpmsOpcode;
+  PIPEREPLY dpmsInfo; /* -dpmsmouse: DPMS state asked for last */
+  Bool    dpmsAsked;  /* and not taken in yet */
+  long long dpmsCheckAt; /* ns: not asked again before */
+  int     agentFd;    /* x2x-agent injecting for this display, -1 if none */
+  unsigned char *agentBuf; /* messages not sent yet */
+  int     agentLen;
+  int     agentScreen, agentX, agentY; /* last motion sent */
+  Bool    motionQueued; /* latest motion, sent before anything else */
+  int     motionScreen, motionX, motionY;
+  struct _shadow *pNextTile;
+  char    *tileGeom;  /* as given with -tile */
+  int     tileX, tileY, tileWidth, tileHeight; /* rectangle in the canvas */
+  PSCALEMAP *pMaps;   /* per "to" screen, NULL if the sizes match */
+  int     nMaps;
 } SHADOW, *PSHADOW;
 
+/* one log call, formatted only when the log is dumped */
+typedef struct _logRec {
+  volatile unsigned long seq; /* index in the log + 1 once written */
+  const char *fmt;
+  long long  time;            /* ns */
+  int        level;
+  int        nArgs;
+  long long  args[LOG_MAX_ARGS]; /* integers, pointers, bits of doubles */
+  char       strs[LOG_STR_SIZE]; /* %s arguments, one after the other */
+} LOGREC, *PLOGREC;
+
+/* -trace: one span, times in ns */
+typedef struct _traceRec {
+  const char *name;
+  const char *arg;  /* display, or NULL */
+  long long  start, dur;
+} TRACEREC;
+
+/* spans of one thread, written out when full and at exit */
+typedef struct _traceRing {
+  struct _traceRing *pNext;
+  int      tid;
+  int      nRecs;
+  TRACEREC recs[TRACE_RING_SIZE];
+} TRACERING, *PTRACERING;
+
+/* a display opened at startup, in parallel with the others */
+typedef struct _opening {
+  struct _opening *pNext;
+  char    *name;
+  Bool    needTest; /* must support the test extension */
+  Bool    taken;
+  Display *dpy;     /* NULL if it could not be opened */
+  double  ms;       /* time taken */
+#ifdef HAVE_PTHREAD
+  pthread_t thread;
+  Bool    joinable;
+#endif
+} OPENING, *POPENING;
+
+/* switchboard: "to" displays placed in a layout graph */
+typedef struct _node {
+  struct _node *pNext;
+  char    *name;
+  Display *dpy;
+  PSHADOW shadows;  /* displays driven while this node is active */
+  struct _node *links[5]; /* neighbour beyond each edge, indexed by EDGE_* */
+  int     fromEdge; /* edge leading back to the "from" display */
+  int     toScreen;
+  int     nScreens;
+  short   **xTables;
+  short   **yTables;
+  unsigned int inverseMap[N_BUTTONS + 1];
+  int     nButtons;
+} NODE, *PNODE;
+
+#define NODE_HAS_EDGE(PNODE, EDGE)\
+   (((PNODE)->links[EDGE] != NULL) || ((PNODE)->fromEdge == (EDGE)))
+
+/* -link options, resolved into the layout graph once displays are open */
+typedef struct _link {
+  struct _link *pNext;
+  char    *name;
+  int     edge;
+  char    *otherName;
+} LINK, *PLINK;
+
 /* sticky keys */
 typedef struct _sticky {
   struct _sticky *pNext;
@@ -288,14 +655,72 @@ typedef int  (*HANDLER)(Display *, PDPYINFO, XEvent *); /* event handler functio
  * functions
  **********/
 static void    ParseCommandLine(int, char **);
-static Display *OpenAndCheckDisplay(char *);
+static double  Millis(void);
+static void    AddOpening(char *, Bool);
+static void    OpenDisplays(void);
+#ifdef HAVE_PTHREAD
+static void    *OpenThread(void *);
+#endif
+static Display *OpenDisplay(char *, Bool);
+static Display *TakeDisplay(char *, Bool);
+static int     AgentConnect(char *);
+static void    AgentPut(PSHADOW, int, long, long);
+static void    FakeKey(PSHADOW, KeyCode, Bool);
+static void    FakeButton(PSHADOW, unsigned int, Bool);
+static void    FakeMotion(PSHADOW, int, int, int);
+static void    SendMotion(PSHADOW);
+static Bool    MotionFollows(Display *);
+static void    FlushShadow(PSHADOW);
+static void    FlushOutput(void);
+static void    FlushDisplays(void);
+static void    TraceOpen(void);
+static long long TraceNow(void);
+static void    TraceSpan(const char *, const char *, long long);
+static PTRACERING TraceRing(void);
+static void    TraceWrite(PTRACERING);
+static void    TraceString(const char *);
+static void    TraceClose(void);
+static void    BuildTiles(void);
+static int     TileBounds(int *, Bool);
+static void    FocusTile(PDPYINFO, PSHADOW);
 static Bool    CheckTestExtension(Display *);
 #ifndef WIN_2_X
 static int     ErrorHandler(Display *, XErrorEvent *);
 #endif
+static Bool    HaveDPMS(PSHADOW);
 static void    DoDPMSForceLevel(PSHADOW, CARD16);
+static void    DPMSWake(PSHADOW, long long);
 static void    DoX2X(Display *, Display *);
 static void    InitDpyInfo(PDPYINFO);
+static Bool    LoadLabelFont(PDPYINFO);
+static int     SetFromGeometry(PDPYINFO, int, int);
+static int     ParseEdge(char *);
+static PNODE   AddNode(char *, PSHADOW);
+static PNODE   FindNode(char *);
+static void    BuildLayout(void);
+static void    BuildTables(PDPYINFO, PNODE);
+static void    BuildShadowMaps(PNODE);
+static PSCALEMAP GetScaleMap(int, int, int, int);
+static void    FreeScaleMap(PSCALEMAP);
+static void    ActivateNode(PDPYINFO, PNODE);
+static void    SwitchNode(PDPYINFO, int);
+static void    PipeHandle(Display *, PPIPEREPLY);
+static void    PipeExpect(Display *, PPIPEREPLY);
+static Bool    PipeHandler(Display *, xReply *, char *, int, XPointer);
+static Bool    PipeAnswered(PPIPEREPLY);
+static void    PipeGetInputFocus(Display *, PPIPEREPLY);
+static void    PipeGetKeyboardControl(Display *, PPIPEREPLY);
+static void    PipeGrab(Display *, Window, unsigned int, Cursor, PPIPEREPLY,
+                        PPIPEREPLY);
+static void    PipeSync(void);
+static void    QuietRequest(Display *);
+static void    AskKeyboardState(Display *, PPIPEREPLY);
+static void    KeyboardState(PPIPEREPLY);
+static void    RestoreKeyboardState(void);
+static void    FixLeds(PSHADOW, long, long);
+static void    GrabFrom(PDPYINFO);
+static void    CheckGrabs(PDPYINFO);
+static void    RetryGrabs(PDPYINFO);
 static void    DoConnect(PDPYINFO);
 static void    DoDisconnect(PDPYINFO);
 static void    RegisterEventHandlers(PDPYINFO);
@@ -304,6 +729,15 @@ static Bool    ProcessMotionNotify(Display*, PDPYINFO, XMotionEvent*);
 static Bool    ProcessExpose();
 static void    DrawWindowText(PDPYINFO);
 static Bool    ProcessEnterNotify();
+static void    EdgeConnect(PDPYINFO, int, int, int);
+static void    WarpFrom(PDPYINFO, int, int);
+static void    AddSource(char *);
+static void    TakeOver(PDPYINFO);
+#ifdef HAVE_BARRIERS
+static Bool    CreateEdgeBarrier(PDPYINFO);
+static void    PlaceEdgeBarrier(PDPYINFO);
+static Bool    ProcessGenericEvent();
+#endif
 static Bool    ProcessButtonPress();
 static Bool    ProcessButtonRelease();
 static Bool    ProcessKeyEvent();
@@ -314,14 +748,67 @@ static void    SendPing(Display *, PDPYXTRA);
 static Bool    ProcessPropertyNotify();
 static Bool    ProcessSelectionNotify();
 static void    SendSelectionNotify(XSelectionRequestEvent *);
+static Atom    XferProperty(PDPYINFO, Display *);
+static PXFER   NewXfer(PDPYINFO, Display *, int, Atom);
+static void    FreeXfer(PDPYINFO, PXFER);
+static void    CancelXfer(PDPYINFO, PXFER);
+static void    StartRead(PDPYINFO, PXFER, Display *, Window, Atom);
+static void    AskSlice(PPROPREAD, SLICE *, long);
+static Bool    ReadHandler(Display *, xReply *, char *, int, XPointer);
+static Bool    PumpReads(void);
+static void    XferReply(PDPYINFO, PXFER, Atom, int, unsigned long,
+                         unsigned char *);
+static void    XferChunk(PDPYINFO, PXFER, Atom, int, unsigned long,
+                         unsigned char *);
+#ifdef HAVE_XFIXES
+static Bool    GetSelProperty(Display *, Window, Atom, long, Atom *, int *,
+                              unsigned long *, unsigned char **);
+#endif
+static int     SelIndex(PDPYXTRA, Atom);
+static PATOMMAP FindAtomMap(PDPYXTRA, Atom);
+static void    AddAtomMap(PDPYXTRA, Atom, Atom);
+static void    TranslateAtoms(PDPYINFO, Display *, Atom *, int);
+static Atom    TranslateAtom(PDPYINFO, Display *, Atom);
+static Atom    OtherText(PDPYINFO, Display *, Atom);
+static Atom    ConvertText(PDPYINFO, Display *, Atom, Atom, unsigned char **,
+                           unsigned long *);
+static Atom    ConvertChunk(PDPYINFO, PXFER, Atom, unsigned char **,
+                            unsigned long *);
+static PSELCACHE FindSelCache(PDPYINFO, Display *, int, Atom);
+static Bool    StoreSelCache(PDPYINFO, Display *, int, Atom, Time, Atom, int,
+                             PSELDATA, unsigned long);
+static void    DropSelCache(PDPYINFO, Display *, int, Time);
+#ifdef HAVE_XFIXES
+static void    SelectSelectionOwner(Display *, PDPYINFO);
+static Bool    ProcessSelectionOwner();
+static void    StartPrefetch(Display *, PDPYINFO, int, Time);
+static void    ProcessPrefetch(Display *, PDPYINFO, XSelectionEvent *);
+static void    DrainPrefetch(Display *, PDPYINFO);
+static void    NextPrefetch(Display *, PDPYINFO);
+#endif
+static void    StartIncr(PDPYINFO, PXFER, int, long);
+static void    PumpIncr(PDPYINFO, PXFER);
+static void    EndReq(PDPYINFO, PSELREQ, Bool);
+static void    QueueBulk(PDPYINFO, XSelectionRequestEvent *, Atom, int,
+                         PSELDATA, unsigned char *, unsigned long, Bool);
+static PSELDATA NewSelData(unsigned char *);
+static PSELDATA HoldSelData(PSELDATA);
+static void    ReleaseSelData(PSELDATA);
+static void    PumpBulk(PDPYINFO, Display *);
 static Bool    ProcessSelectionClear();
 static Bool    ProcessVisibility();
 static Bool    ProcessMapping();
+#ifdef HAVE_RANDR
+static void    SelectScreenChange(Display *);
+static Bool    ProcessScreenChange();
+static void    ResizeFrom(PDPYINFO);
+#endif
 static void    FakeThingsUp(PDPYINFO);
 static void    FakeAction(PDPYINFO, int, KeySym, Bool);
 static void    RefreshPointerMapping(Display *, PDPYINFO);
 static void    Usage();
 static void    *xmalloc(size_t);
+static void    *xXmalloc(size_t);
 
 
 
@@ -357,18 +844,62 @@ static char    *defaultFN   = "-*-times-bold-r-*-*-*-180-*-*-*-*-*-*";
 static char    *fontName    = "-*-times-bold-r-*-*-*-180-*-*-*-*-*-*";
 static char    *label       = NULL;
 static char    *title       = NULL;
-static char    *pingStr     = "PING"; /* atom for ping request */
 static char    *geomStr     = NULL;
 static Bool    waitDpy      = False;
+static Bool    doVerbose    = False;
+static char    *traceFile   = NULL;
+static FILE    *traceFp     = NULL; /* NULL unless tracing */
+static long long traceOrigin;
+static PTRACERING traceRings = NULL;
+static int     traceTids    = 0;
+static Bool    traceFirst   = True;
+#ifdef HAVE_PTHREAD
+static pthread_key_t   traceKey;
+static pthread_mutex_t traceMutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/* names of the core events, for -trace */
+static const char *eventNames[LASTEvent] = {
+  "0", "1", "KeyPress", "KeyRelease", "ButtonPress", "ButtonRelease",
+  "MotionNotify", "EnterNotify", "LeaveNotify", "FocusIn", "FocusOut",
+  "KeymapNotify", "Expose", "GraphicsExpose", "NoExpose",
+  "VisibilityNotify", "CreateNotify", "DestroyNotify", "UnmapNotify",
+  "MapNotify", "MapRequest", "ReparentNotify", "ConfigureNotify",
+  "ConfigureRequest", "GravityNotify", "ResizeRequest",
+  "CirculateNotify", "CirculateRequest", "PropertyNotify",
+  "SelectionClear", "SelectionRequest", "SelectionNotify",
+  "ColormapNotify", "ClientMessage", "MappingNotify", "GenericEvent"
+};
+static char    *agentAddress = NULL; /* of the x2x-agent for the "to" display */
+static double  startTime;   /* ms */
+static POPENING openings    = NULL;
+static char    *startupAtomNames[N_STARTUP_ATOMS] = {
+  UTF8_STRING, "PING", "INCR", "MULTIPLE", "CLIPBOARD",
+  "WM_PROTOCOLS", "WM_DELETE_WINDOW", "_NET_WM_WINDOW_TYPE",
+  "_NET_WM_WINDOW_TYPE_DOCK", "_NET_WM_STRUT", "_NET_WM_WINDOW_OPACITY" };
 static Bool    doBig        = False;
 static Bool    doMouse      = True;
 static int     doEdge       = EDGE_NONE;
 static Bool    doSel        = True;
 static Bool    doAutoUp     = True;
 static Bool    doResurface  = False;
+static Bool    doSync       = False; /* a round trip after each request */
 static Bool    winTransparent = False;
 static Bool    doInputOnly  = True;
-static PSHADOW shadows      = NULL;
+static PSHADOW shadows      = NULL; /* displays of the active node */
+static PNODE   nodes        = NULL;
+static PLINK   links        = NULL;
+static PSHADOW tiles        = NULL; /* tiled mode: "to" display first */
+static int     canvasWidth, canvasHeight;
+static int     nTileCols;
+static short   *tileCols, *tileRows; /* canvas coordinate to grid cell */
+static PSHADOW *tileGrid;            /* row * nTileCols + col */
+static PSCALEMAP scaleMaps  = NULL; /* shared by shadows */
+static PPIPEREPLY pipeReplies = NULL;
+static PPROPREAD pReads = NULL; /* selection properties being read */
+static Display *quietDpys[N_QUIET];
+static unsigned long quietSerials[N_QUIET];
+static int     quietNext = 0;
 static int     triggerw     = 2;
 static Bool    doPointerMap = True;
 static PSTICKY stickies     = NULL;
@@ -376,6 +907,7 @@ static Bool    doBtnBlock   = False;
 static Bool    doCapsLkHack = False;
 static Bool    doClipCheck  = False;
 static Bool    doDpmsMouse  = False;
+static int     dpmsInterval = 1000; /* ms between DPMS checks */
 static int     logicalOffset= 0;
 static int     nButtons     = 0;
 static KeySym  buttonmap[N_BUTTONS + 1][MAX_BUTTONMAPEVENTS + 1];
@@ -385,6 +917,14 @@ static int     compRegRight = 0;
 static int     compRegUp    = 0;
 static int     compRegLow   = 0;
 static Bool    useStruts    = False;
+static Bool    doBarrier    = True;
+static long    selCacheMax  = 1024 * 1024; /* bytes */
+static long    prefetchMax  = 0; /* bytes per target, 0: no prefetch */
+#ifdef HAVE_XFIXES
+static char    *pfAtomNames[N_PFATOMS] = {
+  "_X2X_PREFETCH", "TARGETS", "MULTIPLE", "TIMESTAMP", "DELETE",
+  "INSERT_SELECTION", "INSERT_PROPERTY", "SAVE_TARGETS" };
+#endif
 
 #ifdef WIN_2_X
 /* These are used to allow pointer comparisons */
@@ -403,13 +943,132 @@ void debug_cmpreg(const char *fmt, ...)
 }
 #endif
 
-#ifdef DEBUG
-#define debug printf
+/**********
+ * levelled log: a call below the level costs one comparison, one above
+ * stores its arguments in a ring and returns; formatting waits until
+ * the ring is dumped (SIGUSR1, or a crash).  Errors and warnings are
+ * also printed right away.  Only the event loop logs, so the ring has
+ * one writer and needs no lock; a dump skips records it catches half
+ * written.  Records made while handling an event carry the time the
+ * event was read.
+ **********/
+static int     logLevel     = LOG_DEBUG;
+static LOGREC  logRing[LOG_RING_SIZE];
+static volatile unsigned long logHead = 0;
+static volatile sig_atomic_t logDumpPending = 0;
+static long long logOrigin;
+static long long logEventTime = 0; /* 0 outside of event handling */
+
+static void    LogRecord(int, const char *, ...);
+static long long LogNow(void);
+static int     LogFormat(PLOGREC, char *, int);
+static int     LogFormatSafe(PLOGREC, char *, int);
+static int     LogPutNumber(char *, int, int, unsigned long long, int,
+                            const char *, int);
+static void    LogDump(int, Bool);
+static void    LogDumpSignal(int);
+static void    LogCrash(int);
+
+#define LOG(LEVEL, ...) \
+  do { if ((LEVEL) <= logLevel) LogRecord((LEVEL), __VA_ARGS__); } while (0)
+#define debug(...) LOG(LOG_DEBUG, __VA_ARGS__)
+
+/* between % and the conversion of a format: flags, width, precision,
+   and length, of which these make an argument long */
+#define LOG_FLAG(C) ((((C) >= '0') && ((C) <= '9')) || ((C) == '.') || \
+                     ((C) == '-') || ((C) == '+') || ((C) == ' ') || \
+                     ((C) == '#') || ((C) == 'h') || LOG_LONG(C))
+#define LOG_LONG(C) (((C) == 'l') || ((C) == 'z') || ((C) == 'j') || \
+                     ((C) == 't'))
+
+#if defined(RTT_AUDIT) && !defined(WIN_2_X)
+/**********
+ * --enable-rtt-audit: every Xlib call that waits for a reply is counted
+ * and timed by call, caller, display and what x2x was doing (event
+ * type, DoConnect, DoDisconnect), and reported at exit
+ **********/
+typedef struct _audit {
+  struct _audit *pNext;
+  const char *context;
+  const char *call;
+  const char *caller;
+  Display    *dpy;
+  char       *dpyName; /* outlives the display */
+  long       count;
+  long long  ns;
+} AUDIT, *PAUDIT;
+
+typedef struct _auditContext {
+  struct _auditContext *pNext;
+  const char *context;
+  long       count; /* events handled, connects, ... */
+} AUDITCONTEXT, *PAUDITCONTEXT;
+
+static PAUDIT        audits = NULL;
+static PAUDITCONTEXT auditContexts = NULL;
+static const char    *auditContext = "startup";
+static long long     auditStart;
+static Bool          auditForbid = False; /* any round trip is fatal */
+
+static void    AuditBegin(const char *, const char *);
+static long    AuditEnd(const char *, const char *, Display *, long);
+static const char *AuditEnter(const char *);
+static int     AuditAfter(Display *);
+static void    AuditSynchronize(Display *, Bool);
+static void    AuditReport(void);
+
+#define AUDIT(NAME, DPY, CALL) \
+  (AuditBegin((NAME), __func__), \
+   AuditEnd((NAME), __func__, (DPY), (long)(CALL)))
+
+#define XSync(D, ...)              (int)AUDIT("XSync", D, XSync(D, __VA_ARGS__))
+#define XGetInputFocus(D, ...) \
+  (int)AUDIT("XGetInputFocus", D, XGetInputFocus(D, __VA_ARGS__))
+#define XGetKeyboardControl(D, ...) \
+  (int)AUDIT("XGetKeyboardControl", D, XGetKeyboardControl(D, __VA_ARGS__))
+#define XGetWindowProperty(D, ...) \
+  (int)AUDIT("XGetWindowProperty", D, XGetWindowProperty(D, __VA_ARGS__))
+#define XInternAtom(D, ...) \
+  (Atom)AUDIT("XInternAtom", D, XInternAtom(D, __VA_ARGS__))
+#define XInternAtoms(D, ...) \
+  (Status)AUDIT("XInternAtoms", D, XInternAtoms(D, __VA_ARGS__))
+#define XGetAtomNames(D, ...) \
+  (Status)AUDIT("XGetAtomNames", D, XGetAtomNames(D, __VA_ARGS__))
+#define XGrabPointer(D, ...) \
+  (int)AUDIT("XGrabPointer", D, XGrabPointer(D, __VA_ARGS__))
+#define XGrabKeyboard(D, ...) \
+  (int)AUDIT("XGrabKeyboard", D, XGrabKeyboard(D, __VA_ARGS__))
+#define XGetPointerMapping(D, ...) \
+  (int)AUDIT("XGetPointerMapping", D, XGetPointerMapping(D, __VA_ARGS__))
+#define XGetGeometry(D, ...) \
+  (Status)AUDIT("XGetGeometry", D, XGetGeometry(D, __VA_ARGS__))
+#define XQueryTextExtents(D, ...) \
+  (int)AUDIT("XQueryTextExtents", D, XQueryTextExtents(D, __VA_ARGS__))
+#define XQueryExtension(D, ...) \
+  (Bool)AUDIT("XQueryExtension", D, XQueryExtension(D, __VA_ARGS__))
+#define XTestQueryExtension(D, ...) \
+  (Bool)AUDIT("XTestQueryExtension", D, XTestQueryExtension(D, __VA_ARGS__))
+#define DPMSQueryExtension(D, ...) \
+  (Bool)AUDIT("DPMSQueryExtension", D, DPMSQueryExtension(D, __VA_ARGS__))
+#define DPMSInfo(D, ...) \
+  (Status)AUDIT("DPMSInfo", D, DPMSInfo(D, __VA_ARGS__))
+#define XFixesQueryExtension(D, ...) \
+  (Bool)AUDIT("XFixesQueryExtension", D, XFixesQueryExtension(D, __VA_ARGS__))
+#define XFixesQueryVersion(D, ...) \
+  (Status)AUDIT("XFixesQueryVersion", D, XFixesQueryVersion(D, __VA_ARGS__))
+#define XIQueryVersion(D, ...) \
+  (Status)AUDIT("XIQueryVersion", D, XIQueryVersion(D, __VA_ARGS__))
+#define XRRQueryExtension(D, ...) \
+  (Bool)AUDIT("XRRQueryExtension", D, XRRQueryExtension(D, __VA_ARGS__))
+/* synchronous mode makes a round trip of every request */
+#define XSynchronize(D, ON)        AuditSynchronize((D), (ON))
+
+#define AUDIT_ENTER(CONTEXT)       AuditEnter(CONTEXT)
+#define AUDIT_LEAVE(SAVED)         (auditContext = (SAVED))
 #else
-void debug(const char* fmt, ...)
-{
-}
-#endif
+#define AUDIT_ENTER(CONTEXT)       NULL
+#define AUDIT_LEAVE(SAVED)         ((void)(SAVED))
+#endif /* RTT_AUDIT */
 
 #ifdef WIN_2_X
 
@@ -420,6 +1079,7 @@ WinMain (HINSTANCE hInst, HINSTANCE hPrev, LPSTR lpCmd, int nShow)
 {
   Display *fromDpy;
   PSHADOW pShadow;
+  PNODE   pNode;
   int argc;
   char *argv[MAX_WIN_ARGS];
   char *ap;
@@ -451,14 +1111,32 @@ char **argv;
 {
   Display *fromDpy;
   PSHADOW pShadow;
+  PNODE   pNode;
+  PDPYINFO pSource, pOther;
 
 #endif /* WIN_2_X */
 #ifdef DEBUG
   setvbuf(stdout, NULL, _IONBF, 0);
 #endif
 
+#ifdef HAVE_PTHREAD
+  XInitThreads(); /* first Xlib call: OpenDisplays opens in parallel */
+#endif
+  startTime = Millis();
   XrmInitialize();
+  logOrigin = LogNow();
+  signal(SIGUSR1, LogDumpSignal);
+  signal(SIGSEGV, LogCrash);
+  signal(SIGBUS,  LogCrash);
+  signal(SIGFPE,  LogCrash);
+  signal(SIGILL,  LogCrash);
+  signal(SIGABRT, LogCrash);
   ParseCommandLine(argc, argv);
+  if (traceFile)
+    TraceOpen();
+#if defined(RTT_AUDIT)
+  atexit(AuditReport);
+#endif
 
 #ifdef WIN_2_X
   if (fromDpyName != fromWinName)
@@ -468,14 +1146,40 @@ char **argv;
 #endif
 
   toDpyName   = XDisplayName(toDpyName);
-  if (!strcasecmp(toDpyName, fromDpyName)) {
-    fprintf(stderr, "%s: display names are both %s\n", programStr, toDpyName);
+  dpyInfo.name = fromDpyName;
+  for (pSource = &dpyInfo; pSource; pSource = pSource->pNext) {
+    if (!strcasecmp(toDpyName, pSource->name)) {
+      fprintf(stderr, "%s: display names are both %s\n", programStr,
+              toDpyName);
+      exit(1);
+    }
+    for (pOther = pSource->pNext; pOther; pOther = pOther->pNext)
+      if (!strcasecmp(pOther->name, pSource->name)) {
+        fprintf(stderr, "%s: %s is a \"from\" display twice\n",
+                programStr, pSource->name);
+        exit(1);
+      }
+  } /* END for */
+#ifdef WIN_2_X
+  if (dpyInfo.pNext && (fromDpyName == fromWinName)) {
+    fprintf(stderr, "%s - error: -from is not supported with -fromwin\n",
+            programStr);
     exit(1);
   }
+#endif
+
+  /* toDpy is always the first shadow */
+  pShadow = (PSHADOW)xmalloc(sizeof(SHADOW));
+  pShadow->DPMSstatus = -1;
+  pShadow->name = toDpyName;
+  /* link into the global list */
+  pShadow->pNext = shadows;
+  shadows = pShadow;
 
   /* no OS independent way to stop Xlib from complaining via stderr,
      but can always pipe stdout/stderr to /dev/null */
-  /* convert to real name: */
+  OpenDisplays();
+
 #ifdef WIN_2_X
   if (fromDpyName == fromWinName) {
     /* From is Windows, don't need to open */
@@ -483,33 +1187,49 @@ char **argv;
   } else
     /* This ugly hanging else... */
 #endif /* WIN_2_X */
-    /* ... qualifies this while in WIN_2_X case with an X source */
-  while ((fromDpy = XOpenDisplay(fromDpyName)) == NULL) {
-    if (!waitDpy) {
-      fprintf(stderr, "%s - error: can not open display %s\n",
-              programStr, fromDpyName);
+    /* ... qualifies this if in WIN_2_X case with an X source */
+  if (!(fromDpy = TakeDisplay(fromDpyName, False)))
+    exit(2);
+  for (pSource = dpyInfo.pNext; pSource; pSource = pSource->pNext)
+    if (!(pSource->fromDpy = TakeDisplay(pSource->name, False)))
       exit(2);
-    } /* END if */
-    sleep(10);
-  } /* END while fromDpy */
-  (void)XSynchronize(fromDpy, True);
-
-  /* toDpy is always the first shadow */
-  pShadow = (PSHADOW)xmalloc(sizeof(SHADOW));
-  pShadow->DPMSstatus = -1;
-  pShadow->name = toDpyName;
-  /* link into the global list */
-  pShadow->pNext = shadows;
-  shadows = pShadow;
 
   /* initialize all of the shadows, including the toDpy */
   for (pShadow = shadows; pShadow; pShadow = pShadow->pNext) {
     pShadow->led_mask = 0;
     pShadow->flush = False;
-    if (!(pShadow->dpy = OpenAndCheckDisplay(pShadow->name)))
+    pShadow->agentFd = -1;
+    if (!(pShadow->dpy = TakeDisplay(pShadow->name, True)))
+      exit(3);
+  }
+
+  /* requests are buffered and flushed where x2x waits, unless an X
+     error is to be traced to its request */
+  if (doSync) {
+    (void)XSynchronize(fromDpy, True);
+    for (pSource = dpyInfo.pNext; pSource; pSource = pSource->pNext)
+      (void)XSynchronize(pSource->fromDpy, True);
+    for (pShadow = shadows; pShadow; pShadow = pShadow->pNext)
+      (void)XSynchronize(pShadow->dpy, True);
+  }
+
+  /* input for toDpy goes through its agent */
+  if (agentAddress) {
+    if ((shadows->agentFd = AgentConnect(agentAddress)) < 0)
       exit(3);
+    signal(SIGPIPE, SIG_IGN); /* a lost agent is reported by write */
+    shadows->agentBuf = (unsigned char *)xmalloc(AGENT_BUF_SIZE);
+    memcpy(shadows->agentBuf, AGENT_MAGIC, AGENT_GREETING - 1);
+    shadows->agentBuf[AGENT_GREETING - 1] = AGENT_VERSION;
+    shadows->agentLen = AGENT_GREETING;
+    shadows->agentScreen = -1;
   }
-  (void)XSynchronize(shadows->dpy, True);
+
+  if (tiles)
+    BuildTiles();
+
+  /* toDpy and its shadows head the layout graph */
+  BuildLayout();
 
 #ifndef WIN_2_X
   /* set error handler,
@@ -529,20 +1249,129 @@ char **argv;
 #else
   XCloseDisplay(fromDpy);
 #endif
+  for (pSource = dpyInfo.pNext; pSource; pSource = pSource->pNext)
+    XCloseDisplay(pSource->fromDpy);
 
-  for (pShadow = shadows; pShadow; pShadow = pShadow->pNext)
-    XCloseDisplay(pShadow->dpy);
+  for (pNode = nodes; pNode; pNode = pNode->pNext)
+    for (pShadow = pNode->shadows; pShadow; pShadow = pShadow->pNext)
+      XCloseDisplay(pShadow->dpy);
   exit(0);
 
 } /* END main */
 
-static Display *OpenAndCheckDisplay(name)
+static double Millis()
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return (tv.tv_sec * 1000.0) + (tv.tv_usec / 1000.0);
+
+} /* END Millis */
+
+/**********
+ * open every display named on the command line at once: over slow
+ * links, connection setup and the XTest query dominate startup
+ **********/
+static void AddOpening(name, needTest)
 char *name;
+Bool needTest;
 {
-  Display *openDpy;
+  POPENING pOpening, *ppOpening;
 
-  /* convert to real name: */
   name = XDisplayName(name);
+  for (ppOpening = &openings; (pOpening = *ppOpening);
+       ppOpening = &(pOpening->pNext))
+    if (!strcasecmp(pOpening->name, name) && (pOpening->needTest == needTest))
+      return;
+
+  pOpening = (POPENING)xmalloc(sizeof(OPENING));
+  pOpening->pNext    = NULL;
+  pOpening->name     = name;
+  pOpening->needTest = needTest;
+  pOpening->taken    = False;
+  pOpening->dpy      = NULL;
+  *ppOpening = pOpening;
+
+} /* END AddOpening */
+
+static void OpenDisplays()
+{
+  POPENING pOpening;
+  PSHADOW  pShadow;
+  PLINK    pLink;
+  PDPYINFO pSource;
+  double   start;
+
+#ifdef WIN_2_X
+  if (fromDpyName != fromWinName)
+#endif
+    AddOpening(fromDpyName, False);
+  for (pSource = dpyInfo.pNext; pSource; pSource = pSource->pNext)
+    AddOpening(pSource->name, False);
+  for (pShadow = shadows; pShadow; pShadow = pShadow->pNext)
+    AddOpening(pShadow->name, True);
+  for (pShadow = tiles; pShadow; pShadow = pShadow->pNextTile)
+    if (strcasecmp(XDisplayName(pShadow->name), toDpyName))
+      AddOpening(pShadow->name, True);
+  for (pLink = links; pLink; pLink = pLink->pNext) {
+    if (strcasecmp(XDisplayName(pLink->name), fromDpyName))
+      AddOpening(pLink->name, True);
+    if (strcasecmp(XDisplayName(pLink->otherName), fromDpyName))
+      AddOpening(pLink->otherName, True);
+  }
+
+  start = Millis();
+#ifdef HAVE_PTHREAD
+  if (openings && openings->pNext) {
+    for (pOpening = openings; pOpening; pOpening = pOpening->pNext) {
+      pOpening->joinable =
+        !pthread_create(&(pOpening->thread), NULL, OpenThread, pOpening);
+      if (!pOpening->joinable)
+        OpenThread(pOpening); /* no thread: do it here */
+    }
+    for (pOpening = openings; pOpening; pOpening = pOpening->pNext)
+      if (pOpening->joinable)
+        pthread_join(pOpening->thread, NULL);
+  } else
+#endif
+  for (pOpening = openings; pOpening; pOpening = pOpening->pNext) {
+    pOpening->ms = Millis();
+    pOpening->dpy = OpenDisplay(pOpening->name, pOpening->needTest);
+    pOpening->ms = Millis() - pOpening->ms;
+  }
+
+  if (doVerbose) {
+    for (pOpening = openings; pOpening; pOpening = pOpening->pNext)
+      fprintf(stderr, "%s: opened %s in %.1f ms\n",
+              programStr, pOpening->name, pOpening->ms);
+    fprintf(stderr, "%s: opened displays in %.1f ms\n",
+            programStr, Millis() - start);
+  }
+
+} /* END OpenDisplays */
+
+#ifdef HAVE_PTHREAD
+static void *OpenThread(arg)
+void *arg;
+{
+  POPENING pOpening = (POPENING)arg;
+  double   start = Millis();
+
+  pOpening->dpy = OpenDisplay(pOpening->name, pOpening->needTest);
+  pOpening->ms = Millis() - start;
+  return NULL;
+
+} /* END OpenThread */
+#endif
+
+static Display *OpenDisplay(name, needTest)
+char *name;
+Bool needTest;
+{
+  Display *openDpy;
+  long long traced;
+
+  TRACE_START(traced);
   while ((openDpy = XOpenDisplay(name)) == NULL) {
     if (!waitDpy) {
       fprintf(stderr, "%s - error: can not open display %s\n",
@@ -551,8 +1380,9 @@ char *name;
     } /* END if */
     sleep(10);
   } /* END while openDpy */
+  TRACE_END(traced, "XOpenDisplay", name);
 
-  if (!CheckTestExtension(openDpy)) {
+  if (needTest && !CheckTestExtension(openDpy)) {
     fprintf(stderr,
             "%s - error: display %s does not support the test extension\n",
             programStr, name);
@@ -560,1901 +1390,5516 @@ char *name;
   }
   return (openDpy);
 
-} /* END OpenAndCheckDisplay */
+} /* END OpenDisplay */
 
 /**********
- * use standard X functions to parse the command line
+ * a display opened at startup, or opened now if it was not (or was
+ * already taken)
  **********/
-static void ParseCommandLine(argc, argv)
-int  argc;
-char **argv;
+static Display *TakeDisplay(name, needTest)
+char *name;
+Bool needTest;
 {
-  int     arg;
-  PSHADOW pShadow;
-  extern  char *lawyerese;
-  PSTICKY pNewSticky;
-  KeySym  keysym;
-  int     button;
-  int     eventno;
-  char    *keyname, *argptr;
+  POPENING pOpening;
 
-  debug("programStr = %s\n", programStr);
+  /* convert to real name: */
+  name = XDisplayName(name);
+  for (pOpening = openings; pOpening; pOpening = pOpening->pNext) {
+    if (!pOpening->taken && (pOpening->needTest == needTest) &&
+        !strcasecmp(pOpening->name, name)) {
+      pOpening->taken = True;
+      return pOpening->dpy;
+    }
+  } /* END for */
+  return OpenDisplay(name, needTest);
 
-  /* Clear button map */
-  for (button = 0; button <= N_BUTTONS; button++)
-    buttonmap[button][0] = NoSymbol;
+} /* END TakeDisplay */
 
-  for (arg = 1; arg < argc; ++arg) {
+/**********
+ * tiled mode: the "to" display and the -tile displays are tiles of one
+ * canvas; motion goes to the tile under the cursor only, and so does
+ * the rest of the input.  A tile is found with one lookup per axis in
+ * the grid drawn by the edges of all tiles.
+ **********/
+static void BuildTiles()
+{
+  PSHADOW pTile, *ppTile;
+  int     geomMask, x, y, col, row, nRows, nTiles;
+  unsigned int width, height;
+  int     *xBounds, *yBounds;
+
+  if (links || shadows->pNext) {
+    fprintf(stderr, "%s - error: -tile can not be combined with -shadow "
+            "or -link\n", programStr);
+    exit(1);
+  }
 #ifdef WIN_2_X
-    if (!strcasecmp(argv[arg], "-fromWin")) {
-      fromDpyName = fromWinName;
-      /* XXX mdh - For now only support edge windows getting big */
-      /* Note: -east will override correctly (even if earlier on the line) */
-      doBig = True;
-      if (doEdge == EDGE_NONE) doEdge = EDGE_WEST;
-      doCapsLkHack = True;
+  if (fromDpyName == fromWinName) {
+    fprintf(stderr, "%s - error: -tile is not supported with -fromwin\n",
+            programStr);
+    exit(1);
+  }
+#endif
 
-      debug("fromDpyName = %s\n", fromDpyName);
-    } else
-      /* Note this else will qualify the if below... */
-#endif /* WIN_2_X */
-    if (!strcasecmp(argv[arg], "-from")) {
-      if (++arg >= argc) Usage();
-      fromDpyName = argv[arg];
+  /* the "to" display heads the tiles, at +0+0 unless placed */
+  shadows->tileGeom = NULL;
+  for (ppTile = &tiles; (pTile = *ppTile);) {
+    if (!strcasecmp(XDisplayName(pTile->name), toDpyName)) {
+      shadows->tileGeom = pTile->tileGeom;
+      *ppTile = pTile->pNextTile;
+      free(pTile);
+    } else {
+      ppTile = &(pTile->pNextTile);
+    }
+  } /* END for */
+  shadows->pNextTile = tiles;
+  tiles = shadows;
+
+  canvasWidth = canvasHeight = 0;
+  for (nTiles = 0, pTile = tiles; pTile; pTile = pTile->pNextTile, ++nTiles) {
+    if (pTile != shadows) {
+      pTile->led_mask = 0;
+      pTile->flush = False;
+      pTile->agentFd = -1;
+      if (!(pTile->dpy = TakeDisplay(pTile->name, True)))
+        exit(3);
+    }
+    /* the size of its screen unless given */
+    x = y = 0;
+    width  = XDisplayWidth(pTile->dpy, XDefaultScreen(pTile->dpy));
+    height = XDisplayHeight(pTile->dpy, XDefaultScreen(pTile->dpy));
+    geomMask = XParseGeometry(pTile->tileGeom, &x, &y, &width, &height);
+    if ((geomMask & (XNegative | YNegative)) || !width || !height) {
+      fprintf(stderr, "%s - error: bad tile geometry %s\n",
+              programStr, pTile->tileGeom);
+      exit(1);
+    }
+    pTile->tileX      = x;
+    pTile->tileY      = y;
+    pTile->tileWidth  = width;
+    pTile->tileHeight = height;
+    canvasWidth  = MAX(canvasWidth, x + (int)width);
+    canvasHeight = MAX(canvasHeight, y + (int)height);
+    debug("tile %s: %dx%d+%d+%d\n", pTile->name, width, height, x, y);
+  } /* END for */
+  if ((canvasWidth > 32767) || (canvasHeight > 32767)) {
+    fprintf(stderr, "%s - error: tiles span more than 32767 pixels\n",
+            programStr);
+    exit(1);
+  }
 
-      debug("fromDpyName = %s\n", fromDpyName);
-    } else if (!strcasecmp(argv[arg], "-to")) {
-      if (++arg >= argc) Usage();
-      toDpyName = argv[arg];
+  xBounds = (int *)xmalloc(sizeof(int) * (2 * nTiles + 1));
+  yBounds = (int *)xmalloc(sizeof(int) * (2 * nTiles + 1));
+  nTileCols = TileBounds(xBounds, False);
+  nRows     = TileBounds(yBounds, True);
 
-      debug("toDpyName = %s\n", toDpyName);
-    } else if (!strcasecmp(argv[arg], "-font")) {
-      if (++arg >= argc) Usage();
-      fontName = argv[arg];
+  tileCols = (short *)xmalloc(sizeof(short) * canvasWidth);
+  for (col = 0, x = 0; x < canvasWidth; ++x) {
+    while (((col + 1) < nTileCols) && (x >= xBounds[col + 1]))
+      ++col;
+    tileCols[x] = col;
+  }
+  tileRows = (short *)xmalloc(sizeof(short) * canvasHeight);
+  for (row = 0, y = 0; y < canvasHeight; ++y) {
+    while (((row + 1) < nRows) && (y >= yBounds[row + 1]))
+      ++row;
+    tileRows[y] = row;
+  }
 
-      debug("fontName = %s\n", fontName);
-    } else if (!strcasecmp(argv[arg], "-label")) {
-      if (++arg >= argc) Usage();
-      label = argv[arg];
+  /* each cell belongs to the first tile over it, if any */
+  tileGrid = (PSHADOW *)xmalloc(sizeof(PSHADOW) * nTileCols * nRows);
+  for (row = 0; row < nRows; ++row) {
+    for (col = 0; col < nTileCols; ++col) {
+      for (pTile = tiles; pTile; pTile = pTile->pNextTile)
+        if ((xBounds[col] >= pTile->tileX) &&
+            (xBounds[col] < pTile->tileX + pTile->tileWidth) &&
+            (yBounds[row] >= pTile->tileY) &&
+            (yBounds[row] < pTile->tileY + pTile->tileHeight))
+          break;
+      tileGrid[(row * nTileCols) + col] = pTile;
+    } /* END for col */
+  } /* END for row */
 
-      debug("label = %s\n", label);
-    } else if (!strcasecmp(argv[arg], "-title")) {
-      if (++arg > argc) Usage();
-      title = argv[arg];
+  free(xBounds);
+  free(yBounds);
 
-      debug("title = %s\n", title);
-    } else if (!strcasecmp(argv[arg], "-geometry")) {
-      if (++arg >= argc) Usage();
-      geomStr = argv[arg];
+} /* END BuildTiles */
 
-      debug("geometry = %s\n", geomStr);
-    } else if (!strcasecmp(argv[arg], "-wait")) {
-      waitDpy = True;
+/**********
+ * edges of the tiles along one axis, in order, from 0: each starts a
+ * row or column of the grid
+ **********/
+static int TileBounds(bounds, vert)
+int  *bounds;
+Bool vert;
+{
+  PSHADOW pTile;
+  int     nBounds = 0, bound, counter, pass;
+  int     extent = vert ? canvasHeight : canvasWidth;
+
+  bounds[nBounds++] = 0;
+  for (pTile = tiles; pTile; pTile = pTile->pNextTile) {
+    for (pass = 0; pass < 2; ++pass) {
+      bound = vert ? pTile->tileY : pTile->tileX;
+      if (pass)
+        bound += vert ? pTile->tileHeight : pTile->tileWidth;
+      if (bound >= extent)
+        continue;
+      /* insert in order, once */
+      for (counter = 0; (counter < nBounds) && (bounds[counter] < bound);
+           ++counter);
+      if ((counter < nBounds) && (bounds[counter] == bound))
+        continue;
+      memmove(bounds + counter + 1, bounds + counter,
+              sizeof(int) * (nBounds - counter));
+      bounds[counter] = bound;
+      ++nBounds;
+    } /* END for pass */
+  } /* END for pTile */
+  return nBounds;
+
+} /* END TileBounds */
 
-      debug("will wait for displays\n");
-    } else if (!strcasecmp(argv[arg], "-big")) {
-      doBig = True;
+/**********
+ * the pointer went over another tile: it takes the input from now on
+ **********/
+static void FocusTile(pDpyInfo, pTile)
+PDPYINFO pDpyInfo;
+PSHADOW  pTile;
+{
+  PSHADOW pOld = shadows;
+  PFAKE   pFake;
+  KeyCode keycode;
 
-      debug("will create big window on from display\n");
-    } else if (!strcasecmp(argv[arg], "-nomouse")) {
-      doMouse = False;
+  debug("focus on tile %s\n", pTile->name);
 
-      debug("will not capture mouse (eek!)\n");
-    } else if (!strcasecmp(argv[arg], "-nopointermap")) {
-      doPointerMap = False;
+  /* keys held down (modifiers) move along, buttons are let go: a drag
+     can not cross X servers */
+  for (pFake = pDpyInfo->pFakeThings; pFake; pFake = pFake->pNext) {
+    if (pFake->type == FAKE_KEY) {
+      if ((keycode = XKeysymToKeycode(pOld->dpy, pFake->thing)))
+        FakeKey(pOld, keycode, False);
+      if ((keycode = XKeysymToKeycode(pTile->dpy, pFake->thing)))
+        FakeKey(pTile, keycode, True);
+    } else {
+      FakeButton(pOld, pFake->thing, False);
+    }
+  } /* END for */
+  FlushShadow(pOld);
 
-      debug("will not do pointer mapping\n");
-    } else if (!strcasecmp(argv[arg], "-north")) {
-      doEdge = EDGE_NORTH;
+  shadows = pDpyInfo->pNode->shadows = pTile;
+  DoDPMSForceLevel(pTile, DPMSModeOn);
 
-      debug("\"from\" is on the north side of \"to\"\n");
-    } else if (!strcasecmp(argv[arg], "-south")) {
-      doEdge = EDGE_SOUTH;
+} /* END FocusTile */
 
-      debug("\"from\" is on the south side of \"to\"\n");
-    } else if (!strcasecmp(argv[arg], "-east")) {
-      doEdge = EDGE_EAST;
+/**********
+ * x2x-agent: input for a display sent to an agent next to it, see
+ * agent.h
+ **********/
+static int AgentConnect(address)
+char *address;
+{
+  struct sockaddr_un unAddr;
+  struct addrinfo hints, *pAddrs, *pAddr;
+  char   *copy, *host, *port;
+  int    fd = -1;
+  int    one = 1;
+
+  if (strchr(address, '/')) { /* Unix domain socket */
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) >= 0) {
+      memset(&unAddr, 0, sizeof(unAddr));
+      unAddr.sun_family = AF_UNIX;
+      strncpy(unAddr.sun_path, address, sizeof(unAddr.sun_path) - 1);
+      if (connect(fd, (struct sockaddr *)&unAddr, sizeof(unAddr)) < 0) {
+        close(fd);
+        fd = -1;
+      }
+    }
+  } else { /* [host:]port */
+    copy = (char *)xmalloc(strlen(address) + 1);
+    strcpy(copy, address);
+    if ((port = strrchr(copy, ':'))) {
+      *port++ = '\0';
+      host = copy;
+    } else { /* local */
+      port = copy;
+      host = NULL;
+    }
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (!getaddrinfo(host, port, &hints, &pAddrs)) {
+      for (pAddr = pAddrs; pAddr; pAddr = pAddr->ai_next) {
+        if ((fd = socket(pAddr->ai_family, pAddr->ai_socktype,
+                         pAddr->ai_protocol)) < 0)
+          continue;
+        if (connect(fd, pAddr->ai_addr, pAddr->ai_addrlen) == 0)
+          break;
+        close(fd);
+        fd = -1;
+      } /* END for */
+      freeaddrinfo(pAddrs);
+    }
+    /* every batch goes out at once */
+    if (fd >= 0)
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    free(copy);
+  } /* END if Unix ... else ... */
 
-      debug("\"from\" is on the east side of \"to\"\n");
-    } else if (!strcasecmp(argv[arg], "-west")) {
-      doEdge = EDGE_WEST;
+  if (fd < 0)
+    fprintf(stderr, "%s - error: can not connect to agent %s\n",
+            programStr, address);
+  return fd;
 
-      debug("\"from\" is on the west side of \"to\"\n");
-    } else if (!strcasecmp(argv[arg], "-nosel")) {
-      doSel = False;
+} /* END AgentConnect */
 
-      debug("will not transmit X selections between displays\n");
-    } else if (!strcasecmp(argv[arg], "-noautoup")) {
-      doAutoUp = False;
-
-      debug("will not automatically lift keys and buttons\n");
-    } else if (!strcasecmp(argv[arg], "-buttonblock")) {
-      doBtnBlock = True;
+static void AgentPut(pShadow, op, a, b)
+PSHADOW pShadow;
+int     op;
+long    a, b;
+{
+  unsigned char *pBuf;
+  unsigned long n;
+  int      nNums, counter;
+
+  if (pShadow->agentLen + AGENT_MAX_MSG > AGENT_BUF_SIZE)
+    FlushShadow(pShadow);
+
+  pBuf = pShadow->agentBuf + pShadow->agentLen;
+  *pBuf++ = op;
+  switch (op) {
+  case AGENT_MOTION: nNums = 2; break;
+  case AGENT_WAKE:
+  case AGENT_LEAVE:
+  case AGENT_ENTER:  nNums = 0; break;
+  default:           nNums = 1; break;
+  }
+  for (counter = 0; counter < nNums; ++counter) {
+    n = AGENT_ZIGZAG(counter ? b : a);
+    while (n >= 0x80) {
+      *pBuf++ = (n & 0x7f) | 0x80;
+      n >>= 7;
+    }
+    *pBuf++ = n;
+  } /* END for */
+  pShadow->agentLen = pBuf - pShadow->agentBuf;
 
-      debug("mouse buttons down will block disconnects\n");
-    } else if (!strcasecmp(argv[arg], "-capslockhack")) {
-      doCapsLkHack = True;
+} /* END AgentPut */
 
-      debug("behavior of CapsLock will be hacked\n");
-    } else if (!strcasecmp(argv[arg], "-dpmsmouse")) {
-      doDpmsMouse = True;
+static void FakeKey(pShadow, keycode, down)
+PSHADOW pShadow;
+KeyCode keycode;
+Bool    down;
+{
+  long long traced;
 
-      debug("mouse movement wakes monitor\n");
-    } else if (!strcasecmp(argv[arg], "-offset")) {
-      if (++arg >= argc) Usage();
-      logicalOffset = atoi(argv[arg]);
+  SendMotion(pShadow); /* where the pointer was, first */
+  TRACE_START(traced);
+  if (pShadow->agentFd >= 0)
+    AgentPut(pShadow, down ? AGENT_KEY_DOWN : AGENT_KEY_UP, keycode, 0);
+  else
+    XTestFakeKeyEvent(pShadow->dpy, keycode, down, 0);
+  TRACE_END(traced, "FakeKey", pShadow->name);
 
-      debug("logicalOffset %d\n", logicalOffset);
-    } else if (!strcasecmp(argv[arg], "-clipcheck")) {
-      doClipCheck = True;
+} /* END FakeKey */
 
-      debug("Clipboard type will be checked for XA_STRING\n");
-    } else if (!strcasecmp(argv[arg], "-nocapslockhack")) {
-      doCapsLkHack = False;
+static void FakeButton(pShadow, button, down)
+PSHADOW pShadow;
+unsigned int button;
+Bool    down;
+{
+  long long traced;
 
-      debug("behavior of CapsLock will not be hacked\n");
-    } else if (!strcasecmp(argv[arg], "-sticky")) {
-      if (++arg >= argc) Usage();
-      if ((keysym = XStringToKeysym(argv[arg])) != NoSymbol) {
-        pNewSticky = (PSTICKY)xmalloc(sizeof(STICKY));
-        pNewSticky->pNext  = stickies;
-        pNewSticky->keysym = keysym;
-        stickies = pNewSticky;
+  SendMotion(pShadow); /* where the pointer was, first */
+  TRACE_START(traced);
+  if (pShadow->agentFd >= 0)
+    AgentPut(pShadow, down ? AGENT_BUTTON_DOWN : AGENT_BUTTON_UP, button, 0);
+  else
+    XTestFakeButtonEvent(pShadow->dpy, button, down, 0);
+  TRACE_END(traced, "FakeButton", pShadow->name);
 
-        debug("will press/release sticky key: %s\n", argv[arg]);
-      } else {
-        printf("x2x: warning: can't translate %s\n", argv[arg]);
-      }
-    } else if (!strcasecmp(argv[arg], "-buttonmap")) {
-      if (++arg >= argc) Usage();
-      button = atoi(argv[arg]);
+} /* END FakeButton */
 
-      if ((button < 1) || (button > N_BUTTONS))
-        printf("x2x: warning: invalid button %d\n", button);
-      else if (++arg >= argc)
-        Usage();
-      else
-      {
-        debug("will map button %d to keysyms '%s'\n", button, argv[arg]);
+/**********
+ * motion is only noted: of a burst, the latest goes out, before any key
+ * or button and at the latest with FlushShadow
+ **********/
+static void FakeMotion(pShadow, screen, x, y)
+PSHADOW pShadow;
+int     screen, x, y;
+{
+  pShadow->motionQueued = True;
+  pShadow->motionScreen = screen;
+  pShadow->motionX = x;
+  pShadow->motionY = y;
 
-        argptr  = argv[arg];
-        eventno = 0;
-        while ((keyname = strtok(argptr, " \t\n\r")) != NULL)
-        {
-          if ((keysym = XStringToKeysym(keyname)) == NoSymbol)
-            printf("x2x: warning: can't translate %s\n", keyname);
-          else if (eventno + 1 >= MAX_BUTTONMAPEVENTS)
-            printf("x2x: warning: too many keys mapped to button %d\n",
-                   button);
-          else
-            buttonmap[button][eventno++] = keysym;
-          argptr = NULL;
-        }
-        buttonmap[button][eventno] = NoSymbol;
-      }
-    } else if (!strcasecmp(argv[arg], "-resurface")) {
-      doResurface = True;
+} /* END FakeMotion */
 
-      debug("will resurface the trigger window when obscured\n");
-    } else if (!strcasecmp(argv[arg], "-win-output")) {
-      doInputOnly = False;
-      debug("trigger window will be an InputOutput window\n");
-    } else if (!strcasecmp(argv[arg], "-win-transparent")) {
-      winTransparent = True;
-      debug("trigger window will be transparent\n");
-    } else if (!strcasecmp(argv[arg], "-shadow")) {
-      if (++arg >= argc) Usage();
-      pShadow = (PSHADOW)xmalloc(sizeof(SHADOW));
-      pShadow->DPMSstatus = -1;
-      pShadow->name = argv[arg];
+static void SendMotion(pShadow)
+PSHADOW pShadow;
+{
+  int screen = pShadow->motionScreen;
+  int x = pShadow->motionX, y = pShadow->motionY;
+  long long traced;
 
-      /* into the global list of shadows */
-      pShadow->pNext = shadows;
-      shadows = pShadow;
+  if (!pShadow->motionQueued)
+    return;
+  pShadow->motionQueued = False;
+  TRACE_START(traced);
+  if (pShadow->agentFd < 0) {
+    XTestFakeMotionEvent(pShadow->dpy, screen, x, y, 0);
+  } else {
+    if (screen != pShadow->agentScreen) {
+      AgentPut(pShadow, AGENT_SCREEN, screen, 0);
+      pShadow->agentScreen = screen;
+      pShadow->agentX = pShadow->agentY = 0;
+    }
+    AgentPut(pShadow, AGENT_MOTION, x - pShadow->agentX, y - pShadow->agentY);
+    pShadow->agentX = x;
+    pShadow->agentY = y;
+  }
+  TRACE_END(traced, "FakeMotion", pShadow->name);
 
-    } else if (!strcasecmp(argv[arg], "-triggerw")) {
-      if (++arg >= argc) Usage();
-      triggerw = atoi(argv[arg]);
-    } else if (!strcasecmp(argv[arg], "-copyright")) {
-      puts(lawyerese);
-    } else if (!strcasecmp(argv[arg], "-noscale")) {
-      noScale = True;
-    } else if (!strcasecmp(argv[arg], "-completeregionleft")) {
-      if (++arg >= argc) Usage();
-      compRegLeft = atoi(argv[arg]);
-    } else if (!strcasecmp(argv[arg], "-completeregionright")) {
-      if (++arg >= argc) Usage();
-      compRegRight = atoi(argv[arg]);
-    } else if (!strcasecmp(argv[arg], "-completeregionup")) {
-      if (++arg >= argc) Usage();
-      compRegUp = atoi(argv[arg]);
-    } else if (!strcasecmp(argv[arg], "-completeregionlow")) {
-      if (++arg >= argc) Usage();
-      compRegLow = atoi(argv[arg]);
+} /* END SendMotion */
 
-    } else if (!strcasecmp(argv[arg], "-struts")) {
-      useStruts = True;
+/**********
+ * True if the next event read from dpy is motion too
+ **********/
+static Bool MotionFollows(dpy)
+Display *dpy;
+{
+  XEvent ev;
 
-      debug("will advertise struts in _NET_WM_STRUT\n");
-    } else {
-      Usage();
-    } /* END if... */
-  } /* END for */
+  if (!XEventsQueued(dpy, QueuedAlready))
+    return False;
+  XPeekEvent(dpy, &ev);
+  return (ev.type == MotionNotify);
 
-} /* END ParseCommandLine */
+} /* END MotionFollows */
 
-static void Usage()
+static void FlushShadow(pShadow)
+PSHADOW pShadow;
 {
-#ifdef WIN_2_X
-  printf("Usage: x2x [-fromwin | -from <DISPLAY>][-to <DISPLAY>] options..\n");
-#else
-  printf("Usage: x2x [-to <DISPLAY> | -from <DISPLAY>] options...\n");
-#endif
-  printf("       -copyright\n");
-  printf("       -font <FONTNAME>\n");
-  printf("       -geometry <GEOMETRY>\n");
-  printf("       -wait\n");
-  printf("       -big\n");
-  printf("       -buttonblock\n");
-  printf("       -nomouse\n");
-  printf("       -nopointermap\n");
-  printf("       -north\n");
-  printf("       -south\n");
-  printf("       -east\n");
-  printf("       -west\n");
-  printf("       -nosel\n");
-  printf("       -noautoup\n");
-  printf("       -resurface\n");
-  printf("       -win-output\n");
-  printf("       -win-transparent\n");
-  printf("       -capslockhack\n");
-  printf("       -nocapslockhack\n");
-  printf("       -clipcheck\n");
-  printf("       -shadow <DISPLAY>\n");
-  printf("       -sticky <STICKY KEY>\n");
-  printf("       -label <LABEL>\n");
-  printf("       -title <TITLE>\n");
-  printf("       -buttonmap <BUTTON#> \"<KEYSYM> ...\"\n");
-  printf("       -completeregionleft <COORDINATE>\n");
-  printf("       -completeregionright <COORDINATE>\n");
-  printf("       -completeregionup <COORDINATE>\n");
-  printf("       -completeregionlow <COORDINATE>\n");
-  printf("       -struts\n");
-#ifdef WIN_2_X
-  printf("       -offset [-]<pixel offset of \"to\">\n");
-  printf("WIN_2_X build allows Windows or X as -from display\n");
-  printf("Note that -fromwin sets default to -big -west -capslockhack\n");
-  printf("A Windows shortcut of the form:\n");
-  printf("C:\\cygwin\\usr\\X11R6\\bin\\run.exe /usr/X11R6/bin/x2x -fromwin -to <to> -east\n");
-  printf("Should work to start the app from the desktop or start menu, but\n");
-  printf("c:\\cygwin\\bin may need to be added to the PATH to get cygwin1.dll\n");
-#endif
-  exit(4);
+  int off, n;
+  long long traced;
 
-} /* END Usage */
+  SendMotion(pShadow);
+  TRACE_START(traced);
+  if (pShadow->agentFd < 0) {
+    XFlush(pShadow->dpy);
+    TRACE_END(traced, "XFlush", pShadow->name);
+    return;
+  }
+  for (off = 0; off < pShadow->agentLen; off += n) {
+    if ((n = write(pShadow->agentFd, pShadow->agentBuf + off,
+                   pShadow->agentLen - off)) < 0) {
+      if (errno == EINTR) {
+        n = 0;
+        continue;
+      }
+      fprintf(stderr, "%s - error: lost connection to agent %s\n",
+              programStr, agentAddress);
+      exit(1);
+    }
+  } /* END for */
+  pShadow->agentLen = 0;
+  TRACE_END(traced, "AgentFlush", pShadow->name);
+
+} /* END FlushShadow */
 
 /**********
- * call the library to check for the test extension
+ * output once no input is left to read: the motion not sent yet, then
+ * a piece of the selection data for each display
  **********/
-static Bool CheckTestExtension(dpy)
-Display  *dpy;
+static void FlushOutput()
 {
-  int eventb, errorb;
-  int vmajor, vminor;
+  PDPYINFO pSource;
+  PSHADOW  pShadow;
 
-  return (XTestQueryExtension(dpy, &eventb, &errorb, &vmajor, &vminor));
+  for (pSource = &dpyInfo; pSource; pSource = pSource->pNext)
+    if (XEventsQueued(pSource->fromDpy, QueuedAfterReading))
+      return;
+  for (pShadow = shadows; pShadow; pShadow = pShadow->pNext)
+    if (pShadow->motionQueued) {
+      FlushShadow(pShadow);
+      pShadow->flush = False;
+    }
+  if (dpyInfo.fromDpyXtra.pBulk)
+    PumpBulk(&dpyInfo, dpyInfo.fromDpy);
+  if (dpyInfo.toDpyXtra.pBulk)
+    PumpBulk(&dpyInfo, dpyInfo.toDpy);
 
-} /* END CheckTestExtension */
+} /* END FlushOutput */
 
-#ifndef WIN_2_X
-int ErrorHandler(Display *disp, XErrorEvent *event) {
+/**********
+ * nothing is left in an output buffer while x2x waits: the requests
+ * handling an event made to other displays go now
+ **********/
+static void FlushDisplays()
+{
+  PDPYINFO pSource;
+  PNODE    pNode;
+  PSHADOW  pShadow;
+
+  for (pSource = &dpyInfo; pSource; pSource = pSource->pNext)
+    XFlush(pSource->fromDpy);
+  for (pNode = nodes; pNode; pNode = pNode->pNext)
+    XFlush(pNode->dpy);
+  for (pShadow = shadows; pShadow; pShadow = pShadow->pNext)
+    XFlush(pShadow->dpy);
 
-  int bufflen = 1024;
-  char *buff;
-  buff = malloc(bufflen);
+} /* END FlushDisplays */
 
-  XGetErrorText(disp,event->error_code,buff,bufflen);
-  debug("x2x:ErrHandler(): Display:`%s` \t error_code:`%i` \n",
-        XDisplayName(NULL),event->error_code);
-  printf(" %s \n",buff);
-  free(buff);
-  return True;
-}
+/**********
+ * -trace: spans of the event pipeline in Chrome trace event format
+ * (chrome://tracing, ui.perfetto.dev).  A span is kept in a ring of
+ * its thread; the ring is written out when full and at exit, so that
+ * tracing an event costs two clock reads.
+ **********/
+static void TraceOpen()
+{
+  if (!(traceFp = fopen(traceFile, "w"))) {
+    fprintf(stderr, "%s - error: can not write %s: %s\n",
+            programStr, traceFile, strerror(errno));
+    exit(1);
+  }
+#ifdef HAVE_PTHREAD
+  pthread_key_create(&traceKey, NULL);
 #endif
+  fprintf(traceFp, "[\n");
+  traceOrigin = TraceNow() - 1; /* a span never starts at 0 */
+  atexit(TraceClose);
 
-#define X2X_DISCONNECTED    0
-#define X2X_AWAIT_RELEASE   1
-#define X2X_CONNECTED       2
-#define X2X_CONN_RELEASE    3
+} /* END TraceOpen */
 
-static void signal_handler(int sig)
+static long long TraceNow()
 {
-  if (dpyInfo.mode == X2X_CONNECTED)
-    DoDisconnect(&dpyInfo);
-  dpyInfo.signal = sig;
-}
+  struct timespec ts;
 
-static void DoX2X(fromDpy, toDpy)
-Display *fromDpy;
-Display *toDpy;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec * 1000000000LL) + ts.tv_nsec;
+
+} /* END TraceNow */
+
+static void TraceSpan(name, arg, start)
+const char *name;
+const char *arg;
+long long  start;
 {
-  int       nfds;
-  fd_set    fdset;
-  Bool      fromPending;
-  int       fromConn, toConn;
+  PTRACERING pRing = TraceRing();
+  TRACEREC   *pRec;
 
-  /* set up displays */
-  dpyInfo.fromDpy = fromDpy;
-  dpyInfo.toDpy = toDpy;
-  InitDpyInfo(&dpyInfo);
-  RegisterEventHandlers(&dpyInfo);
+  if (pRing->nRecs == TRACE_RING_SIZE) {
+#ifdef HAVE_PTHREAD
+    pthread_mutex_lock(&traceMutex);
+#endif
+    TraceWrite(pRing);
+#ifdef HAVE_PTHREAD
+    pthread_mutex_unlock(&traceMutex);
+#endif
+  }
+  pRec = &(pRing->recs[pRing->nRecs++]);
+  pRec->name  = name;
+  pRec->arg   = arg;
+  pRec->start = start;
+  pRec->dur   = TraceNow() - start;
 
-  signal(SIGINT,  signal_handler);
-  signal(SIGTERM, signal_handler);
+} /* END TraceSpan */
 
-  /* set up for select */
-#ifdef WIN_2_X
-  fromConn = (fromDpy == fromWin) ? 0 : XConnectionNumber(fromDpy);
+/**********
+ * ring of the calling thread, made on its first span
+ **********/
+static PTRACERING TraceRing()
+{
+  static PTRACERING pRing = NULL; /* without threads */
+
+#ifdef HAVE_PTHREAD
+  if ((pRing = (PTRACERING)pthread_getspecific(traceKey)))
+    return pRing;
+  pRing = (PTRACERING)xmalloc(sizeof(TRACERING));
+  pthread_setspecific(traceKey, pRing);
+  pthread_mutex_lock(&traceMutex);
+  pRing->tid = ++traceTids;
+  pRing->pNext = traceRings;
+  traceRings = pRing;
+  pthread_mutex_unlock(&traceMutex);
 #else
-  fromConn = XConnectionNumber(fromDpy);
-#endif /* WIN_2_X */
+  if (pRing)
+    return pRing;
+  pRing = (PTRACERING)xmalloc(sizeof(TRACERING));
+  pRing->tid = ++traceTids;
+  traceRings = pRing;
+#endif
+  return pRing;
 
-  toConn   = XConnectionNumber(toDpy);
-  nfds = (fromConn > toConn ? fromConn : toConn) + 1;
+} /* END TraceRing */
 
-#ifdef WIN_2_X
-  if (fromDpy == fromWin) {
-    MSG                msg;                /* A Win32 message structure. */
-    int         nowQuit;
+/**********
+ * write out and empty a ring; the caller holds traceMutex
+ **********/
+static void TraceWrite(pRing)
+PTRACERING pRing;
+{
+  TRACEREC *pRec;
+  int      counter;
+
+  for (counter = 0; counter < pRing->nRecs; ++counter) {
+    pRec = &(pRing->recs[counter]);
+    fprintf(traceFp, "%s{\"name\":", traceFirst ? "" : ",\n");
+    TraceString(pRec->name);
+    fprintf(traceFp, ",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+            "\"ts\":%.3f,\"dur\":%.3f", (int)getpid(), pRing->tid,
+            (pRec->start - traceOrigin) / 1000.0, pRec->dur / 1000.0);
+    if (pRec->arg) {
+      fprintf(traceFp, ",\"args\":{\"display\":");
+      TraceString(pRec->arg);
+      fputc('}', traceFp);
+    }
+    fputc('}', traceFp);
+    traceFirst = False;
+  } /* END for */
+  pRing->nRecs = 0;
 
-    nowQuit = 0;
+} /* END TraceWrite */
 
-    /* XXX mdh - This is not quite right becaue it only does To events */
-    /* XXX mdh - when there are From events                            */
-    /* This is mostly ok, but can cause windows->X paste to take a while */
-    /* As a compromise, try a 1 second tick to cause polling */
+static void TraceString(str)
+const char *str;
+{
+  fputc('"', traceFp);
+  for (; *str; ++str) {
+    if ((*str == '"') || (*str == '\\'))
+      fputc('\\', traceFp);
+    if ((unsigned char)*str >= ' ')
+      fputc(*str, traceFp);
+  }
+  fputc('"', traceFp);
 
-    SetTimer(dpyInfo.bigwindow, 1, 1000 /* in ms */, NULL);
-    /* GetMessage blocks until the next Windows event */
-    /* It returns 0 if the app should quit */
-    while (!nowQuit && GetMessage (&msg, NULL, 0, 0)) {
-      /* XXX mdh - Translate may not be needed if all Key processing is */
-      /* XXX mdh - done using the Key events rather than CHAR events    */
-      TranslateMessage (&msg);
-      DispatchMessage (&msg);
-      /* Done a Windows event, now loop while -to has something */
-      while (XPending(toDpy) || dpyInfo.expectSelNotify) {
-        if (ProcessEvent(toDpy, &dpyInfo)) { /* done! */
-          nowQuit = 1;
-          break;
-        }
-        /* PeekMessage is a non-blocking version of GetMessage */
-        /* But it returns 0 for no messages rather than for quit */
-        if (PeekMessage (&msg, NULL, 0, 0, PM_REMOVE)) {
-          /* need explicit check for quit */
-          if (msg.message == WM_QUIT) {
-            nowQuit = 1;
-            break; /* from the while(XPending... )*/
-          }
-          /* XXX mdh - see above */
-          TranslateMessage (&msg);
-          DispatchMessage (&msg);
-        }
+} /* END TraceString */
+
+static void TraceClose()
+{
+  PTRACERING pRing;
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock(&traceMutex);
+#endif
+  for (pRing = traceRings; pRing; pRing = pRing->pNext)
+    TraceWrite(pRing);
+  fprintf(traceFp, "\n]\n");
+  fclose(traceFp);
+  traceFp = NULL;
+#ifdef HAVE_PTHREAD
+  pthread_mutex_unlock(&traceMutex);
+#endif
+
+} /* END TraceClose */
+
+/**********
+ * keep one log call: its format and arguments, with copies of its
+ * strings since they may be gone by the time the log is dumped
+ **********/
+static void LogRecord(int level, const char *fmt, ...)
+{
+  va_list       ap;
+  unsigned long index;
+  PLOGREC       pRec;
+  const char    *pFmt, *str;
+  char          *pStr, *pStrEnd;
+  int           nLongs;
+
+  index = logHead++;
+  pRec = &(logRing[index & (LOG_RING_SIZE - 1)]);
+  pRec->seq   = 0; /* being written */
+  pRec->fmt   = fmt;
+  pRec->time  = logEventTime ? logEventTime : LogNow();
+  pRec->level = level;
+  pRec->nArgs = 0;
+  pStr    = pRec->strs;
+  pStrEnd = pRec->strs + LOG_STR_SIZE - 1;
+
+  va_start(ap, fmt);
+  for (pFmt = fmt; pRec->nArgs < LOG_MAX_ARGS;) {
+    while (*pFmt && (*pFmt != '%')) /* shorter than a call to strchr */
+      ++pFmt;
+    if (!*pFmt)
+      break;
+    for (++pFmt, nLongs = 0; LOG_FLAG(*pFmt); ++pFmt)
+      nLongs += LOG_LONG(*pFmt);
+    switch (*pFmt++) {
+    case '%':
+      break;
+    case '\0':
+      --pFmt;
+      break;
+    case 's':
+      str = va_arg(ap, const char *);
+      if (!str)
+        str = "(null)";
+      for (; *str && (pStr < pStrEnd); *pStr++ = *str++);
+      *pStr = '\0';
+      if (pStr < pStrEnd)
+        ++pStr;
+      ++(pRec->nArgs);
+      break;
+    case 'p':
+      pRec->args[pRec->nArgs++] = (long long)(long)va_arg(ap, void *);
+      break;
+    case 'e': case 'E': case 'f': case 'F': case 'g': case 'G':
+      {
+        double d = va_arg(ap, double);
+        memcpy(&(pRec->args[pRec->nArgs++]), &d, sizeof(d));
       }
-    }
-  } else
-    /* Again, the else qualifies the while below */
-#endif /* WIN_2_X */
-  while (dpyInfo.signal == 0) { /* FOREVER */
-    if ((fromPending = XPending(fromDpy)))
-      if (ProcessEvent(fromDpy, &dpyInfo)) /* done! */
-        break;
+      break;
+    default: /* integers */
+      pRec->args[pRec->nArgs++] =
+        (nLongs == 0) ? (long long)va_arg(ap, int) :
+        (nLongs == 1) ? (long long)va_arg(ap, long) :
+        va_arg(ap, long long);
+      break;
+    } /* END switch */
+  } /* END for */
+  va_end(ap);
 
-    if (XPending(toDpy)) {
-      if (ProcessEvent(toDpy, &dpyInfo)) /* done! */
-        break;
-    } else if (!fromPending) {
-      FD_ZERO(&fdset);
-      FD_SET(fromConn, &fdset);
-      FD_SET(toConn, &fdset);
-      select(nfds, &fdset, NULL, NULL, NULL);
-    }
+  /* complete once seq is seen (a plain store on x86) */
+#if defined(__GNUC__)
+  __atomic_store_n(&(pRec->seq), index + 1, __ATOMIC_RELEASE);
+#else
+  pRec->seq = index + 1;
+#endif
 
-  } /* END FOREVER */
+#ifdef DEBUG
+  { /* as debug() always did */
+    char line[512];
+    LogFormat(pRec, line, sizeof(line));
+    fputs(line, stdout);
+  }
+#else
+  if (level <= LOG_WARN) {
+    char line[512];
+    LogFormat(pRec, line, sizeof(line));
+    fprintf(stderr, "%s: %s", programStr, line);
+  }
+#endif
 
-} /* END DoX2X() */
+} /* END LogRecord */
 
-static void InitDpyInfo(pDpyInfo)
-PDPYINFO pDpyInfo;
+static long long LogNow()
 {
-  Display   *fromDpy, *toDpy;
-  Screen    *fromScreen;
-  long      black, white;
-  int       fromHeight, fromWidth, toHeight, toWidth;
-  Pixmap    nullPixmap;
-  XColor    dummyColor;
-  Window    root, trigger, big, rret, toRoot, propWin;
-  short     *xTable, *yTable; /* short: what about dimensions > 2^15? */
-  int       *heights, *widths;
-  int       counter;
-  int       nScreens, screenNum;
-  int       twidth, theight, tascent; /* text dimensions */
-  int       xoff, yoff; /* window offsets */
-  unsigned int width, height; /* window width, height */
-  int       geomMask;                /* mask returned by parse */
-  int       gravMask;
-  int       gravity;
-  int       xret, yret;
-  unsigned int wret, hret, bret, dret;
-  XSetWindowAttributes xswa;
-  XSizeHints *xsh;
-  int       eventMask;
-  GC        textGC;
-  char      *windowName;
-  Font      fid;
-  PSHADOW   pShadow;
-  int       triggerLoc;
-  Bool      vertical;
+  struct timespec ts;
 
-  /* cache commonly used variables */
-  fromDpy = pDpyInfo->fromDpy;
-  toDpy   = pDpyInfo->toDpy;
-  pDpyInfo->toDpyXtra.propWin = (Window) 0;
+#ifdef CLOCK_MONOTONIC_COARSE
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+#else
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+  return (ts.tv_sec * 1000000000LL) + ts.tv_nsec;
 
-  gravity = NorthWestGravity;   /* Default gravity of window. */
-  pDpyInfo->fid = 0; /* Default is no text. */
+} /* END LogNow */
 
-#ifdef WIN_2_X
-  pDpyInfo->unreasonableCount = 0;
+/**********
+ * the text of a log record; returns its length
+ **********/
+static int LogFormat(pRec, line, size)
+PLOGREC pRec;
+char    *line;
+int     size;
+{
+  const char *pFmt = pRec->fmt, *pStr = pRec->strs;
+  char       spec[16], *pSpec;
+  int        len = 0, arg = 0, nLongs, n;
+  double     d;
+
+  while (*pFmt && (len < size - 1)) {
+    if (*pFmt != '%') {
+      line[len++] = *pFmt++;
+      continue;
+    }
+    pSpec = spec;
+    *pSpec++ = *pFmt++;
+    for (nLongs = 0; LOG_FLAG(*pFmt) && (pSpec < spec + sizeof(spec) - 4);
+         ++pFmt) {
+      if (LOG_LONG(*pFmt)) {
+        ++nLongs;
+        continue; /* everything is passed as long long */
+      }
+      *pSpec++ = *pFmt;
+    }
+    if (!*pFmt)
+      break;
+    if (*pFmt == '%') {
+      line[len++] = *pFmt++;
+      continue;
+    }
+    if (arg >= pRec->nArgs) /* more than LOG_MAX_ARGS */
+      break;
+    switch (*pFmt) {
+    case 's':
+      *pSpec++ = 's';
+      *pSpec = '\0';
+      n = snprintf(line + len, size - len, spec, pStr);
+      /* a string that filled strs ends on its last byte, as do those
+         recorded after it */
+      pStr += strlen(pStr) + 1;
+      if (pStr > pRec->strs + LOG_STR_SIZE - 1)
+        pStr = pRec->strs + LOG_STR_SIZE - 1;
+      break;
+    case 'p':
+      *pSpec++ = 'p';
+      *pSpec = '\0';
+      n = snprintf(line + len, size - len, spec,
+                   (void *)(long)pRec->args[arg]);
+      break;
+    case 'c':
+      *pSpec++ = 'c';
+      *pSpec = '\0';
+      n = snprintf(line + len, size - len, spec, (int)pRec->args[arg]);
+      break;
+    case 'e': case 'E': case 'f': case 'F': case 'g': case 'G':
+      *pSpec++ = *pFmt;
+      *pSpec = '\0';
+      memcpy(&d, &(pRec->args[arg]), sizeof(d));
+      n = snprintf(line + len, size - len, spec, d);
+      break;
+    default:
+      *pSpec++ = 'l';
+      *pSpec++ = 'l';
+      *pSpec++ = *pFmt;
+      *pSpec = '\0';
+      n = snprintf(line + len, size - len, spec,
+                   (nLongs || (*pFmt == 'd') || (*pFmt == 'i')) ?
+                   pRec->args[arg] :
+                   (long long)(unsigned int)pRec->args[arg]);
+      break;
+    } /* END switch */
+    ++pFmt;
+    ++arg;
+    len += (n < 0) ? 0 : n;
+    if (len > size - 1)
+      len = size - 1;
+  } /* END while */
+  line[len] = '\0';
+  return len;
+
+} /* END LogFormat */
 
-  if (fromDpy == fromWin) {
+/**********
+ * LogFormat for a signal handler, without stdio, which the crash may
+ * have left locked: flags, width and precision are dropped, and doubles
+ * come out with 3 decimals
+ **********/
+static int LogFormatSafe(pRec, line, size)
+PLOGREC pRec;
+char    *line;
+int     size;
+{
+  const char *pFmt = pRec->fmt, *pStr = pRec->strs;
+  const char *lower = "0123456789abcdef", *upper = "0123456789ABCDEF";
+  int        len = 0, arg = 0, nLongs;
+  long long  value;
+  double     d;
+
+  while (*pFmt && (len < size - 1)) {
+    if (*pFmt != '%') {
+      line[len++] = *pFmt++;
+      continue;
+    }
+    for (++pFmt, nLongs = 0; LOG_FLAG(*pFmt); ++pFmt)
+      nLongs += LOG_LONG(*pFmt);
+    if (!*pFmt)
+      break;
+    if (*pFmt == '%') {
+      line[len++] = *pFmt++;
+      continue;
+    }
+    if (arg >= pRec->nArgs) /* more than LOG_MAX_ARGS */
+      break;
+    value = pRec->args[arg];
+    switch (*pFmt) {
+    case 's':
+      for (; *pStr; ++pStr)
+        if (len < size - 1)
+          line[len++] = *pStr;
+      if (pStr < pRec->strs + LOG_STR_SIZE - 1) /* as in LogFormat */
+        ++pStr;
+      break;
+    case 'c':
+      line[len++] = (char)value;
+      break;
+    case 'p':
+      line[len++] = '0';
+      if (len < size - 1)
+        line[len++] = 'x';
+      len = LogPutNumber(line, len, size, (unsigned long)value, 16, lower, 1);
+      break;
+    case 'e': case 'E': case 'f': case 'F': case 'g': case 'G':
+      memcpy(&d, &value, sizeof(d));
+      if (d < 0) {
+        line[len++] = '-';
+        d = -d;
+      }
+      if (!(d < 1e18)) { /* or not a number */
+        line[len++] = '?';
+        break;
+      }
+      len = LogPutNumber(line, len, size, (unsigned long long)d, 10, lower,
+                         1);
+      if (len < size - 1)
+        line[len++] = '.';
+      len = LogPutNumber(line, len, size, (unsigned long long)
+                         ((d - (double)(unsigned long long)d) * 1000), 10,
+                         lower, 3);
+      break;
+    case 'd': case 'i':
+      if (value < 0) {
+        line[len++] = '-';
+        value = -value;
+      }
+      len = LogPutNumber(line, len, size, value, 10, lower, 1);
+      break;
+    default: /* unsigned */
+      if (!nLongs)
+        value = (unsigned int)value;
+      len = LogPutNumber(line, len, size, value,
+                         (*pFmt == 'o') ? 8 : (*pFmt == 'u') ? 10 : 16,
+                         (*pFmt == 'X') ? upper : lower, 1);
+      break;
+    } /* END switch */
+    ++pFmt;
+    ++arg;
+  } /* END while */
+  line[len] = '\0';
+  return len;
 
-    fromWidth=GetSystemMetrics(SM_CXSCREEN);
-    fromHeight=GetSystemMetrics(SM_CYSCREEN);
+} /* END LogFormatSafe */
 
-    POINT pt;
+/**********
+ * value in base, at least min digits, after len bytes of line; returns
+ * the new length
+ **********/
+static int LogPutNumber(line, len, size, value, base, digits, min)
+char   *line;
+int    len, size;
+unsigned long long value;
+int    base;
+const char *digits;
+int    min;
+{
+  char buf[24]; /* 64 bits in octal */
+  int  n = 0;
 
-    pDpyInfo->screenRect.left = GetSystemMetrics(SM_XVIRTUALSCREEN);
-    pDpyInfo->screenRect.top = GetSystemMetrics(SM_YVIRTUALSCREEN);
-    pDpyInfo->screenRect.right = GetSystemMetrics(SM_CXVIRTUALSCREEN);
-    pDpyInfo->screenRect.bottom = GetSystemMetrics(SM_CYVIRTUALSCREEN);
-    pDpyInfo->screenHeight = pDpyInfo->screenRect.bottom - pDpyInfo->screenRect.top;
-    pDpyInfo->screenWidth = pDpyInfo->screenRect.right - pDpyInfo->screenRect.left;
+  do {
+    buf[n++] = digits[value % base];
+    value /= base;
+  } while (value || (n < min));
+  while (n && (len < size - 1))
+    line[len++] = buf[--n];
+  return len;
 
+} /* END LogPutNumber */
 
-    // Guess a a point at or near the monitor we want.
-    if (doEdge == EDGE_NORTH || doEdge == EDGE_SOUTH)
-    {
-      pt.x = (pDpyInfo->screenRect.right - pDpyInfo->screenRect.left) / 2;
-      pt.y = (doEdge == EDGE_SOUTH) ? pDpyInfo->screenRect.bottom - 1 : pDpyInfo->screenRect.top;;
-    }
-    else
-    {
-      pt.x = (doEdge == EDGE_EAST) ? pDpyInfo->screenRect.right - 1 : pDpyInfo->screenRect.left;
-      pt.y = (pDpyInfo->screenRect.bottom -  pDpyInfo->screenRect.top) / 2;
+/**********
+ * write out the log, oldest first; records overwritten or being
+ * written meanwhile are skipped.  safe in a signal handler.
+ **********/
+static void LogDump(fd, safe)
+int  fd;
+Bool safe;
+{
+  unsigned long head = logHead, index;
+  PLOGREC       pRec;
+  char          line[600];
+  int           len;
+  long long     ns;
+
+  index = (head > LOG_RING_SIZE) ? head - LOG_RING_SIZE : 0;
+  for (; index < head; ++index) {
+    pRec = &(logRing[index & (LOG_RING_SIZE - 1)]);
+    if (pRec->seq != index + 1)
+      continue;
+    if (safe) {
+      ns = MAX(pRec->time - logOrigin, 0);
+      len = LogPutNumber(line, 0, sizeof(line), ns / 1000000000LL, 10,
+                         "0123456789", 1);
+      line[len++] = '.';
+      len = LogPutNumber(line, len, sizeof(line),
+                         (ns % 1000000000LL) / 1000, 10, "0123456789", 6);
+      line[len++] = ' ';
+      line[len++] = "EWID"[pRec->level];
+      line[len++] = ' ';
+      len += LogFormatSafe(pRec, line + len, sizeof(line) - len);
+    } else {
+      len = snprintf(line, 88, "%12.6f %c ",
+                     (pRec->time - logOrigin) / 1e9, "EWID"[pRec->level]);
+      len += LogFormat(pRec, line + len, sizeof(line) - len);
     }
+    if ((len == 0) || (line[len - 1] != '\n'))
+      line[len++] = '\n';
+    if (write(fd, line, len) < 0)
+      return;
+  } /* END for */
 
-    HMONITOR mon = MonitorFromPoint(pt, MONITOR_DEFAULTTONEAREST);
+} /* END LogDump */
 
-    MONITORINFO monInfo;
-    monInfo.cbSize = sizeof(MONITORINFO);
-    GetMonitorInfo(mon, &monInfo);
+static void LogDumpSignal(sig)
+int sig;
+{
+  logDumpPending = 1;
 
-    pDpyInfo->monitorRect = monInfo.rcMonitor;
+} /* END LogDumpSignal */
 
-    /* these should not be used, but keep compiler happy */
-    fromScreen = (Screen *) 0;
-    black = white = 0;
-    root = pDpyInfo->root = None;
-  } else {
-    fromScreen = XDefaultScreenOfDisplay(fromDpy);
-    black      = XBlackPixelOfScreen(fromScreen);
-    white      = XWhitePixelOfScreen(fromScreen);
-    fromHeight = XHeightOfScreen(fromScreen);
-    fromWidth  = XWidthOfScreen(fromScreen);
-    root       = pDpyInfo->root      = XDefaultRootWindow(fromDpy);
+/**********
+ * last words: what led to the crash, then the crash itself.  The crash
+ * may be in malloc or stdio: the log is formatted by hand.
+ **********/
+static void LogCrash(sig)
+int sig;
+{
+  signal(sig, SIG_DFL);
+  LogDump(2, True);
+  raise(sig);
+
+} /* END LogCrash */
+
+#if defined(RTT_AUDIT) && !defined(WIN_2_X)
+static void AuditBegin(call, caller)
+const char *call;
+const char *caller;
+{
+  if (auditForbid) {
+    fprintf(stderr, "%s - error: round trip on the input path: %s in %s "
+            "(%s)\n", programStr, call, caller, auditContext);
+    exit(1);
   }
-  toRoot     = XDefaultRootWindow(toDpy);
-  nScreens   = pDpyInfo->nScreens  = XScreenCount(toDpy);
-  vertical   = pDpyInfo->vertical = (doEdge == EDGE_NORTH
-                                      || doEdge == EDGE_SOUTH);
-#else
-  gravity = NorthWestGravity;   /* keep compliler happy */
-  fromScreen = XDefaultScreenOfDisplay(fromDpy);
-  black      = XBlackPixelOfScreen(fromScreen);
-  white      = XWhitePixelOfScreen(fromScreen);
-  fromHeight = XHeightOfScreen(fromScreen);
-  fromWidth  = XWidthOfScreen(fromScreen);
-  toRoot     = XDefaultRootWindow(toDpy);
+  auditStart = TraceNow();
 
-  /* values also in dpyinfo */
-  root       = pDpyInfo->root      = XDefaultRootWindow(fromDpy);
-  nScreens   = pDpyInfo->nScreens  = XScreenCount(toDpy);
-  vertical   = pDpyInfo->vertical = (doEdge == EDGE_NORTH
-                                      || doEdge == EDGE_SOUTH);
-#endif
+} /* END AuditBegin */
 
-  if (compRegRight == 0)
-   compRegRight = fromWidth;
-  if (compRegLow == 0)
-    compRegLow = fromHeight;
+/**********
+ * account for a call that just returned ret
+ **********/
+static long AuditEnd(call, caller, dpy, ret)
+const char *call;
+const char *caller;
+Display    *dpy;
+long       ret;
+{
+  long long ns = TraceNow() - auditStart;
+  PAUDIT    pAudit;
 
-#ifdef WIN_2_X
-  if (fromDpy != fromWin) {
-#endif
-    pDpyInfo->fromDpyUtf8String = XInternAtom(fromDpy, UTF8_STRING, False);
-#ifdef WIN_2_X
+  for (pAudit = audits; pAudit; pAudit = pAudit->pNext)
+    if ((pAudit->call == call) && (pAudit->caller == caller) &&
+        (pAudit->dpy == dpy) && (pAudit->context == auditContext))
+      break;
+  if (!pAudit) {
+    pAudit = (PAUDIT)xmalloc(sizeof(AUDIT));
+    pAudit->call    = call;
+    pAudit->caller  = caller;
+    pAudit->dpy     = dpy;
+    pAudit->dpyName = strdup(dpy ? DisplayString(dpy) : "(all)");
+    pAudit->context = auditContext;
+    pAudit->pNext   = audits;
+    audits = pAudit;
   }
-#endif
-  pDpyInfo->toDpyUtf8String = XInternAtom(toDpy, UTF8_STRING, False);
+  ++(pAudit->count);
+  pAudit->ns += ns;
+  return ret;
 
-  /* other dpyinfo values */
-  pDpyInfo->mode        = X2X_DISCONNECTED;
-  pDpyInfo->unreasonableDelta = (vertical ? fromHeight : fromWidth) / 2;
-  pDpyInfo->pFakeThings = NULL;
+} /* END AuditEnd */
 
-  /* window init structures */
-  xswa.override_redirect = True;
-  xsh = XAllocSizeHints();
-  eventMask = KeyPressMask | KeyReleaseMask;
+/**********
+ * from now on round trips are counted for context; returns the context
+ * to go back to
+ **********/
+static const char *AuditEnter(context)
+const char *context;
+{
+  const char    *saved = auditContext;
+  PAUDITCONTEXT pContext;
 
-  /* cursor locations for moving between screens */
-  pDpyInfo->fromIncrCoord = triggerw;
-  pDpyInfo->fromDecrCoord = (vertical ? fromHeight : fromWidth) - triggerw - 1;
-  if (doEdge) { /* edge triggers x2x */
-#ifdef WIN_2_X
-    if (fromDpy == fromWin) {
-      /* keep compiler happy */
-      nullPixmap = 0;
-      pDpyInfo->grabCursor = 0;
-    } else {
-#endif
-    nullPixmap = XCreatePixmap(fromDpy, root, 1, 1, 1);
-    eventMask |= EnterWindowMask;
-    pDpyInfo->grabCursor =
-      XCreatePixmapCursor(fromDpy, nullPixmap, nullPixmap,
-                          &dummyColor, &dummyColor, 0, 0);
-#ifdef WIN_2_X
-    }
-#endif
+  for (pContext = auditContexts; pContext; pContext = pContext->pNext)
+    if (pContext->context == context)
+      break;
+  if (!pContext) {
+    pContext = (PAUDITCONTEXT)xmalloc(sizeof(AUDITCONTEXT));
+    pContext->context = context;
+    pContext->pNext = auditContexts;
+    auditContexts = pContext;
+  }
+  ++(pContext->count);
+  auditContext = context;
+  return saved;
 
-    /* trigger window location */
-    if (doEdge == EDGE_NORTH) {
-      triggerLoc = 0;
-      pDpyInfo->fromConnCoord = compRegLow - triggerw - 1;
-      pDpyInfo->fromDiscCoord = triggerw;
-    } else if (doEdge == EDGE_SOUTH) {
-      triggerLoc = fromHeight - triggerw;
-      pDpyInfo->fromConnCoord = compRegUp + 1;
-      pDpyInfo->fromDiscCoord = triggerLoc - 1;
-    } else if (doEdge == EDGE_EAST) {
-      triggerLoc = fromWidth - triggerw;
-      pDpyInfo->fromConnCoord = compRegLeft + 1;
-      pDpyInfo->fromDiscCoord = triggerLoc - 1;
-    } else /* doEdge == EDGE_WEST */ {
-      triggerLoc = 0;
-      pDpyInfo->fromConnCoord = compRegRight - triggerw - 1;
-      pDpyInfo->fromDiscCoord = triggerw;
-    } /* END if doEdge == ... */
+} /* END AuditEnter */
 
-    xswa.background_pixel = black;
+/**********
+ * synchronous mode: the XSync after each request, counted
+ **********/
+static int AuditAfter(dpy)
+Display *dpy;
+{
+  AuditBegin("(synchronous)", "XSynchronize");
+  return (int)AuditEnd("(synchronous)", "XSynchronize", dpy,
+                       (long)(XSync)(dpy, False));
 
-#ifdef WIN_2_X
-    if (fromDpy == fromWin) {
+} /* END AuditAfter */
 
-      /* Create both trigger and big windows here */
-      /* This code is based on Win2VBC/vncviewer ClientConnection.cpp */
-      WNDCLASS wndclass;
-      const DWORD winstyle = 0;
-
-      wndclass.style		= 0;
-      wndclass.lpfnWndProc	= WinProcessMessage;
-      wndclass.cbClsExtra	= 0;
-      wndclass.cbWndExtra	= 0;
-      wndclass.hInstance	= m_instance;
-      /* XXX mdh - For now just use system provided resources */
-      wndclass.hIcon		= LoadIcon(NULL, IDI_APPLICATION);
-      // wndclass.hCursor	= LoadCursor(NULL, IDC_NO);
-      wndclass.hCursor		= LoadCursor(m_instance, MAKEINTRESOURCE(IDC_NOCURSOR));
-      wndclass.hbrBackground	= (HBRUSH) GetStockObject(BLACK_BRUSH);
-      wndclass.lpszMenuName	= (const TCHAR *) NULL;
-      wndclass.lpszClassName	= fromWinName;
+static void AuditSynchronize(dpy, onoff)
+Display *dpy;
+Bool    onoff;
+{
+  (XSynchronize)(dpy, onoff);
+  XSetAfterFunction(dpy, onoff ? AuditAfter : NULL);
 
-      RegisterClass(&wndclass);
+} /* END AuditSynchronize */
 
+static void AuditReport()
+{
+  PAUDITCONTEXT pContext;
+  PAUDIT        pAudit;
+  long          count;
+  long long     ns;
+
+  fprintf(stderr, "%s: round trips\n", programStr);
+  for (pContext = auditContexts; pContext; pContext = pContext->pNext) {
+    count = 0;
+    ns = 0;
+    for (pAudit = audits; pAudit; pAudit = pAudit->pNext)
+      if (pAudit->context == pContext->context) {
+        count += pAudit->count;
+        ns += pAudit->ns;
+      }
+    fprintf(stderr, "%-20s %8ld times %8ld round trips %6.2f each "
+            "%10.3f ms\n", pContext->context, pContext->count, count,
+            (double)count / pContext->count, ns / 1e6);
+  } /* END for pContext */
+  fprintf(stderr, "\n%-20s %-22s %-24s %-12s %8s %10s\n", "context",
+          "call", "caller", "display", "count", "ms");
+  for (pAudit = audits; pAudit; pAudit = pAudit->pNext)
+    fprintf(stderr, "%-20s %-22s %-24s %-12s %8ld %10.3f\n",
+            pAudit->context, pAudit->call, pAudit->caller, pAudit->dpyName,
+            pAudit->count, pAudit->ns / 1e6);
+
+} /* END AuditReport */
+#endif /* RTT_AUDIT */
 
-     pDpyInfo->bigwindow = CreateWindowEx(
-         WS_EX_TRANSPARENT | WS_EX_TOPMOST | WS_EX_TOOLWINDOW,
-         fromWinName,
-         "x2x_big",
-         winstyle,
-         0,
-         0,
-         fromWidth,
-         fromHeight,
-         NULL,                // Parent handle
-         NULL,                // Menu handle
-         m_instance,
-         NULL);
+/**********
+ * the switchboard layout graph
+ **********/
+static int ParseEdge(name)
+char *name;
+{
+  if (!strcasecmp(name, "north")) return EDGE_NORTH;
+  if (!strcasecmp(name, "south")) return EDGE_SOUTH;
+  if (!strcasecmp(name, "east"))  return EDGE_EAST;
+  if (!strcasecmp(name, "west"))  return EDGE_WEST;
+  return EDGE_NONE;
 
-      pDpyInfo->edgewindow = CreateWindowEx(
-         WS_EX_TRANSPARENT | WS_EX_TOPMOST | WS_EX_TOOLWINDOW,
-         fromWinName,
-         "x2x_edge",
-         winstyle,
-         /* Next 4 are x, y, width, height */
-         (doEdge == EDGE_EAST) ? pDpyInfo->monitorRect.right -1: pDpyInfo->monitorRect.left,
-         (doEdge == EDGE_SOUTH) ? pDpyInfo->monitorRect.bottom - 1 : pDpyInfo->monitorRect.top,
-         (pDpyInfo->vertical) ? pDpyInfo->monitorRect.right - pDpyInfo->monitorRect.left : 1,
-         (pDpyInfo->vertical) ? 1 : pDpyInfo->monitorRect.bottom - pDpyInfo->monitorRect.top,
-         pDpyInfo->bigwindow, // Parent handle
-         NULL,                // Menu handle
-         m_instance,
-         NULL);
+} /* END ParseEdge */
 
+static PNODE AddNode(name, pShadows)
+char    *name;
+PSHADOW pShadows;
+{
+  PNODE pNode, *ppNode;
 
-      ShowWindow(pDpyInfo->bigwindow, SW_HIDE);
-      ShowWindow(pDpyInfo->edgewindow, SW_HIDE);
-      pDpyInfo->fromWidth = fromWidth;
-      pDpyInfo->fromHeight = fromHeight;
-      pDpyInfo->wdelta = 0;
+  pNode = (PNODE)xmalloc(sizeof(NODE));
+  pNode->name = name;
+  pNode->shadows = pShadows;
+  pNode->dpy = pShadows->dpy;
+  pNode->fromEdge = EDGE_NONE;
 
-      // record which client created this window
-      SetWindowLong(pDpyInfo->bigwindow, GWL_USERDATA, (LONG) pDpyInfo);
-      SetWindowLong(pDpyInfo->edgewindow, GWL_USERDATA, (LONG) pDpyInfo);
+  /* keep the list in order, so that toDpy stays at its head */
+  for (ppNode = &nodes; *ppNode; ppNode = &((*ppNode)->pNext));
+  *ppNode = pNode;
+  return pNode;
 
-      // Set up clipboard watching
-      // We want to know when the clipboard changes, so
-      // insert ourselves in the viewer chain. But doing
-      // this will cause us to be notified immediately of
-      // the current state.
-      // We don't want to send that.
-      pDpyInfo->expectOwnClip = 0;
-      if (doSel) {
-        // pDpyInfo->initialClipboardSeen = False;
-        pDpyInfo->winSelText = NULL;
-        pDpyInfo->hwndNextViewer = SetClipboardViewer(pDpyInfo->edgewindow);
-      }
+} /* END AddNode */
 
-      pDpyInfo->onedge = 0;
-      MoveWindowToEdge(pDpyInfo);
-      /* Keep compile happy */
-      trigger = 0;
-    } else {
-#endif
-    /* fromWidth - 1 doesn't seem to work for some reason */
-    /* Use triggerw offsets so that if an x2x is running
-       along the left edge and along the north edge, both with
-       -resurface, we don't get a feedback loop of them each
-       fighting to be on top.
-        --09/27/99 Greg J. Badros <gjb@cs.washington.edu> */
-    /* also, make it an InputOnly window so I don't lose
-       screen real estate --09/29/99 gjb */
-    /* make it InputOutput when argument -win-output presents,
-       so to get window visibility change event and make -resurface work */
-    /* make it InputOutput so to make -resurface work*/ 
-    trigger = pDpyInfo->trigger =
-      XCreateWindow(fromDpy, root,
-                    vertical ? triggerw : triggerLoc,
-                    vertical ? triggerLoc : triggerw,
-                    vertical ? fromWidth - (2*triggerw) : triggerw,
-                    vertical ? triggerw : fromHeight - (2*triggerw),
-                    0, 0, InputOutput, 0,
-                    CWOverrideRedirect, &xswa);
+static PNODE FindNode(name)
+char *name;
+{
+  PNODE   pNode;
+  PSHADOW pShadow;
+  PDPYINFO pSource;
 
-    pDpyInfo->netWmWindowTypeAtom = XInternAtom(fromDpy, "_NET_WM_WINDOW_TYPE", True);
-    pDpyInfo->netWmWindowTypeDockAtom = XInternAtom(fromDpy, "_NET_WM_WINDOW_TYPE_DOCK", True);
-    XChangeProperty(fromDpy, trigger, pDpyInfo->netWmWindowTypeAtom,
-                    XA_ATOM, 32, PropModeReplace,
-                    (unsigned char *)&pDpyInfo->netWmWindowTypeDockAtom, 1);
+  name = XDisplayName(name);
+  for (pNode = nodes; pNode; pNode = pNode->pNext)
+    if (!strcasecmp(pNode->name, name))
+      return pNode;
 
-    if (useStruts) {
-      unsigned long struts[4] = { doEdge == EDGE_WEST ? triggerw : 0
-                                , doEdge == EDGE_EAST ? triggerw : 0
-                                , doEdge == EDGE_NORTH ? triggerw : 0
-                                , doEdge == EDGE_SOUTH ? triggerw : 0
-                                };
-      pDpyInfo->netWmStrutAtom = XInternAtom(fromDpy, "_NET_WM_STRUT", True);
-      XChangeProperty(fromDpy, trigger, pDpyInfo->netWmStrutAtom,
-                      XA_CARDINAL, 32, PropModeReplace,
-                      (unsigned char *)&struts, 4);
+  for (pSource = &dpyInfo; pSource; pSource = pSource->pNext)
+    if (!strcasecmp(name, pSource->name)) {
+      fprintf(stderr, "%s - error: %s is a \"from\" display\n",
+              programStr, name);
+      exit(1);
     }
 
-#ifdef WIN_2_X
-    }
-#endif
-  } else { /* normal window for text: do size grovelling */
-    pDpyInfo->grabCursor = XCreateFontCursor(fromDpy, XC_exchange);
-    eventMask |= StructureNotifyMask | ExposureMask;
-    if (doMouse) eventMask |= ButtonPressMask | ButtonReleaseMask;
+  /* new switchboard display: open it like a shadow */
+  pShadow = (PSHADOW)xmalloc(sizeof(SHADOW));
+  pShadow->DPMSstatus = -1;
+  pShadow->name = name;
+  pShadow->agentFd = -1;
+  if (!(pShadow->dpy = TakeDisplay(name, True)))
+    exit(3);
+  return AddNode(name, pShadow);
 
-    if (label == NULL)
-      label = toDpyName;
-    /* determine size of text */
-    if (((fid = XLoadFont(fromDpy, fontName)) != 0) ||
-        ((fid = XLoadFont(fromDpy, defaultFN)) != 0) ||
-        ((fid = XLoadFont(fromDpy, "fixed")) != 0)) {
-      /* have a font */
-      int ascent, descent, direction;
-      XCharStruct overall;
-
-      XQueryTextExtents(fromDpy, fid, label, strlen(label),
-                        &direction, &ascent, &descent, &overall);
-      twidth = -overall.lbearing + overall.rbearing;
-      theight = ascent + descent;
-      tascent = ascent;
-
-      textGC = pDpyInfo->textGC = XCreateGC(fromDpy, root, 0, NULL);
-      XSetState(fromDpy, textGC, black, white, GXcopy, AllPlanes);
-      XSetFont(fromDpy, textGC, fid);
-
-      pDpyInfo->fid = fid;
-      pDpyInfo->twidth = twidth;
-      pDpyInfo->theight = theight;
-      pDpyInfo->tascent = tascent;
-
-    } else { /* should not have to execute this clause: */
-      twidth = theight = 100; /* default window size */
-    } /* END if have a font ... else ... */
+} /* END FindNode */
 
-    /* determine size of window */
-    xoff = yoff = 0;
-    width = twidth + 4; /* XXX gap around text -- should be configurable */
-    height = theight + 4;
-    geomMask = XParseGeometry(geomStr, &xoff, &yoff, &width, &height);
-    switch (gravMask = (geomMask & (XNegative | YNegative))) {
-    case (XNegative | YNegative): gravity = SouthEastGravity; break;
-    case XNegative:               gravity = NorthEastGravity; break;
-    case YNegative:               gravity = SouthWestGravity; break;
-    default:                      gravity = NorthWestGravity; break;
-    }
-    pDpyInfo->width = width;
-    pDpyInfo->height = height;
-    if (gravMask) {
-      XGetGeometry(fromDpy, root,
-                   &rret, &xret, &yret, &wret, &hret, &bret, &dret);
-      if ((geomMask & (XValue | XNegative)) == (XValue | XNegative)){
-        xoff = wret - width + xoff;
-      }
-      if ((geomMask & (YValue | YNegative)) == (YValue | YNegative)) {
-        yoff = hret - height + yoff;
-      }
-    } /* END if geomMask */
+static void BuildLayout()
+{
+  PNODE pNode, pOther;
+  PLINK pLink;
 
-    trigger = pDpyInfo->trigger =
-      XCreateSimpleWindow(fromDpy, root, xoff, yoff, width, height,
-                          0, black, white);
-  } /* END if doEdge ... else ...*/
+  pNode = AddNode(toDpyName, shadows);
+  pNode->fromEdge = oppositeEdge[doEdge];
 
+  if (links && (doEdge == EDGE_NONE)) {
+    fprintf(stderr, "%s - error: -link needs -north, -south, -east or -west\n",
+            programStr);
+    exit(1);
+  }
 #ifdef WIN_2_X
-  if (fromDpy != fromWin) {
+  if (links && (fromDpyName == fromWinName)) {
+    fprintf(stderr, "%s - error: -link is not supported with -fromwin\n",
+            programStr);
+    exit(1);
+  }
 #endif
-  /* size hints stuff: */
-  xsh->x           = xoff;
-  xsh->y           = yoff;
-  xsh->base_width  = width;
-  xsh->base_height = height;
-  xsh->win_gravity = gravity;
-  xsh->flags       = (PPosition|PBaseSize|PWinGravity);
-  XSetWMNormalHints(fromDpy, trigger, xsh);
 
-  if (title) {
-    windowName = title;
-  } else {
-    windowName = (char *)xmalloc(strlen(programStr) + strlen(toDpyName) + 2);
-    sprintf(windowName, "%s %s", programStr, toDpyName);
-  }
+  for (pLink = links; pLink; pLink = pLink->pNext) {
+    pNode = FindNode(pLink->name);
+    pOther = FindNode(pLink->otherName);
+    if ((pNode == pOther) ||
+        NODE_HAS_EDGE(pNode, pLink->edge) ||
+        NODE_HAS_EDGE(pOther, oppositeEdge[pLink->edge])) {
+      fprintf(stderr, "%s - error: can not link %s to %s, edge is taken\n",
+              programStr, pOther->name, pNode->name);
+      exit(1);
+    }
+    pNode->links[pLink->edge] = pOther;
+    pOther->links[oppositeEdge[pLink->edge]] = pNode;
 
-  XStoreName(fromDpy, trigger, windowName);
-  XSetIconName(fromDpy, trigger, windowName);
+    debug("%s is linked to %s\n", pOther->name, pNode->name);
+  } /* END for */
 
-  /* register for WM_DELETE_WINDOW protocol */
-  pDpyInfo->wmpAtom = XInternAtom(fromDpy, "WM_PROTOCOLS", True);
-  pDpyInfo->wmdwAtom = XInternAtom(fromDpy, "WM_DELETE_WINDOW", True);
-  XSetWMProtocols(fromDpy, trigger, &(pDpyInfo->wmdwAtom), 1);
+} /* END BuildLayout */
 
-  /* making the trigger window transparent */
-  if (winTransparent) {
-    u_int32_t cardinal_alpha = (u_int32_t) (0);
-    XChangeProperty(fromDpy, trigger,
-      XInternAtom(fromDpy, "_NET_WM_WINDOW_OPACITY", 0),
-      XA_CARDINAL, 32, PropModeReplace, (u_int8_t*) &cardinal_alpha,1);
-  };
+/**********
+ * another -from: a display of its own, in the order given
+ **********/
+static void AddSource(name)
+char *name;
+{
+  PDPYINFO pSource, *ppSource;
 
-  /* mdh - Put in Chaiken's change to make this InputOnly */
-  if (doBig) {
-    big = pDpyInfo->big =
-      XCreateWindow(fromDpy, root, 0, 0, fromWidth, fromHeight, 0,
-                    0, InputOnly, 0, CWOverrideRedirect, &xswa);
-    /* size hints stuff: */
-    xsh->x           = 0;
-    xsh->y           = 0;
-    xsh->base_width  = fromWidth;
-    xsh->base_height = fromHeight;
-    xsh->min_width   = fromWidth;
-    xsh->min_height  = fromHeight;
-    xsh->flags       = (PMinSize|PPosition|PBaseSize);
+  pSource = (PDPYINFO)xmalloc(sizeof(DPYINFO));
+  pSource->name = XDisplayName(name);
+  for (ppSource = &(dpyInfo.pNext); *ppSource;
+       ppSource = &((*ppSource)->pNext));
+  *ppSource = pSource;
 
-    XSetWMNormalHints(fromDpy, big, xsh);
-    XStoreName(fromDpy, big, windowName);
-    XSetIconName(fromDpy, big, windowName);
-  } else {
-    pDpyInfo->big = None;
-  }
+} /* END AddSource */
 
-  XFree((char *) xsh);
+/**********
+ * use standard X functions to parse the command line
+ **********/
+static void ParseCommandLine(argc, argv)
+int  argc;
+char **argv;
+{
+  int     arg;
+  PSHADOW pShadow, *ppTile;
+  PLINK   pLink;
+  extern  char *lawyerese;
+  PSTICKY pNewSticky;
+  KeySym  keysym;
+  int     button;
+  int     eventno;
+  char    *keyname, *argptr;
 
-  if (!title)
-    free(windowName);
-#ifdef WIN_2_X
-  }
-#endif
+  debug("programStr = %s\n", programStr);
 
-  /* conversion stuff */
-  pDpyInfo->toScreen = (doEdge == EDGE_WEST || doEdge == EDGE_NORTH)
-                        ? (nScreens - 1) : 0;
+  /* Clear button map */
+  for (button = 0; button <= N_BUTTONS; button++)
+    buttonmap[button][0] = NoSymbol;
 
-  /* construct table lookup for screen coordinate conversion */
-  pDpyInfo->xTables = (short **)xmalloc(sizeof(short *) * nScreens);
-  pDpyInfo->yTables = (short **)xmalloc(sizeof(short *) * nScreens);
-  heights = (int *)xmalloc(sizeof(int *) * nScreens);
-  widths  = (int *)xmalloc(sizeof(int *) * nScreens);
+  for (arg = 1; arg < argc; ++arg) {
+#ifdef WIN_2_X
+    if (!strcasecmp(argv[arg], "-fromWin")) {
+      fromDpyName = fromWinName;
+      /* XXX mdh - For now only support edge windows getting big */
+      /* Note: -east will override correctly (even if earlier on the line) */
+      doBig = True;
+      if (doEdge == EDGE_NONE) doEdge = EDGE_WEST;
+      doCapsLkHack = True;
 
-  for (screenNum = 0; screenNum < nScreens; ++screenNum) {
-    widths[screenNum] = toWidth  =
-      XWidthOfScreen(XScreenOfDisplay(toDpy, screenNum));
-    heights[screenNum] = toHeight =
-      XHeightOfScreen(XScreenOfDisplay(toDpy, screenNum));
+      debug("fromDpyName = %s\n", fromDpyName);
+    } else
+      /* Note this else will qualify the if below... */
+#endif /* WIN_2_X */
+    if (!strcasecmp(argv[arg], "-from")) {
+      if (++arg >= argc) Usage();
+      if (fromDpyName) /* many-to-one */
+        AddSource(argv[arg]);
+      else
+        fromDpyName = argv[arg];
 
-    pDpyInfo->xTables[screenNum] = xTable =
-      (short *)xmalloc(sizeof(short) * fromWidth);
-    pDpyInfo->yTables[screenNum] = yTable =
-      (short *)xmalloc(sizeof(short) * fromHeight);
+      debug("fromDpyName = %s\n", fromDpyName);
+    } else if (!strcasecmp(argv[arg], "-to")) {
+      if (++arg >= argc) Usage();
+      toDpyName = argv[arg];
 
-    debug_cmpreg("fromWidth/Height: %d/%d, toWidth/Height: %d/%d\n",
-		    fromWidth, fromHeight, toWidth, toHeight);
-    if (noScale) {
-        /* TODO:
-            - the fake tables should be built as "starting ignored", 1:1 map
+      debug("toDpyName = %s\n", toDpyName);
+    } else if (!strcasecmp(argv[arg], "-font")) {
+      if (++arg >= argc) Usage();
+      fontName = argv[arg];
+
+      debug("fontName = %s\n", fontName);
+    } else if (!strcasecmp(argv[arg], "-label")) {
+      if (++arg >= argc) Usage();
+      label = argv[arg];
+
+      debug("label = %s\n", label);
+    } else if (!strcasecmp(argv[arg], "-title")) {
+      if (++arg > argc) Usage();
+      title = argv[arg];
+
+      debug("title = %s\n", title);
+    } else if (!strcasecmp(argv[arg], "-geometry")) {
+      if (++arg >= argc) Usage();
+      geomStr = argv[arg];
+
+      debug("geometry = %s\n", geomStr);
+    } else if (!strcasecmp(argv[arg], "-wait")) {
+      waitDpy = True;
+
+      debug("will wait for displays\n");
+    } else if (!strcasecmp(argv[arg], "-loglevel")) {
+      if (++arg >= argc) Usage();
+      if (!strcasecmp(argv[arg], "none"))
+        logLevel = LOG_NONE;
+      else if (!strcasecmp(argv[arg], "error"))
+        logLevel = LOG_ERROR;
+      else if (!strcasecmp(argv[arg], "warn"))
+        logLevel = LOG_WARN;
+      else if (!strcasecmp(argv[arg], "info"))
+        logLevel = LOG_INFO;
+      else if (!strcasecmp(argv[arg], "debug"))
+        logLevel = LOG_DEBUG;
+      else
+        Usage();
+    } else if (!strcasecmp(argv[arg], "-trace")) {
+      if (++arg >= argc) Usage();
+      traceFile = argv[arg];
+
+      debug("trace to %s\n", traceFile);
+    } else if (!strcasecmp(argv[arg], "-sync")) {
+      doSync = True;
+
+      debug("synchronous\n");
+    } else if (!strcasecmp(argv[arg], "-v")) {
+      doVerbose = True;
+
+      debug("verbose\n");
+    } else if (!strcasecmp(argv[arg], "-big")) {
+      doBig = True;
+
+      debug("will create big window on from display\n");
+    } else if (!strcasecmp(argv[arg], "-nomouse")) {
+      doMouse = False;
+
+      debug("will not capture mouse (eek!)\n");
+    } else if (!strcasecmp(argv[arg], "-nopointermap")) {
+      doPointerMap = False;
+
+      debug("will not do pointer mapping\n");
+    } else if (!strcasecmp(argv[arg], "-north")) {
+      doEdge = EDGE_NORTH;
+
+      debug("\"from\" is on the north side of \"to\"\n");
+    } else if (!strcasecmp(argv[arg], "-south")) {
+      doEdge = EDGE_SOUTH;
+
+      debug("\"from\" is on the south side of \"to\"\n");
+    } else if (!strcasecmp(argv[arg], "-east")) {
+      doEdge = EDGE_EAST;
+
+      debug("\"from\" is on the east side of \"to\"\n");
+    } else if (!strcasecmp(argv[arg], "-west")) {
+      doEdge = EDGE_WEST;
+
+      debug("\"from\" is on the west side of \"to\"\n");
+    } else if (!strcasecmp(argv[arg], "-selcache")) {
+      if (++arg >= argc) Usage();
+      selCacheMax = atol(argv[arg]) * 1024;
+    } else if (!strcasecmp(argv[arg], "-prefetch")) {
+      if (++arg >= argc) Usage();
+      prefetchMax = atol(argv[arg]) * 1024;
+    } else if (!strcasecmp(argv[arg], "-nosel")) {
+      doSel = False;
+
+      debug("will not transmit X selections between displays\n");
+    } else if (!strcasecmp(argv[arg], "-noautoup")) {
+      doAutoUp = False;
+
+      debug("will not automatically lift keys and buttons\n");
+    } else if (!strcasecmp(argv[arg], "-buttonblock")) {
+      doBtnBlock = True;
+
+      debug("mouse buttons down will block disconnects\n");
+    } else if (!strcasecmp(argv[arg], "-capslockhack")) {
+      doCapsLkHack = True;
+
+      debug("behavior of CapsLock will be hacked\n");
+    } else if (!strcasecmp(argv[arg], "-dpmsmouse")) {
+      doDpmsMouse = True;
+
+      debug("mouse movement wakes monitor\n");
+    } else if (!strcasecmp(argv[arg], "-dpmsinterval")) {
+      if (++arg >= argc) Usage();
+      if ((dpmsInterval = atoi(argv[arg])) < 0) Usage();
+
+      debug("DPMS checked every %d ms\n", dpmsInterval);
+    } else if (!strcasecmp(argv[arg], "-offset")) {
+      if (++arg >= argc) Usage();
+      logicalOffset = atoi(argv[arg]);
+
+      debug("logicalOffset %d\n", logicalOffset);
+    } else if (!strcasecmp(argv[arg], "-clipcheck")) {
+      doClipCheck = True;
+
+      debug("Clipboard type will be checked for XA_STRING\n");
+    } else if (!strcasecmp(argv[arg], "-nocapslockhack")) {
+      doCapsLkHack = False;
+
+      debug("behavior of CapsLock will not be hacked\n");
+    } else if (!strcasecmp(argv[arg], "-sticky")) {
+      if (++arg >= argc) Usage();
+      if ((keysym = XStringToKeysym(argv[arg])) != NoSymbol) {
+        pNewSticky = (PSTICKY)xmalloc(sizeof(STICKY));
+        pNewSticky->pNext  = stickies;
+        pNewSticky->keysym = keysym;
+        stickies = pNewSticky;
+
+        debug("will press/release sticky key: %s\n", argv[arg]);
+      } else {
+        printf("x2x: warning: can't translate %s\n", argv[arg]);
+      }
+    } else if (!strcasecmp(argv[arg], "-buttonmap")) {
+      if (++arg >= argc) Usage();
+      button = atoi(argv[arg]);
+
+      if ((button < 1) || (button > N_BUTTONS))
+        printf("x2x: warning: invalid button %d\n", button);
+      else if (++arg >= argc)
+        Usage();
+      else
+      {
+        debug("will map button %d to keysyms '%s'\n", button, argv[arg]);
+
+        argptr  = argv[arg];
+        eventno = 0;
+        while ((keyname = strtok(argptr, " \t\n\r")) != NULL)
+        {
+          if ((keysym = XStringToKeysym(keyname)) == NoSymbol)
+            printf("x2x: warning: can't translate %s\n", keyname);
+          else if (eventno + 1 >= MAX_BUTTONMAPEVENTS)
+            printf("x2x: warning: too many keys mapped to button %d\n",
+                   button);
+          else
+            buttonmap[button][eventno++] = keysym;
+          argptr = NULL;
+        }
+        buttonmap[button][eventno] = NoSymbol;
+      }
+    } else if (!strcasecmp(argv[arg], "-resurface")) {
+      doResurface = True;
+
+      debug("will resurface the trigger window when obscured\n");
+    } else if (!strcasecmp(argv[arg], "-win-output")) {
+      doInputOnly = False;
+      debug("trigger window will be an InputOutput window\n");
+    } else if (!strcasecmp(argv[arg], "-win-transparent")) {
+      winTransparent = True;
+      debug("trigger window will be transparent\n");
+    } else if (!strcasecmp(argv[arg], "-shadow")) {
+      if (++arg >= argc) Usage();
+      pShadow = (PSHADOW)xmalloc(sizeof(SHADOW));
+      pShadow->DPMSstatus = -1;
+      pShadow->name = argv[arg];
+
+      /* into the global list of shadows */
+      pShadow->pNext = shadows;
+      shadows = pShadow;
+
+    } else if (!strcasecmp(argv[arg], "-tile")) {
+      if ((arg + 2) >= argc) Usage();
+      pShadow = (PSHADOW)xmalloc(sizeof(SHADOW));
+      pShadow->DPMSstatus = -1;
+      pShadow->name = argv[++arg];
+      pShadow->tileGeom = argv[++arg];
+      pShadow->pNext = NULL;
+
+      /* into the list of tiles, in order */
+      for (ppTile = &tiles; *ppTile; ppTile = &((*ppTile)->pNextTile));
+      pShadow->pNextTile = NULL;
+      *ppTile = pShadow;
+
+      debug("tile %s at %s\n", pShadow->name, pShadow->tileGeom);
+    } else if (!strcasecmp(argv[arg], "-agent")) {
+      if (++arg >= argc) Usage();
+      agentAddress = argv[arg];
+
+      debug("agent = %s\n", agentAddress);
+    } else if (!strcasecmp(argv[arg], "-link")) {
+      if ((arg + 3) >= argc) Usage();
+      pLink = (PLINK)xmalloc(sizeof(LINK));
+      pLink->name = argv[++arg];
+      if ((pLink->edge = ParseEdge(argv[++arg])) == EDGE_NONE) Usage();
+      pLink->otherName = argv[++arg];
+
+      /* into the global list of links */
+      pLink->pNext = links;
+      links = pLink;
+
+      debug("%s is on the %s side of %s\n",
+            pLink->otherName, argv[arg - 1], pLink->name);
+    } else if (!strcasecmp(argv[arg], "-triggerw")) {
+      if (++arg >= argc) Usage();
+      triggerw = atoi(argv[arg]);
+    } else if (!strcasecmp(argv[arg], "-copyright")) {
+      puts(lawyerese);
+    } else if (!strcasecmp(argv[arg], "-noscale")) {
+      noScale = True;
+    } else if (!strcasecmp(argv[arg], "-completeregionleft")) {
+      if (++arg >= argc) Usage();
+      compRegLeft = atoi(argv[arg]);
+    } else if (!strcasecmp(argv[arg], "-completeregionright")) {
+      if (++arg >= argc) Usage();
+      compRegRight = atoi(argv[arg]);
+    } else if (!strcasecmp(argv[arg], "-completeregionup")) {
+      if (++arg >= argc) Usage();
+      compRegUp = atoi(argv[arg]);
+    } else if (!strcasecmp(argv[arg], "-completeregionlow")) {
+      if (++arg >= argc) Usage();
+      compRegLow = atoi(argv[arg]);
+
+    } else if (!strcasecmp(argv[arg], "-struts")) {
+      useStruts = True;
+
+      debug("will advertise struts in _NET_WM_STRUT\n");
+    } else if (!strcasecmp(argv[arg], "-nobarrier")) {
+      doBarrier = False;
+
+      debug("will use a trigger window instead of a pointer barrier\n");
+    } else {
+      Usage();
+    } /* END if... */
+  } /* END for */
+
+} /* END ParseCommandLine */
+
+static void Usage()
+{
+#ifdef WIN_2_X
+  printf("Usage: x2x [-fromwin | -from <DISPLAY>][-to <DISPLAY>] options..\n");
+#else
+  printf("Usage: x2x [-to <DISPLAY> | -from <DISPLAY>] options...\n");
+#endif
+  printf("       -copyright\n");
+  printf("       -font <FONTNAME>\n");
+  printf("       -geometry <GEOMETRY>\n");
+  printf("       -wait\n");
+  printf("       -v\n");
+  printf("       -trace <FILE>\n");
+  printf("       -sync\n");
+  printf("       -loglevel none|error|warn|info|debug\n");
+  printf("       -big\n");
+  printf("       -buttonblock\n");
+  printf("       -nomouse\n");
+  printf("       -nopointermap\n");
+  printf("       -north\n");
+  printf("       -south\n");
+  printf("       -east\n");
+  printf("       -west\n");
+  printf("       -nosel\n");
+  printf("       -selcache <KBYTES>\n");
+  printf("       -prefetch <KBYTES>\n");
+  printf("       -noautoup\n");
+  printf("       -resurface\n");
+  printf("       -win-output\n");
+  printf("       -win-transparent\n");
+  printf("       -capslockhack\n");
+  printf("       -nocapslockhack\n");
+  printf("       -clipcheck\n");
+  printf("       -dpmsmouse\n");
+  printf("       -dpmsinterval <MS>\n");
+  printf("       -from <DISPLAY> (again, for each other \"from\" display)\n");
+  printf("       -shadow <DISPLAY>\n");
+  printf("       -link <DISPLAY> <north|south|east|west> <DISPLAY>\n");
+  printf("       -tile <DISPLAY> <[WxH]+X+Y>\n");
+  printf("       -agent <[HOST:]PORT | SOCKET PATH>\n");
+  printf("       -sticky <STICKY KEY>\n");
+  printf("       -label <LABEL>\n");
+  printf("       -title <TITLE>\n");
+  printf("       -buttonmap <BUTTON#> \"<KEYSYM> ...\"\n");
+  printf("       -completeregionleft <COORDINATE>\n");
+  printf("       -completeregionright <COORDINATE>\n");
+  printf("       -completeregionup <COORDINATE>\n");
+  printf("       -completeregionlow <COORDINATE>\n");
+  printf("       -struts\n");
+  printf("       -nobarrier\n");
+#ifdef WIN_2_X
+  printf("       -offset [-]<pixel offset of \"to\">\n");
+  printf("WIN_2_X build allows Windows or X as -from display\n");
+  printf("Note that -fromwin sets default to -big -west -capslockhack\n");
+  printf("A Windows shortcut of the form:\n");
+  printf("C:\\cygwin\\usr\\X11R6\\bin\\run.exe /usr/X11R6/bin/x2x -fromwin -to <to> -east\n");
+  printf("Should work to start the app from the desktop or start menu, but\n");
+  printf("c:\\cygwin\\bin may need to be added to the PATH to get cygwin1.dll\n");
+#endif
+  exit(4);
+
+} /* END Usage */
+
+/**********
+ * call the library to check for the test extension
+ **********/
+static Bool CheckTestExtension(dpy)
+Display  *dpy;
+{
+  int eventb, errorb;
+  int vmajor, vminor;
+
+  return (XTestQueryExtension(dpy, &eventb, &errorb, &vmajor, &vminor));
+
+} /* END CheckTestExtension */
+
+#ifndef WIN_2_X
+int ErrorHandler(Display *disp, XErrorEvent *event) {
+
+  char text[LOG_STR_SIZE];
+  int  counter;
+
+  for (counter = 0; counter < N_QUIET; ++counter)
+    if ((quietDpys[counter] == disp) &&
+        (quietSerials[counter] == event->serial))
+      return True;
+  XGetErrorText(disp, event->error_code, text, sizeof(text));
+  LOG(LOG_WARN, "X error on %s: %s (request %d.%d, resource 0x%lx)\n",
+      DisplayString(disp), text, event->request_code, event->minor_code,
+      event->resourceid);
+  return True;
+}
+#endif
+
+#define X2X_DISCONNECTED    0
+#define X2X_AWAIT_RELEASE   1
+#define X2X_CONNECTED       2
+#define X2X_CONN_RELEASE    3
+
+static void signal_handler(int sig)
+{
+  PDPYINFO pSource;
+
+  if (activeSource->mode == X2X_CONNECTED)
+    DoDisconnect(activeSource);
+  for (pSource = &dpyInfo; pSource; pSource = pSource->pNext)
+    pSource->signal = sig;
+}
+
+static void DoX2X(fromDpy, toDpy)
+Display *fromDpy;
+Display *toDpy;
+{
+  int       nfds;
+  fd_set    fdset, writeset;
+  Bool      fromPending, nodePending;
+  Bool      done = False;
+  int       fromConn, toConn;
+  PNODE     pNode;
+  PDPYINFO  pSource;
+  double    start, untilRetry;
+  struct timeval timeout;
+
+  /* set up displays */
+  start = Millis();
+  dpyInfo.fromDpy = fromDpy;
+  for (pSource = &dpyInfo; pSource; pSource = pSource->pNext) {
+    pSource->toDpy = toDpy;
+    InitDpyInfo(pSource);
+    RegisterEventHandlers(pSource);
+  }
+  if (doVerbose) {
+    fprintf(stderr, "%s: set up windows in %.1f ms\n",
+            programStr, Millis() - start);
+    fprintf(stderr, "%s: started in %.1f ms\n",
+            programStr, Millis() - startTime);
+  }
+
+  signal(SIGINT,  signal_handler);
+  signal(SIGTERM, signal_handler);
+
+  /* set up for select */
+#ifdef WIN_2_X
+  fromConn = (fromDpy == fromWin) ? 0 : XConnectionNumber(fromDpy);
+#else
+  fromConn = XConnectionNumber(fromDpy);
+#endif /* WIN_2_X */
+
+  toConn   = XConnectionNumber(toDpy);
+  nfds = (fromConn > toConn ? fromConn : toConn) + 1;
+  for (pNode = nodes->pNext; pNode; pNode = pNode->pNext)
+    if (XConnectionNumber(pNode->dpy) >= nfds)
+      nfds = XConnectionNumber(pNode->dpy) + 1;
+  for (pSource = dpyInfo.pNext; pSource; pSource = pSource->pNext)
+    if (XConnectionNumber(pSource->fromDpy) >= nfds)
+      nfds = XConnectionNumber(pSource->fromDpy) + 1;
+
+#ifdef WIN_2_X
+  if (fromDpy == fromWin) {
+    MSG                msg;                /* A Win32 message structure. */
+    int         nowQuit;
+
+    nowQuit = 0;
+
+    /* XXX mdh - This is not quite right becaue it only does To events */
+    /* XXX mdh - when there are From events                            */
+    /* This is mostly ok, but can cause windows->X paste to take a while */
+    /* As a compromise, try a 1 second tick to cause polling */
+
+    SetTimer(dpyInfo.bigwindow, 1, 1000 /* in ms */, NULL);
+    /* GetMessage blocks until the next Windows event */
+    /* It returns 0 if the app should quit */
+    while (!nowQuit && GetMessage (&msg, NULL, 0, 0)) {
+      /* XXX mdh - Translate may not be needed if all Key processing is */
+      /* XXX mdh - done using the Key events rather than CHAR events    */
+      TranslateMessage (&msg);
+      DispatchMessage (&msg);
+      /* Done a Windows event, now loop while -to has something */
+      while (XPending(toDpy) || dpyInfo.expectSelNotify) {
+        if (ProcessEvent(toDpy, &dpyInfo)) { /* done! */
+          nowQuit = 1;
+          break;
+        }
+        /* PeekMessage is a non-blocking version of GetMessage */
+        /* But it returns 0 for no messages rather than for quit */
+        if (PeekMessage (&msg, NULL, 0, 0, PM_REMOVE)) {
+          /* need explicit check for quit */
+          if (msg.message == WM_QUIT) {
+            nowQuit = 1;
+            break; /* from the while(XPending... )*/
+          }
+          /* XXX mdh - see above */
+          TranslateMessage (&msg);
+          DispatchMessage (&msg);
+        }
+      }
+    }
+  } else
+    /* Again, the else qualifies the while below */
+#endif /* WIN_2_X */
+  while (dpyInfo.signal == 0) { /* FOREVER */
+    if (logDumpPending) {
+      logDumpPending = 0;
+      LogDump(2, False);
+    }
+    /* only the active source can be connected, and grabbing */
+    if (activeSource->grabRetryAt &&
+        (Millis() >= activeSource->grabRetryAt))
+      RetryGrabs(activeSource);
+    if ((fromPending = XPending(fromDpy)))
+      if (ProcessEvent(fromDpy, &dpyInfo)) /* done! */
+        break;
+
+    /* many-to-one: the other "from" displays, one event each */
+    for (pSource = dpyInfo.pNext; pSource && !done; pSource = pSource->pNext)
+      if (XPending(pSource->fromDpy)) {
+        fromPending = True;
+        done = ProcessEvent(pSource->fromDpy, pSource);
+      }
+    if (done)
+      break;
+
+    /* other displays of the layout only report mapping and
+       screen changes */
+    nodePending = False;
+    for (pNode = nodes->pNext; pNode; pNode = pNode->pNext)
+      if (XPending(pNode->dpy)) {
+        nodePending = True;
+        ProcessEvent(pNode->dpy, &dpyInfo);
+      }
+
+    /* input is handled first: what it left to write goes now, and
+       selection properties read meanwhile are relayed */
+    PumpReads();
+    FlushOutput();
+
+    /* XPending may have taken in replies to reads, with no event
+       behind them to wake select */
+    if (XPending(toDpy)) {
+      if (ProcessEvent(toDpy, &dpyInfo)) /* done! */
+        break;
+    } else if (!fromPending && !nodePending && !PumpReads()) {
+      FlushDisplays();
+      FD_ZERO(&fdset);
+      FD_SET(fromConn, &fdset);
+      FD_SET(toConn, &fdset);
+      for (pNode = nodes->pNext; pNode; pNode = pNode->pNext)
+        FD_SET(XConnectionNumber(pNode->dpy), &fdset);
+      for (pSource = dpyInfo.pNext; pSource; pSource = pSource->pNext)
+        FD_SET(XConnectionNumber(pSource->fromDpy), &fdset);
+      /* the next piece of selection data once there is room for it */
+      FD_ZERO(&writeset);
+      if (dpyInfo.fromDpyXtra.pBulk)
+        FD_SET(fromConn, &writeset);
+      if (dpyInfo.toDpyXtra.pBulk)
+        FD_SET(toConn, &writeset);
+      if (activeSource->grabRetryAt) { /* until the next try */
+        untilRetry = MAX(activeSource->grabRetryAt - Millis(), 0);
+        timeout.tv_sec = untilRetry / 1000;
+        timeout.tv_usec = ((long)untilRetry % 1000) * 1000;
+      }
+      select(nfds, &fdset, &writeset, NULL,
+             activeSource->grabRetryAt ? &timeout : NULL);
+    }
+
+  } /* END FOREVER */
+
+} /* END DoX2X() */
+
+static void InitDpyInfo(pDpyInfo)
+PDPYINFO pDpyInfo;
+{
+  Display   *fromDpy, *toDpy;
+  Screen    *fromScreen;
+  long      black, white;
+  int       fromHeight, fromWidth;
+  Pixmap    nullPixmap;
+  XColor    dummyColor;
+  Window    root, trigger, big, rret, toRoot, propWin;
+  int       xoff, yoff; /* window offsets */
+  unsigned int width, height; /* window width, height */
+  int       geomMask;                /* mask returned by parse */
+  int       gravMask;
+  int       gravity;
+  int       xret, yret;
+  unsigned int wret, hret, bret, dret;
+  XSetWindowAttributes xswa;
+  XSizeHints *xsh;
+  int       eventMask;
+  char      *windowName;
+  PSHADOW   pShadow;
+  PNODE     pNode;
+  int       triggerLoc;
+  Bool      vertical;
+  int       sel;
+  Atom      fromAtoms[N_STARTUP_ATOMS], toAtoms[N_TO_ATOMS];
+
+  /* cache commonly used variables */
+  fromDpy = pDpyInfo->fromDpy;
+  toDpy   = pDpyInfo->toDpy;
+  pDpyInfo->toDpyXtra.propWin = (Window) 0;
+
+  /* one round trip each */
+#ifdef WIN_2_X
+  if (fromDpy != fromWin)
+#endif
+    XInternAtoms(fromDpy, startupAtomNames, N_STARTUP_ATOMS, False,
+                 fromAtoms);
+  XInternAtoms(toDpy, startupAtomNames, N_TO_ATOMS, False, toAtoms);
+
+  gravity = NorthWestGravity;   /* Default gravity of window. */
+  pDpyInfo->fid = 0; /* Default is no text. */
+  pDpyInfo->fontPending = False;
+
+#ifdef WIN_2_X
+  if (fromDpy == fromWin) {
+
+    fromWidth=GetSystemMetrics(SM_CXSCREEN);
+    fromHeight=GetSystemMetrics(SM_CYSCREEN);
+
+    POINT pt;
+
+    pDpyInfo->screenRect.left = GetSystemMetrics(SM_XVIRTUALSCREEN);
+    pDpyInfo->screenRect.top = GetSystemMetrics(SM_YVIRTUALSCREEN);
+    pDpyInfo->screenRect.right = GetSystemMetrics(SM_CXVIRTUALSCREEN);
+    pDpyInfo->screenRect.bottom = GetSystemMetrics(SM_CYVIRTUALSCREEN);
+    pDpyInfo->screenHeight = pDpyInfo->screenRect.bottom - pDpyInfo->screenRect.top;
+    pDpyInfo->screenWidth = pDpyInfo->screenRect.right - pDpyInfo->screenRect.left;
+
+
+    // Guess a a point at or near the monitor we want.
+    if (doEdge == EDGE_NORTH || doEdge == EDGE_SOUTH)
+    {
+      pt.x = (pDpyInfo->screenRect.right - pDpyInfo->screenRect.left) / 2;
+      pt.y = (doEdge == EDGE_SOUTH) ? pDpyInfo->screenRect.bottom - 1 : pDpyInfo->screenRect.top;;
+    }
+    else
+    {
+      pt.x = (doEdge == EDGE_EAST) ? pDpyInfo->screenRect.right - 1 : pDpyInfo->screenRect.left;
+      pt.y = (pDpyInfo->screenRect.bottom -  pDpyInfo->screenRect.top) / 2;
+    }
+
+    HMONITOR mon = MonitorFromPoint(pt, MONITOR_DEFAULTTONEAREST);
+
+    MONITORINFO monInfo;
+    monInfo.cbSize = sizeof(MONITORINFO);
+    GetMonitorInfo(mon, &monInfo);
+
+    pDpyInfo->monitorRect = monInfo.rcMonitor;
+
+    /* these should not be used, but keep compiler happy */
+    fromScreen = (Screen *) 0;
+    black = white = 0;
+    root = pDpyInfo->root = None;
+  } else {
+    fromScreen = XDefaultScreenOfDisplay(fromDpy);
+    black      = XBlackPixelOfScreen(fromScreen);
+    white      = XWhitePixelOfScreen(fromScreen);
+    fromHeight = XHeightOfScreen(fromScreen);
+    fromWidth  = XWidthOfScreen(fromScreen);
+    root       = pDpyInfo->root      = XDefaultRootWindow(fromDpy);
+  }
+  toRoot     = XDefaultRootWindow(toDpy);
+  vertical   = pDpyInfo->vertical = (doEdge == EDGE_NORTH
+                                      || doEdge == EDGE_SOUTH);
+#else
+  gravity = NorthWestGravity;   /* keep compliler happy */
+  fromScreen = XDefaultScreenOfDisplay(fromDpy);
+  black      = XBlackPixelOfScreen(fromScreen);
+  white      = XWhitePixelOfScreen(fromScreen);
+  fromHeight = XHeightOfScreen(fromScreen);
+  fromWidth  = XWidthOfScreen(fromScreen);
+  toRoot     = XDefaultRootWindow(toDpy);
+
+  /* values also in dpyinfo */
+  root       = pDpyInfo->root      = XDefaultRootWindow(fromDpy);
+  vertical   = pDpyInfo->vertical = (doEdge == EDGE_NORTH
+                                      || doEdge == EDGE_SOUTH);
+#endif
+
+  triggerLoc = SetFromGeometry(pDpyInfo, fromWidth, fromHeight);
+
+#ifdef WIN_2_X
+  if (fromDpy != fromWin) {
+#endif
+    pDpyInfo->fromDpyUtf8String = fromAtoms[ATOM_UTF8_STRING];
+#ifdef WIN_2_X
+  }
+#endif
+  pDpyInfo->toDpyUtf8String = toAtoms[ATOM_UTF8_STRING];
+
+  /* other dpyinfo values */
+  pDpyInfo->mode        = X2X_DISCONNECTED;
+  pDpyInfo->pFakeThings = NULL;
+
+  /* window init structures */
+  xswa.override_redirect = True;
+  xsh = XAllocSizeHints();
+  eventMask = KeyPressMask | KeyReleaseMask;
+
+  if (doEdge) { /* edge triggers x2x */
+#ifdef WIN_2_X
+    if (fromDpy == fromWin) {
+      /* keep compiler happy */
+      nullPixmap = 0;
+      pDpyInfo->grabCursor = 0;
+    } else {
+#endif
+    nullPixmap = XCreatePixmap(fromDpy, root, 1, 1, 1);
+    eventMask |= EnterWindowMask;
+    pDpyInfo->grabCursor =
+      XCreatePixmapCursor(fromDpy, nullPixmap, nullPixmap,
+                          &dummyColor, &dummyColor, 0, 0);
+#ifdef WIN_2_X
+    }
+#endif
+
+    xswa.background_pixel = black;
+
+#ifdef WIN_2_X
+    if (fromDpy == fromWin) {
+
+      /* Create both trigger and big windows here */
+      /* This code is based on Win2VBC/vncviewer ClientConnection.cpp */
+      WNDCLASS wndclass;
+      const DWORD winstyle = 0;
+
+      wndclass.style		= 0;
+      wndclass.lpfnWndProc	= WinProcessMessage;
+      wndclass.cbClsExtra	= 0;
+      wndclass.cbWndExtra	= 0;
+      wndclass.hInstance	= m_instance;
+      /* XXX mdh - For now just use system provided resources */
+      wndclass.hIcon		= LoadIcon(NULL, IDI_APPLICATION);
+      // wndclass.hCursor	= LoadCursor(NULL, IDC_NO);
+      wndclass.hCursor		= LoadCursor(m_instance, MAKEINTRESOURCE(IDC_NOCURSOR));
+      wndclass.hbrBackground	= (HBRUSH) GetStockObject(BLACK_BRUSH);
+      wndclass.lpszMenuName	= (const TCHAR *) NULL;
+      wndclass.lpszClassName	= fromWinName;
+
+      RegisterClass(&wndclass);
+
+
+     pDpyInfo->bigwindow = CreateWindowEx(
+         WS_EX_TRANSPARENT | WS_EX_TOPMOST | WS_EX_TOOLWINDOW,
+         fromWinName,
+         "x2x_big",
+         winstyle,
+         0,
+         0,
+         fromWidth,
+         fromHeight,
+         NULL,                // Parent handle
+         NULL,                // Menu handle
+         m_instance,
+         NULL);
+
+      pDpyInfo->edgewindow = CreateWindowEx(
+         WS_EX_TRANSPARENT | WS_EX_TOPMOST | WS_EX_TOOLWINDOW,
+         fromWinName,
+         "x2x_edge",
+         winstyle,
+         /* Next 4 are x, y, width, height */
+         (doEdge == EDGE_EAST) ? pDpyInfo->monitorRect.right -1: pDpyInfo->monitorRect.left,
+         (doEdge == EDGE_SOUTH) ? pDpyInfo->monitorRect.bottom - 1 : pDpyInfo->monitorRect.top,
+         (pDpyInfo->vertical) ? pDpyInfo->monitorRect.right - pDpyInfo->monitorRect.left : 1,
+         (pDpyInfo->vertical) ? 1 : pDpyInfo->monitorRect.bottom - pDpyInfo->monitorRect.top,
+         pDpyInfo->bigwindow, // Parent handle
+         NULL,                // Menu handle
+         m_instance,
+         NULL);
+
+
+      ShowWindow(pDpyInfo->bigwindow, SW_HIDE);
+      ShowWindow(pDpyInfo->edgewindow, SW_HIDE);
+      pDpyInfo->wdelta = 0;
+
+      // record which client created this window
+      SetWindowLong(pDpyInfo->bigwindow, GWL_USERDATA, (LONG) pDpyInfo);
+      SetWindowLong(pDpyInfo->edgewindow, GWL_USERDATA, (LONG) pDpyInfo);
+
+      // Set up clipboard watching
+      // We want to know when the clipboard changes, so
+      // insert ourselves in the viewer chain. But doing
+      // this will cause us to be notified immediately of
+      // the current state.
+      // We don't want to send that.
+      pDpyInfo->expectOwnClip = 0;
+      if (doSel) {
+        // pDpyInfo->initialClipboardSeen = False;
+        pDpyInfo->winSelText = NULL;
+        pDpyInfo->hwndNextViewer = SetClipboardViewer(pDpyInfo->edgewindow);
+      }
+
+      pDpyInfo->onedge = 0;
+      MoveWindowToEdge(pDpyInfo);
+      /* Keep compile happy */
+      trigger = 0;
+    } else {
+#endif
+    /* fromWidth - 1 doesn't seem to work for some reason */
+    /* Use triggerw offsets so that if an x2x is running
+       along the left edge and along the north edge, both with
+       -resurface, we don't get a feedback loop of them each
+       fighting to be on top.
+        --09/27/99 Greg J. Badros <gjb@cs.washington.edu> */
+    /* also, make it an InputOnly window so I don't lose
+       screen real estate --09/29/99 gjb */
+    /* make it InputOutput when argument -win-output presents,
+       so to get window visibility change event and make -resurface work */
+    /* make it InputOutput so to make -resurface work*/ 
+#ifdef HAVE_BARRIERS
+    if (doBarrier && CreateEdgeBarrier(pDpyInfo))
+      /* the barrier triggers x2x, the window only has to be viewable
+         for the grabs: park it off screen where nothing can cover it */
+      trigger = pDpyInfo->trigger =
+        XCreateWindow(fromDpy, root, -1, -1, 1, 1,
+                      0, 0, InputOutput, 0,
+                      CWOverrideRedirect, &xswa);
+    else
+#endif
+    trigger = pDpyInfo->trigger =
+      XCreateWindow(fromDpy, root,
+                    vertical ? triggerw : triggerLoc,
+                    vertical ? triggerLoc : triggerw,
+                    vertical ? fromWidth - (2*triggerw) : triggerw,
+                    vertical ? triggerw : fromHeight - (2*triggerw),
+                    0, 0, InputOutput, 0,
+                    CWOverrideRedirect, &xswa);
+
+    pDpyInfo->netWmWindowTypeAtom = fromAtoms[ATOM_NET_WM_WINDOW_TYPE];
+    pDpyInfo->netWmWindowTypeDockAtom =
+      fromAtoms[ATOM_NET_WM_WINDOW_TYPE_DOCK];
+    XChangeProperty(fromDpy, trigger, pDpyInfo->netWmWindowTypeAtom,
+                    XA_ATOM, 32, PropModeReplace,
+                    (unsigned char *)&pDpyInfo->netWmWindowTypeDockAtom, 1);
+
+    if (useStruts) {
+      unsigned long struts[4] = { doEdge == EDGE_WEST ? triggerw : 0
+                                , doEdge == EDGE_EAST ? triggerw : 0
+                                , doEdge == EDGE_NORTH ? triggerw : 0
+                                , doEdge == EDGE_SOUTH ? triggerw : 0
+                                };
+      pDpyInfo->netWmStrutAtom = fromAtoms[ATOM_NET_WM_STRUT];
+      XChangeProperty(fromDpy, trigger, pDpyInfo->netWmStrutAtom,
+                      XA_CARDINAL, 32, PropModeReplace,
+                      (unsigned char *)&struts, 4);
+    }
+
+#ifdef WIN_2_X
+    }
+#endif
+  } else { /* normal window for text: do size grovelling */
+    pDpyInfo->grabCursor = XCreateFontCursor(fromDpy, XC_exchange);
+    eventMask |= StructureNotifyMask | ExposureMask;
+    if (doMouse) eventMask |= ButtonPressMask | ButtonReleaseMask;
+
+    if (label == NULL)
+      label = toDpyName;
+    xoff = yoff = 0;
+    width = height = 0;
+    geomMask = XParseGeometry(geomStr, &xoff, &yoff, &width, &height);
+    if ((geomMask & (WidthValue | HeightValue)) == (WidthValue | HeightValue)) {
+      /* the text does not size the window: load the font when it is
+         first drawn */
+      pDpyInfo->fontPending = True;
+    } else { /* determine size of text */
+      if (!LoadLabelFont(pDpyInfo)) { /* should not have to execute this: */
+        pDpyInfo->twidth = pDpyInfo->theight = 100; /* default window size */
+      }
+      /* XXX gap around text -- should be configurable */
+      if (!(geomMask & WidthValue))
+        width = pDpyInfo->twidth + 4;
+      if (!(geomMask & HeightValue))
+        height = pDpyInfo->theight + 4;
+    } /* END if geometry ... else ... */
+
+    /* determine size of window */
+    switch (gravMask = (geomMask & (XNegative | YNegative))) {
+    case (XNegative | YNegative): gravity = SouthEastGravity; break;
+    case XNegative:               gravity = NorthEastGravity; break;
+    case YNegative:               gravity = SouthWestGravity; break;
+    default:                      gravity = NorthWestGravity; break;
+    }
+    pDpyInfo->width = width;
+    pDpyInfo->height = height;
+    if (gravMask) {
+      XGetGeometry(fromDpy, root,
+                   &rret, &xret, &yret, &wret, &hret, &bret, &dret);
+      if ((geomMask & (XValue | XNegative)) == (XValue | XNegative)){
+        xoff = wret - width + xoff;
+      }
+      if ((geomMask & (YValue | YNegative)) == (YValue | YNegative)) {
+        yoff = hret - height + yoff;
+      }
+    } /* END if geomMask */
+
+    trigger = pDpyInfo->trigger =
+      XCreateSimpleWindow(fromDpy, root, xoff, yoff, width, height,
+                          0, black, white);
+  } /* END if doEdge ... else ...*/
+
+#ifdef WIN_2_X
+  if (fromDpy != fromWin) {
+#endif
+  /* size hints stuff: */
+  xsh->x           = xoff;
+  xsh->y           = yoff;
+  xsh->base_width  = width;
+  xsh->base_height = height;
+  xsh->win_gravity = gravity;
+  xsh->flags       = (PPosition|PBaseSize|PWinGravity);
+  XSetWMNormalHints(fromDpy, trigger, xsh);
+
+  if (title) {
+    windowName = title;
+  } else {
+    windowName = (char *)xmalloc(strlen(programStr) + strlen(toDpyName) + 2);
+    sprintf(windowName, "%s %s", programStr, toDpyName);
+  }
+
+  XStoreName(fromDpy, trigger, windowName);
+  XSetIconName(fromDpy, trigger, windowName);
+
+  /* register for WM_DELETE_WINDOW protocol */
+  pDpyInfo->wmpAtom = fromAtoms[ATOM_WM_PROTOCOLS];
+  pDpyInfo->wmdwAtom = fromAtoms[ATOM_WM_DELETE_WINDOW];
+  XSetWMProtocols(fromDpy, trigger, &(pDpyInfo->wmdwAtom), 1);
+
+  /* making the trigger window transparent */
+  if (winTransparent) {
+    u_int32_t cardinal_alpha = (u_int32_t) (0);
+    XChangeProperty(fromDpy, trigger,
+      fromAtoms[ATOM_NET_WM_WINDOW_OPACITY],
+      XA_CARDINAL, 32, PropModeReplace, (u_int8_t*) &cardinal_alpha,1);
+  };
+
+  /* mdh - Put in Chaiken's change to make this InputOnly */
+  if (doBig) {
+    big = pDpyInfo->big =
+      XCreateWindow(fromDpy, root, 0, 0, fromWidth, fromHeight, 0,
+                    0, InputOnly, 0, CWOverrideRedirect, &xswa);
+    /* size hints stuff: */
+    xsh->x           = 0;
+    xsh->y           = 0;
+    xsh->base_width  = fromWidth;
+    xsh->base_height = fromHeight;
+    xsh->min_width   = fromWidth;
+    xsh->min_height  = fromHeight;
+    xsh->flags       = (PMinSize|PPosition|PBaseSize);
+
+    XSetWMNormalHints(fromDpy, big, xsh);
+    XStoreName(fromDpy, big, windowName);
+    XSetIconName(fromDpy, big, windowName);
+  } else {
+    pDpyInfo->big = None;
+  }
+
+  XFree((char *) xsh);
+
+  if (!title)
+    free(windowName);
+#ifdef WIN_2_X
+  }
+#endif
+
+  /* conversion stuff: one set of tables per node of the layout graph,
+     mapping from the active source */
+  if (pDpyInfo == activeSource)
+    for (pNode = nodes; pNode; pNode = pNode->pNext)
+      BuildTables(pDpyInfo, pNode);
+  pNode = nodes; /* toDpy */
+  pNode->toScreen = (doEdge == EDGE_WEST || doEdge == EDGE_NORTH)
+                     ? (pNode->nScreens - 1) : 0;
+
+  /* always create propWin for events from toDpy */
+  propWin = XCreateWindow(toDpy, toRoot, 0, 0, 1, 1, 0, 0, InputOutput,
+                          CopyFromParent, 0, NULL);
+  pDpyInfo->toDpyXtra.propWin = propWin;
+  debug("Create window %x on todpy\n", (unsigned int)propWin);
+  /* initialize pointer mapping */
+  for (pNode = nodes; pNode; pNode = pNode->pNext)
+    RefreshPointerMapping(pNode->dpy, pDpyInfo);
+  ActivateNode(pDpyInfo, nodes);
+
+  if (FORWARDS_SEL(pDpyInfo)) {
+    pDpyInfo->pXfers = NULL;
+
+    pDpyInfo->fromDpyXtra.otherDpy   = toDpy;
+    for (sel = 0; sel < N_SELECTIONS; ++sel) {
+      pDpyInfo->fromDpyXtra.sState[sel] = SELSTATE_OFF;
+      pDpyInfo->toDpyXtra.sState[sel]   = SELSTATE_OFF;
+    }
+    pDpyInfo->fromDpyXtra.pfSel = pDpyInfo->toDpyXtra.pfSel = -1;
+    pDpyInfo->fromDpyXtra.pfDrain = pDpyInfo->toDpyXtra.pfDrain = False;
+    pDpyInfo->fromDpyXtra.xferAtoms = pDpyInfo->toDpyXtra.xferAtoms = NULL;
+    pDpyInfo->fromDpyXtra.nXferAtoms = pDpyInfo->toDpyXtra.nXferAtoms = 0;
+#ifdef WIN_2_X
+  if (fromDpy != fromWin) {
+#endif
+    pDpyInfo->fromDpyXtra.pingAtom   = fromAtoms[ATOM_PING];
+    pDpyInfo->fromDpyXtra.incrAtom   = fromAtoms[ATOM_INCR];
+    pDpyInfo->fromDpyXtra.multipleAtom = fromAtoms[ATOM_MULTIPLE];
+    pDpyInfo->fromDpyXtra.selAtom[SEL_PRIMARY] = XA_PRIMARY;
+    pDpyInfo->fromDpyXtra.selAtom[SEL_CLIPBOARD] = fromAtoms[ATOM_CLIPBOARD];
+#ifdef WIN_2_X
+  }
+#endif
+    pDpyInfo->fromDpyXtra.pingInProg = False;
+    pDpyInfo->fromDpyXtra.propWin    = trigger;
+    eventMask |= PropertyChangeMask;
+
+    pDpyInfo->toDpyXtra.otherDpy     = fromDpy;
+    pDpyInfo->toDpyXtra.pingAtom     = toAtoms[ATOM_PING];
+    pDpyInfo->toDpyXtra.incrAtom     = toAtoms[ATOM_INCR];
+    pDpyInfo->toDpyXtra.multipleAtom = toAtoms[ATOM_MULTIPLE];
+    pDpyInfo->toDpyXtra.selAtom[SEL_PRIMARY] = XA_PRIMARY;
+    pDpyInfo->toDpyXtra.selAtom[SEL_CLIPBOARD] = toAtoms[ATOM_CLIPBOARD];
+    pDpyInfo->toDpyXtra.pingInProg   = False;
+#ifdef WIN_2_X
+    if (fromDpy != fromWin)
+#endif
+      XSelectInput(toDpy, propWin, PropertyChangeMask);
+    for (sel = 0; sel < N_SELECTIONS; ++sel) {
+#ifdef WIN_2_X
+      /* the Windows clipboard only stands in for PRIMARY */
+      if ((fromDpy == fromWin) && (sel != SEL_PRIMARY))
+        continue;
+#endif
+      XSetSelectionOwner(toDpy, pDpyInfo->toDpyXtra.selAtom[sel], propWin,
+                         CurrentTime);
+    }
+#ifdef WIN_2_X
+    debug("SelectionOwner to propWin %x\n", (unsigned int)propWin);
+    pDpyInfo->owntoXsel = 1;
+    pDpyInfo->expectSelNotify = 0;
+    pDpyInfo->expectOwnClip = 0;
+    pDpyInfo->winSSave = 0;
+#endif
+  } /* END if doSel */
+
+  if (doResurface) /* get visibility events */
+    eventMask |= VisibilityChangeMask;
+
+#ifdef WIN_2_X
+  if (fromDpy != fromWin) {
+#endif
+  XSelectInput(fromDpy, trigger, eventMask);
+  pDpyInfo->eventMask = eventMask; /* save for future munging */
+  if (FORWARDS_SEL(pDpyInfo))
+    for (sel = 0; sel < N_SELECTIONS; ++sel)
+      XSetSelectionOwner(fromDpy, pDpyInfo->fromDpyXtra.selAtom[sel], trigger,
+                         CurrentTime);
+  XMapRaised(fromDpy, trigger);
+  DrawWindowText(pDpyInfo);
+#ifdef WIN_2_X
+  }
+#endif
+
+  for (pNode = nodes; pNode; pNode = pNode->pNext)
+    for (pShadow = pNode->shadows; pShadow; pShadow = pShadow->pNext)
+      XTestGrabControl(pShadow->dpy, True); /* impervious to grabs! */
+
+  pDpyInfo->selWinTo = None;
+  pDpyInfo->selRevTo = 0;
+  pDpyInfo->selWinFrom = None;
+  pDpyInfo->selRevFrom = 0;
+  pDpyInfo->signal = 0;
+
+} /* END InitDpyInfo */
+
+/**********
+ * derive everything that depends on the size of the from display;
+ * returns the location of the edge trigger window
+ **********/
+static int SetFromGeometry(pDpyInfo, fromWidth, fromHeight)
+PDPYINFO pDpyInfo;
+int      fromWidth, fromHeight;
+{
+  Bool vertical = pDpyInfo->vertical;
+  int  triggerLoc;
+
+  /* a defaulted compression region follows the screen */
+  if (pDpyInfo == activeSource) {
+    if ((compRegRight == 0) || (compRegRight == pDpyInfo->fromWidth))
+     compRegRight = fromWidth;
+    if ((compRegLow == 0) || (compRegLow == pDpyInfo->fromHeight))
+      compRegLow = fromHeight;
+  }
+
+  pDpyInfo->fromWidth   = fromWidth;
+  pDpyInfo->fromHeight  = fromHeight;
+
+  /* cursor locations for moving between screens */
+  pDpyInfo->fromIncrCoord = triggerw;
+  pDpyInfo->fromDecrCoord = (vertical ? fromHeight : fromWidth) - triggerw - 1;
+  pDpyInfo->fromCrossIncrCoord = triggerw;
+  pDpyInfo->fromCrossDecrCoord =
+    (vertical ? fromWidth : fromHeight) - triggerw - 1;
+
+  /* trigger window location */
+  if (doEdge == EDGE_NORTH) {
+    triggerLoc = 0;
+    pDpyInfo->fromConnCoord = compRegLow - triggerw - 1;
+    pDpyInfo->fromDiscCoord = triggerw;
+  } else if (doEdge == EDGE_SOUTH) {
+    triggerLoc = fromHeight - triggerw;
+    pDpyInfo->fromConnCoord = compRegUp + 1;
+    pDpyInfo->fromDiscCoord = triggerLoc - 1;
+  } else if (doEdge == EDGE_EAST) {
+    triggerLoc = fromWidth - triggerw;
+    pDpyInfo->fromConnCoord = compRegLeft + 1;
+    pDpyInfo->fromDiscCoord = triggerLoc - 1;
+  } else if (doEdge == EDGE_WEST) {
+    triggerLoc = 0;
+    pDpyInfo->fromConnCoord = compRegRight - triggerw - 1;
+    pDpyInfo->fromDiscCoord = triggerw;
+  } else /* no edge */ {
+    triggerLoc = 0;
+  } /* END if doEdge == ... */
+
+  return triggerLoc;
+
+} /* END SetFromGeometry */
+
+/**********
+ * construct table lookup for screen coordinate conversion of a node
+ **********/
+static void BuildTables(pDpyInfo, pNode)
+PDPYINFO pDpyInfo;
+PNODE    pNode;
+{
+  Display   *toDpy = pNode->dpy;
+  int       fromWidth = pDpyInfo->fromWidth;
+  int       fromHeight = pDpyInfo->fromHeight;
+  int       toHeight, toWidth;
+  short     *xTable, *yTable; /* short: what about dimensions > 2^15? */
+  short     **xTables, **yTables, **oldXTables, **oldYTables;
+  int       counter;
+  int       nScreens, oldNScreens, screenNum;
+
+  /* build the new tables aside, so that a rebuild can swap them in
+     between two events */
+  /* tiled mode: one screen, the canvas */
+  nScreens = tiles ? 1 : XScreenCount(toDpy);
+  xTables = (short **)xmalloc(sizeof(short *) * nScreens);
+  yTables = (short **)xmalloc(sizeof(short *) * nScreens);
+
+  for (screenNum = 0; screenNum < nScreens; ++screenNum) {
+    if (tiles) {
+      toWidth  = canvasWidth;
+      toHeight = canvasHeight;
+    } else {
+      toWidth  = XWidthOfScreen(XScreenOfDisplay(toDpy, screenNum));
+      toHeight = XHeightOfScreen(XScreenOfDisplay(toDpy, screenNum));
+    }
+
+    xTables[screenNum] = xTable =
+      (short *)xmalloc(sizeof(short) * fromWidth);
+    yTables[screenNum] = yTable =
+      (short *)xmalloc(sizeof(short) * fromHeight);
+
+    debug_cmpreg("fromWidth/Height: %d/%d, toWidth/Height: %d/%d\n",
+		    fromWidth, fromHeight, toWidth, toHeight);
+    if (noScale) {
+        /* TODO:
+            - the fake tables should be built as "starting ignored", 1:1 map
               region and "ending ignored".  Then the rest of the code would
               need to be taught to disallow mouse movements in the two ignored
               areas.  This would stop the mouse wrap-around that the simple
               tables below result in.
         */
 
-        /* fake vertical conversion table */
-        for (counter = 0; counter < fromHeight; ++counter)
-          yTable[counter] = counter % (toHeight - 1);
+        /* fake vertical conversion table */
+        for (counter = 0; counter < fromHeight; ++counter)
+          yTable[counter] = counter % (toHeight - 1);
+
+        /* fake horizontal conversion table entries */
+        for (counter = 0; counter < fromWidth; ++counter)
+          xTable[counter] = counter % (toWidth - 1);
+    } else {
+        /* vertical conversion table */
+        for (counter = 0; counter < fromHeight; ++counter)
+          yTable[counter] =
+            (counter < compRegUp) ? 0 :
+            (counter > compRegLow) ? toHeight - 1 :
+            (counter - compRegUp) * toHeight / (compRegLow - compRegUp);
+
+        /* vertical conversion table */
+        for (counter = 0; counter < fromWidth; ++counter)
+          xTable[counter] =
+            (counter < compRegLeft) ? 0 :
+            (counter > compRegRight) ? toWidth - 1 :
+            (counter - compRegLeft) * toWidth / (compRegRight - compRegLeft);
+    }
+
+    /* adjustment for boundaries: screens are laid out along the
+       main axis, links of the layout graph may be on any edge */
+    if (pDpyInfo->vertical ?
+        ((screenNum != 0) || NODE_HAS_EDGE(pNode, EDGE_NORTH)) :
+        NODE_HAS_EDGE(pNode, EDGE_NORTH)) {
+      for (counter = 0; counter <= compRegUp; ++counter)
+        yTable[counter] = COORD_DECR;
+    }
+    if (pDpyInfo->vertical ?
+        (((screenNum + 1) < nScreens) || NODE_HAS_EDGE(pNode, EDGE_SOUTH)) :
+        NODE_HAS_EDGE(pNode, EDGE_SOUTH)) {
+      /* work-around for bug: on at least one tested screen, cursor
+         never moved past fromWidth - 2  (I'll assume this might apply
+         in the vertical case, too. --cpbs) */
+      for (counter = compRegLow - 2; counter < fromHeight; ++counter)
+        yTable[counter] = COORD_INCR;
+    }
+    if (pDpyInfo->vertical ?
+        NODE_HAS_EDGE(pNode, EDGE_WEST) :
+        ((screenNum != 0) || NODE_HAS_EDGE(pNode, EDGE_WEST))) {
+      for (counter = 0; counter <= compRegLeft; ++counter)
+        xTable[counter] = COORD_DECR;
+    }
+    if (pDpyInfo->vertical ?
+        NODE_HAS_EDGE(pNode, EDGE_EAST) :
+        (((screenNum + 1) < nScreens) || NODE_HAS_EDGE(pNode, EDGE_EAST))) {
+      /* work-around for bug: on at least one tested screen, cursor
+         never moved past fromWidth - 2 */
+      for (counter = compRegRight - 2; counter < fromWidth; ++counter)
+        xTable[counter] = COORD_INCR;
+    }
+
+  } /* END for screenNum */
+
+  oldXTables  = pNode->xTables;
+  oldYTables  = pNode->yTables;
+  oldNScreens = pNode->nScreens;
+  pNode->xTables  = xTables;
+  pNode->yTables  = yTables;
+  pNode->nScreens = nScreens;
+  if (pDpyInfo->pNode == pNode) {
+    pDpyInfo->xTables  = xTables;
+    pDpyInfo->yTables  = yTables;
+  }
+
+  if (oldXTables) {
+    for (screenNum = 0; screenNum < oldNScreens; ++screenNum) {
+      free(oldXTables[screenNum]);
+      free(oldYTables[screenNum]);
+    }
+    free(oldXTables);
+    free(oldYTables);
+  }
+
+  /* tiles get the canvas cut, not scaled */
+  if (!tiles)
+    BuildShadowMaps(pNode);
+
+} /* END BuildTables */
+
+/**********
+ * shadows of another size than the "to" display: scale each "to" screen
+ * onto the screen of the same number, or the default one if missing
+ **********/
+static void BuildShadowMaps(pNode)
+PNODE pNode;
+{
+  Display   *toDpy = pNode->dpy;
+  PSHADOW   pShadow;
+  PSCALEMAP *pMaps, *oldMaps;
+  Screen    *toScreen, *shadowScreen;
+  int       nScreens = XScreenCount(toDpy);
+  int       oldNMaps, screenNum;
+  Bool      scaled;
+
+  for (pShadow = pNode->shadows; pShadow; pShadow = pShadow->pNext) {
+    if (pShadow->dpy == toDpy)
+      continue;
+    pMaps = (PSCALEMAP *)xmalloc(sizeof(PSCALEMAP) * nScreens);
+    scaled = False;
+    for (screenNum = 0; screenNum < nScreens; ++screenNum) {
+      toScreen = XScreenOfDisplay(toDpy, screenNum);
+      shadowScreen = (screenNum < XScreenCount(pShadow->dpy)) ?
+        XScreenOfDisplay(pShadow->dpy, screenNum) :
+        XDefaultScreenOfDisplay(pShadow->dpy);
+      if ((XWidthOfScreen(toScreen) == XWidthOfScreen(shadowScreen)) &&
+          (XHeightOfScreen(toScreen) == XHeightOfScreen(shadowScreen)))
+        continue;
+      pMaps[screenNum] =
+        GetScaleMap(XWidthOfScreen(toScreen), XHeightOfScreen(toScreen),
+                    XWidthOfScreen(shadowScreen),
+                    XHeightOfScreen(shadowScreen));
+      scaled = True;
+    } /* END for screenNum */
+    if (!scaled) { /* same size everywhere: used as is */
+      free(pMaps);
+      pMaps = NULL;
+    }
+
+    oldMaps  = pShadow->pMaps;
+    oldNMaps = pShadow->nMaps;
+    pShadow->pMaps = pMaps;
+    pShadow->nMaps = pMaps ? nScreens : 0;
+    if (oldMaps) {
+      for (screenNum = 0; screenNum < oldNMaps; ++screenNum)
+        if (oldMaps[screenNum])
+          FreeScaleMap(oldMaps[screenNum]);
+      free(oldMaps);
+    }
+  } /* END for pShadow */
+
+} /* END BuildShadowMaps */
+
+static PSCALEMAP GetScaleMap(fromWidth, fromHeight, toWidth, toHeight)
+int fromWidth, fromHeight, toWidth, toHeight;
+{
+  PSCALEMAP pMap;
+  int       counter;
+
+  for (pMap = scaleMaps; pMap; pMap = pMap->pNext)
+    if ((pMap->fromWidth == fromWidth) && (pMap->fromHeight == fromHeight) &&
+        (pMap->toWidth == toWidth) && (pMap->toHeight == toHeight)) {
+      ++(pMap->refs);
+      return pMap;
+    }
+
+  debug("scale map %dx%d to %dx%d\n", fromWidth, fromHeight,
+        toWidth, toHeight);
+  pMap = (PSCALEMAP)xmalloc(sizeof(SCALEMAP));
+  pMap->refs       = 1;
+  pMap->fromWidth  = fromWidth;
+  pMap->fromHeight = fromHeight;
+  pMap->toWidth    = toWidth;
+  pMap->toHeight   = toHeight;
+  pMap->xMap = (short *)xmalloc(sizeof(short) * fromWidth);
+  pMap->yMap = (short *)xmalloc(sizeof(short) * fromHeight);
+  for (counter = 0; counter < fromWidth; ++counter)
+    pMap->xMap[counter] = counter * toWidth / fromWidth;
+  for (counter = 0; counter < fromHeight; ++counter)
+    pMap->yMap[counter] = counter * toHeight / fromHeight;
+  pMap->pNext = scaleMaps;
+  scaleMaps = pMap;
+  return pMap;
+
+} /* END GetScaleMap */
+
+static void FreeScaleMap(pMap)
+PSCALEMAP pMap;
+{
+  PSCALEMAP *ppMap;
+
+  if (--(pMap->refs) > 0)
+    return;
+  for (ppMap = &scaleMaps; *ppMap != pMap; ppMap = &((*ppMap)->pNext));
+  *ppMap = pMap->pNext;
+  free(pMap->xMap);
+  free(pMap->yMap);
+  free(pMap);
+
+} /* END FreeScaleMap */
+
+/**********
+ * make a node the target of input forwarding
+ **********/
+static void ActivateNode(pDpyInfo, pNode)
+PDPYINFO pDpyInfo;
+PNODE    pNode;
+{
+  PSHADOW pShadow;
+
+  for (pShadow = shadows; pShadow; pShadow = pShadow->pNext)
+    if (pShadow->motionQueued)
+      FlushShadow(pShadow);
+  pDpyInfo->pNode      = pNode;
+  pDpyInfo->toScreen   = pNode->toScreen;
+  pDpyInfo->nScreens   = pNode->nScreens;
+  pDpyInfo->xTables    = pNode->xTables;
+  pDpyInfo->yTables    = pNode->yTables;
+  pDpyInfo->inverseMap = pNode->inverseMap;
+  nButtons             = pNode->nButtons;
+  shadows              = pNode->shadows;
+
+} /* END ActivateNode */
+
+/**********
+ * move the cursor across an edge of the active node onto its neighbour
+ **********/
+static void SwitchNode(pDpyInfo, edge)
+PDPYINFO pDpyInfo;
+int      edge;
+{
+  PNODE   pNode = pDpyInfo->pNode;
+  PNODE   pNext = pNode->links[edge];
+  PSHADOW pShadow;
+  int     toScreen;
+  PIPEREPLY ledState;
+
+  debug("switching from %s to %s\n", pNode->name, pNext->name);
+
+  /* leave the old node in normal state, like a disconnect */
+  if (doAutoUp) {
+    FakeThingsUp(pDpyInfo);
+    AskKeyboardState(NULL, NULL);
+    PipeSync();
+    RestoreKeyboardState();
+  }
+  toScreen = pNode->toScreen = pDpyInfo->toScreen;
+
+  ActivateNode(pDpyInfo, pNext);
+
+  /* enter on the screen next to the crossed edge */
+  if (edge == (pDpyInfo->vertical ? EDGE_SOUTH : EDGE_EAST))
+    pDpyInfo->toScreen = 0;
+  else if (edge == (pDpyInfo->vertical ? EDGE_NORTH : EDGE_WEST))
+    pDpyInfo->toScreen = pDpyInfo->nScreens - 1;
+  else
+    pDpyInfo->toScreen = MIN(toScreen, pDpyInfo->nScreens - 1);
+
+  for (pShadow = shadows; pShadow; pShadow = pShadow->pNext) {
+    DoDPMSForceLevel(pShadow, DPMSModeOn);
+    FlushShadow(pShadow);
+  }
+  if (doAutoUp) {
+    AskKeyboardState(pDpyInfo->fromDpy, &ledState);
+    PipeSync();
+    KeyboardState(&ledState);
+  }
+
+} /* END SwitchNode */
+
+/**********
+ * pipelined requests: each reply is copied into its PIPEREPLY when it
+ * comes in, so that the requests to all the displays go out at once and
+ * PipeSync waits one round trip, to the slowest of them
+ **********/
+static void PipeExpect(dpy, pReply)
+Display    *dpy;
+PPIPEREPLY pReply;
+{
+  PipeHandle(dpy, pReply);
+  pReply->pNext = pipeReplies;
+  pipeReplies = pReply;
+
+} /* END PipeExpect */
+
+/**********
+ * the reply to the last request to dpy goes into pReply, whenever Xlib
+ * reads it; the handler is to be dequeued once it has
+ **********/
+static void PipeHandle(dpy, pReply)
+Display    *dpy;
+PPIPEREPLY pReply;
+{
+  pReply->dpy = dpy;
+  pReply->seq = dpy->request;
+  pReply->done = False;
+  pReply->handler.next = dpy->async_handlers;
+  pReply->handler.handler = PipeHandler;
+  pReply->handler.data = (XPointer)pReply;
+  dpy->async_handlers = &(pReply->handler);
+
+} /* END PipeHandle */
+
+/**********
+ * the reply, or an error instead, has been read: Xlib has read past the
+ * request
+ **********/
+static Bool PipeAnswered(pReply)
+PPIPEREPLY pReply;
+{
+  return (pReply->done ||
+          ((long)(pReply->dpy->last_request_read - pReply->seq) >= 0));
+
+} /* END PipeAnswered */
+
+static Bool PipeHandler(dpy, rep, buf, len, data)
+Display *dpy;
+xReply  *rep;
+char    *buf;
+int     len;
+XPointer data;
+{
+  PPIPEREPLY pReply = (PPIPEREPLY)data;
+  int        extra;
+
+  if ((dpy->last_request_read != pReply->seq) ||
+      (rep->generic.type == X_Error)) /* errors go to ErrorHandler */
+    return False;
+  extra = MIN(rep->generic.length,
+              (sizeof(pReply->reply) - SIZEOF(xReply)) >> 2);
+  memmove(&(pReply->reply),
+          _XGetAsyncReply(dpy, (char *)&(pReply->reply), rep, buf, len,
+                          extra, True),
+          SIZEOF(xReply) + (extra << 2));
+  pReply->done = True;
+  return True;
+
+} /* END PipeHandler */
+
+static void PipeGetInputFocus(dpy, pReply)
+Display    *dpy;
+PPIPEREPLY pReply;
+{
+  xReq *req;
+
+  LockDisplay(dpy);
+  GetEmptyReq(GetInputFocus, req);
+  (void)req; /* nothing to fill in */
+  PipeExpect(dpy, pReply);
+  UnlockDisplay(dpy);
+
+} /* END PipeGetInputFocus */
+
+static void PipeGetKeyboardControl(dpy, pReply)
+Display    *dpy;
+PPIPEREPLY pReply;
+{
+  xReq *req;
+
+  LockDisplay(dpy);
+  GetEmptyReq(GetKeyboardControl, req);
+  (void)req;
+  PipeExpect(dpy, pReply);
+  UnlockDisplay(dpy);
+
+} /* END PipeGetKeyboardControl */
+
+/**********
+ * grab the pointer (unless pPointer is NULL) and the keyboard (unless
+ * pKeyboard is) to win, as XGrabPointer and XGrabKeyboard do for x2x
+ **********/
+static void PipeGrab(dpy, win, eventMask, cursor, pPointer, pKeyboard)
+Display      *dpy;
+Window       win;
+unsigned int eventMask;
+Cursor       cursor;
+PPIPEREPLY   pPointer, pKeyboard;
+{
+  xGrabPointerReq  *pointerReq;
+  xGrabKeyboardReq *keyboardReq;
+
+  LockDisplay(dpy);
+  if (pPointer) {
+    GetReq(GrabPointer, pointerReq);
+    pointerReq->grabWindow = win;
+    pointerReq->ownerEvents = True;
+    pointerReq->eventMask = eventMask;
+    pointerReq->pointerMode = GrabModeAsync;
+    pointerReq->keyboardMode = GrabModeAsync;
+    pointerReq->confineTo = None;
+    pointerReq->cursor = cursor;
+    pointerReq->time = CurrentTime;
+    PipeExpect(dpy, pPointer);
+  }
+  if (pKeyboard) {
+    GetReq(GrabKeyboard, keyboardReq);
+    keyboardReq->grabWindow = win;
+    keyboardReq->ownerEvents = True;
+    keyboardReq->pointerMode = GrabModeAsync;
+    keyboardReq->keyboardMode = GrabModeAsync;
+    keyboardReq->time = CurrentTime;
+    PipeExpect(dpy, pKeyboard);
+  }
+  UnlockDisplay(dpy);
+
+} /* END PipeGrab */
+
+/**********
+ * wait for the replies of all the pipelined requests: a fence after
+ * the last request to each display, all of them sent before any is
+ * waited on
+ **********/
+static void PipeSync()
+{
+  PPIPEREPLY pReply, pOther;
+  Display    *dpy;
+  xReq       *req;
+  xReply     rep;
+  long long  traced;
+
+  if (!pipeReplies)
+    return;
+  TRACE_START(traced);
+#if defined(RTT_AUDIT) && !defined(WIN_2_X)
+  AuditBegin("PipeSync", __func__);
+#endif
+  for (pReply = pipeReplies; pReply; pReply = pReply->pNext) {
+    for (pOther = pipeReplies; pOther != pReply; pOther = pOther->pNext)
+      if (pOther->dpy == pReply->dpy)
+        break;
+    pReply->fence = 0;
+    if (pOther != pReply) /* fenced already */
+      continue;
+    dpy = pReply->dpy;
+    LockDisplay(dpy);
+    GetEmptyReq(GetInputFocus, req);
+    (void)req;
+    pReply->fence = dpy->request;
+    UnlockDisplay(dpy);
+    XFlush(dpy);
+  } /* END for pReply */
+
+  for (pReply = pipeReplies; pReply; pReply = pReply->pNext) {
+    if (!pReply->fence)
+      continue;
+    dpy = pReply->dpy;
+    LockDisplay(dpy);
+    (void)_XReply(dpy, &rep, 0, xTrue);
+    UnlockDisplay(dpy);
+  } /* END for pReply */
+
+  /* done or not (an error instead) */
+  for (pReply = pipeReplies; pReply; pReply = pReply->pNext) {
+    dpy = pReply->dpy;
+    LockDisplay(dpy);
+    DeqAsyncHandler(dpy, &(pReply->handler));
+    UnlockDisplay(dpy);
+  }
+#if defined(RTT_AUDIT) && !defined(WIN_2_X)
+  AuditEnd("PipeSync", __func__, NULL, 0);
+#endif
+  pipeReplies = NULL;
+  TRACE_END(traced, "PipeSync", NULL);
+
+} /* END PipeSync */
+
+/**********
+ * the next request to dpy may fail, e.g. on a window gone since: no
+ * need to report that
+ **********/
+static void QuietRequest(dpy)
+Display *dpy;
+{
+  quietDpys[quietNext] = dpy;
+  quietSerials[quietNext] = NextRequest(dpy);
+  quietNext = (quietNext + 1) % N_QUIET;
+
+} /* END QuietRequest */
+
+/*
+ * Be sure that on all displays the same keyboard state
+ * is active, therefore check for CapsLock and NumLock,
+ * compare, and if required change the state on the
+ * shadowed displays.
+ *
+ * AskKeyboardState asks dpy (unless NULL) and the shadows for
+ * their LEDs; after a PipeSync, KeyboardState brings the shadows
+ * in line with dpy, and RestoreKeyboardState puts them back as
+ * they were.
+ */
+static void AskKeyboardState(Display *dpy, PPIPEREPLY pState)
+{
+  PSHADOW pShadow;
+
+  if (dpy)
+    PipeGetKeyboardControl(dpy, pState);
+  for (pShadow = shadows; pShadow; pShadow = pShadow->pNext)
+    PipeGetKeyboardControl(pShadow->dpy, &(pShadow->leds));
+}
+
+static void KeyboardState(PPIPEREPLY pState)
+{
+  PSHADOW pShadow;
+  long toMask, shMask;
+
+  if (!pState->done)
+    return;
+  toMask = pState->reply.keyboard.ledMask;
+#ifdef DEBUG
+  printf("  LED mask = %lx\n", toMask);
+#endif
+
+  for (pShadow = shadows; pShadow; pShadow = pShadow->pNext) {
+    if (!pShadow->leds.done)
+      continue;
+    shMask = pShadow->leds.reply.keyboard.ledMask;
+
+    if (toMask == shMask)
+      continue;
+
+    pShadow->led_mask = shMask;
+    FixLeds(pShadow, toMask, shMask);
+  }
+}
+
+static void RestoreKeyboardState(void)
+{
+  PSHADOW pShadow;
+  long shMask;
+
+  for (pShadow = shadows; pShadow; pShadow = pShadow->pNext) {
+    if (!pShadow->leds.done)
+      continue;
+    shMask = pShadow->leds.reply.keyboard.ledMask;
+
+#ifdef DEBUG
+    printf("  LED mask = %lx(%lx)\n", shMask, pShadow->led_mask);
+#endif
+
+    if (pShadow->led_mask == shMask)
+      continue;
+
+    FixLeds(pShadow, pShadow->led_mask, shMask);
+  }
+}
+
+/* toggle CapsLock and NumLock on a shadow from its LEDs to wanted */
+static void FixLeds(PSHADOW pShadow, long wanted, long leds)
+{
+  KeyCode keycode;
+
+  if ((wanted & 1) != (leds & 1) &&
+      (keycode = XKeysymToKeycode(pShadow->dpy, XK_Caps_Lock))) {
+    FakeKey(pShadow, keycode, True);
+    FakeKey(pShadow, keycode, False);
+    pShadow->flush = True;
+  }
+
+  if ((wanted & 2) != (leds & 2) &&
+      (keycode = XKeysymToKeycode(pShadow->dpy, XK_Num_Lock))) {
+    FakeKey(pShadow, keycode, True);
+    FakeKey(pShadow, keycode, False);
+    pShadow->flush = True;
+  }
+
+  if (pShadow->flush) {
+    FlushShadow(pShadow);
+    pShadow->flush = False;
+  }
+}
+
+static Bool HaveDPMS(pShadow)
+PSHADOW pShadow;
+{
+  if (pShadow->DPMSstatus == -1) {
+    /* Need to see if this display supports the DPMS extension.
+     * If it doesn't then trying DPMSForceLevel() will display
+     * a spurious error message to stderr.
+     */
+    int t1, t2;
+#ifdef WIN_2_X
+    if (DPMSQueryExtension(pShadow->dpy, &t1, &t2))
+#else
+    if (XQueryExtension(pShadow->dpy, "DPMS", &(pShadow->dpmsOpcode),
+                        &t1, &t2))
+#endif
+      pShadow->DPMSstatus = 1;
+    else
+      pShadow->DPMSstatus = 0;
+  }
+  return (pShadow->DPMSstatus != 0);
+}
+
+static void DoDPMSForceLevel(pShadow, level)
+PSHADOW pShadow;
+CARD16 level;
+{
+  if (pShadow->agentFd >= 0) { /* the agent does it, only on */
+    AgentPut(pShadow, AGENT_WAKE, 0, 0);
+    return;
+  }
+
+  /* Do a DPMSForceLevel(), but only if the display supports it */
+  if (HaveDPMS(pShadow))
+    DPMSForceLevel(pShadow->dpy, level);
+}
+
+/**********
+ * -dpmsmouse: turn the monitor of a shadow back on as the mouse moves.
+ * Its DPMS state is asked for at most once per dpmsInterval, without
+ * waiting for the answer: the reply is taken in on the motions that
+ * follow, and only a monitor that is off is forced on.
+ **********/
+static void DPMSWake(pShadow, now)
+PSHADOW   pShadow;
+long long now; /* ns */
+{
+#ifndef WIN_2_X
+  Display      *dpy = pShadow->dpy;
+  xDPMSInfoReq *req;
+
+  if (pShadow->dpmsAsked) { /* reply on its way */
+    if (!PipeAnswered(&(pShadow->dpmsInfo)))
+      XEventsQueued(dpy, QueuedAfterReading);
+    if (!PipeAnswered(&(pShadow->dpmsInfo)))
+      return;
+    LockDisplay(dpy);
+    DeqAsyncHandler(dpy, &(pShadow->dpmsInfo.handler));
+    UnlockDisplay(dpy);
+    pShadow->dpmsAsked = False;
+    if (pShadow->dpmsInfo.done && /* not an error */
+        pShadow->dpmsInfo.reply.dpms.state &&
+        (pShadow->dpmsInfo.reply.dpms.power_level != DPMSModeOn)) {
+      debug("DPMS wake up of %s\n", pShadow->name);
+      DPMSForceLevel(dpy, DPMSModeOn);
+    }
+  } /* END if dpmsAsked */
+#endif
+
+  if (now < pShadow->dpmsCheckAt)
+    return;
+  pShadow->dpmsCheckAt = now + (dpmsInterval * 1000000LL);
+
+#ifndef WIN_2_X
+  if (pShadow->agentFd >= 0) { /* the agent looks itself */
+    AgentPut(pShadow, AGENT_WAKE, 0, 0);
+  } else if (HaveDPMS(pShadow)) {
+    LockDisplay(dpy);
+    GetReq(DPMSInfo, req);
+    req->reqType = pShadow->dpmsOpcode;
+    req->dpmsReqType = X_DPMSInfo;
+    PipeHandle(dpy, &(pShadow->dpmsInfo));
+    UnlockDisplay(dpy);
+    pShadow->dpmsAsked = True;
+  }
+#else
+  DoDPMSForceLevel(pShadow, DPMSModeOn);
+#endif
+
+} /* END DPMSWake */
+
+/**********
+ * grab the pointer and keyboard of "from" for the trigger window, those
+ * not grabbed yet; the replies come with the next PipeSync
+ **********/
+static void GrabFrom(pDpyInfo)
+PDPYINFO pDpyInfo;
+{
+  PipeGrab(pDpyInfo->fromDpy, pDpyInfo->trigger,
+           PointerMotionMask | ButtonPressMask | ButtonReleaseMask,
+           pDpyInfo->grabCursor,
+           GRABBED(&(pDpyInfo->grabPointer)) ?
+           NULL : &(pDpyInfo->grabPointer),
+           GRABBED(&(pDpyInfo->grabKeyboard)) ?
+           NULL : &(pDpyInfo->grabKeyboard));
+
+} /* END GrabFrom */
+
+/**********
+ * after a PipeSync: a grab another client holds (a menu open, a screen
+ * locker) is tried again a little later, for a while
+ **********/
+static void CheckGrabs(pDpyInfo)
+PDPYINFO pDpyInfo;
+{
+  pDpyInfo->grabRetryAt = 0;
+  if (GRABBED(&(pDpyInfo->grabPointer)) &&
+      GRABBED(&(pDpyInfo->grabKeyboard)))
+    return;
+  if (pDpyInfo->grabRetries++ < GRAB_RETRIES) {
+    debug("grab failed, trying again\n");
+    pDpyInfo->grabRetryAt = Millis() + GRAB_RETRY_MS;
+  } else {
+    LOG(LOG_WARN, "can not grab the %s of %s\n",
+        GRABBED(&(pDpyInfo->grabPointer)) ? "keyboard" : "pointer",
+        DisplayString(pDpyInfo->fromDpy));
+  }
+
+} /* END CheckGrabs */
+
+static void RetryGrabs(pDpyInfo)
+PDPYINFO pDpyInfo;
+{
+  pDpyInfo->grabRetryAt = 0;
+  if (pDpyInfo->mode != X2X_CONNECTED)
+    return;
+  GrabFrom(pDpyInfo);
+  PipeSync();
+  CheckGrabs(pDpyInfo);
+
+} /* END RetryGrabs */
+
+static void DoConnect(pDpyInfo)
+PDPYINFO pDpyInfo;
+{
+  Display *fromDpy = pDpyInfo->fromDpy;
+  Display   *toDpy = pDpyInfo->toDpy;
+  PSHADOW pShadow;
+  PIPEREPLY focusFrom, ledState;
+  long long traced;
+  const char *audited;
+
+  if (pDpyInfo->signal)
+    return;
+
+  TakeOver(pDpyInfo);
+  audited = AUDIT_ENTER("DoConnect");
+  TRACE_START(traced);
+  for (pShadow = shadows; pShadow; pShadow = pShadow->pNext) {
+    DoDPMSForceLevel(pShadow, DPMSModeOn);
+    FlushShadow(pShadow);
+  }
+
+  debug("connecting\n");
+  pDpyInfo->mode = X2X_CONNECTED;
+
+#ifdef WIN_2_X
+  assert (fromDpy != fromWin);
+#endif
+
+  /* all of it is sent before any reply is waited for: one round trip,
+     to the slowest display */
+  PipeGetInputFocus(fromDpy, &focusFrom);
+  XSetInputFocus(fromDpy, PointerRoot, 0, CurrentTime);
+
+  if (shadows->agentFd >= 0) { /* the agent saved it */
+    AgentPut(shadows, AGENT_ENTER, 0, 0);
+    FlushShadow(shadows);
+  } else if (pDpyInfo->selWinTo != None) {
+    QuietRequest(toDpy); /* the window may be gone */
+    XSetInputFocus(toDpy, pDpyInfo->selWinTo, pDpyInfo->selRevTo,
+                   CurrentTime);
+    XFlush(toDpy);
+  }
+
+  if (doAutoUp)
+    AskKeyboardState(fromDpy, &ledState);
+
+  if (pDpyInfo->big != None) XMapRaised(fromDpy, pDpyInfo->big);
+  pDpyInfo->grabPointer.done = pDpyInfo->grabKeyboard.done = False;
+  pDpyInfo->grabRetries = 0;
+  GrabFrom(pDpyInfo);
+  XSelectInput(fromDpy, pDpyInfo->trigger, pDpyInfo->eventMask | PointerMotionMask);
+
+  PipeSync();
+  if (focusFrom.done) {
+    pDpyInfo->selWinFrom = focusFrom.reply.focus.focus;
+    pDpyInfo->selRevFrom = focusFrom.reply.focus.revertTo;
+  } else {
+    pDpyInfo->selWinFrom = None;
+  }
+  if (doAutoUp)
+    KeyboardState(&ledState);
+  CheckGrabs(pDpyInfo);
+  TRACE_END(traced, "DoConnect", NULL);
+  AUDIT_LEAVE(audited);
+
+} /* END DoConnect */
+
+/**********
+ * many-to-one: the "from" display that connects takes the "to" display
+ * and the tables over from the one that had them, which lets go first
+ **********/
+static void TakeOver(pDpyInfo)
+PDPYINFO pDpyInfo;
+{
+  PDPYINFO pOld = activeSource;
+  PNODE    pNode;
+  int      toScreen;
+
+  if (pDpyInfo == pOld)
+    return;
+  LOG(LOG_INFO, "%s takes over %s from %s\n",
+      pDpyInfo->name, toDpyName, pOld->name);
+  if ((pOld->mode == X2X_CONNECTED) || (pOld->mode == X2X_CONN_RELEASE))
+    DoDisconnect(pOld); /* its keys and buttons come up */
+  if (pOld->pNode != nodes) { /* it comes back over its edge, to toDpy */
+    pOld->pNode->toScreen = pOld->toScreen;
+    pOld->pNode = nodes;
+    pOld->toScreen = nodes->toScreen;
+  }
+  /* the focus on "to" it saved is the one to give back */
+  pDpyInfo->selWinTo = pOld->selWinTo;
+  pDpyInfo->selRevTo = pOld->selRevTo;
+  pOld->selWinTo = None;
+
+  /* a defaulted compression region follows the screen */
+  if (compRegRight == pOld->fromWidth)
+    compRegRight = pDpyInfo->fromWidth;
+  if (compRegLow == pOld->fromHeight)
+    compRegLow = pDpyInfo->fromHeight;
+  activeSource = pDpyInfo;
+  SetFromGeometry(pDpyInfo, pDpyInfo->fromWidth, pDpyInfo->fromHeight);
+  if ((pDpyInfo->fromWidth != pOld->fromWidth) ||
+      (pDpyInfo->fromHeight != pOld->fromHeight))
+    for (pNode = nodes; pNode; pNode = pNode->pNext)
+      BuildTables(pDpyInfo, pNode);
+  toScreen = pDpyInfo->toScreen; /* where it left the "to" display */
+  ActivateNode(pDpyInfo, pDpyInfo->pNode);
+  pDpyInfo->toScreen = toScreen;
+
+} /* END TakeOver */
+
+static void DoDisconnect(pDpyInfo)
+PDPYINFO pDpyInfo;
+{
+  Display *fromDpy = pDpyInfo->fromDpy;
+  Display   *toDpy = pDpyInfo->toDpy;
+  PDPYXTRA pDpyXtra;
+  int      sel;
+  PIPEREPLY focusTo;
+  long long traced;
+  const char *audited;
+
+  audited = AUDIT_ENTER("DoDisconnect");
+  TRACE_START(traced);
+  debug("disconnecting\n");
+  pDpyInfo->mode = X2X_DISCONNECTED;
+  pDpyInfo->grabRetryAt = 0;
+#ifdef WIN_2_X
+  assert (fromDpy != fromWin);
+#endif
+
+  focusTo.done = False;
+  if (shadows->agentFd >= 0) { /* no round trips to toDpy */
+    AgentPut(shadows, AGENT_LEAVE, 0, 0);
+    FlushShadow(shadows);
+  } else {
+    PipeGetInputFocus(toDpy, &focusTo);
+    XSetInputFocus(toDpy, PointerRoot, 0, CurrentTime);
+    XFlush(toDpy);
+  }
+
+  if (pDpyInfo->selWinFrom != None) {
+    QuietRequest(fromDpy); /* the window may be gone */
+    XSetInputFocus(fromDpy, pDpyInfo->selWinFrom, pDpyInfo->selRevFrom,
+                   CurrentTime);
+  }
+
+  if (pDpyInfo->big != None) XUnmapWindow(fromDpy, pDpyInfo->big);
+  XUngrabKeyboard(fromDpy, CurrentTime);
+  XUngrabPointer(fromDpy, CurrentTime);
+  XSelectInput(fromDpy, pDpyInfo->trigger, pDpyInfo->eventMask);
+
+  if (FORWARDS_SEL(pDpyInfo)) {
+    pDpyXtra = GETDPYXTRA(fromDpy, pDpyInfo);
+    for (sel = 0; sel < N_SELECTIONS; ++sel)
+      if (pDpyXtra->sState[sel] == SELSTATE_ON)
+        XSetSelectionOwner(fromDpy, pDpyXtra->selAtom[sel], pDpyXtra->propWin,
+                           CurrentTime);
+  } /* END if */
+
+  /* "from" is given back without waiting */
+  XFlush(fromDpy);
+
+  /* force normal state on to display: */
+  if (doAutoUp) {
+    FakeThingsUp(pDpyInfo);
+    AskKeyboardState(NULL, NULL);
+  }
+  PipeSync();
+  if (focusTo.done) {
+    pDpyInfo->selWinTo = focusTo.reply.focus.focus;
+    pDpyInfo->selRevTo = focusTo.reply.focus.revertTo;
+  }
+  if (doAutoUp)
+    RestoreKeyboardState();
+  TRACE_END(traced, "DoDisconnect", NULL);
+  AUDIT_LEAVE(audited);
+
+} /* END DoDisconnect */
+
+static void RegisterEventHandlers(pDpyInfo)
+PDPYINFO pDpyInfo;
+{
+  Display *fromDpy = pDpyInfo->fromDpy;
+  Window  trigger = pDpyInfo->trigger;
+  Display *toDpy;
+  Window  propWin;
+  PNODE   pNode;
+
+#define XSAVECONTEXT(A, B, C, D) XSaveContext(A, B, C, (XPointer)(D))
+
+#ifdef WIN_2_X
+  if (fromDpy != fromWin) {
+#endif
+  XSAVECONTEXT(fromDpy, trigger, MotionNotify,    ProcessMotionNotify);
+  XSAVECONTEXT(fromDpy, trigger, Expose,          ProcessExpose);
+  XSAVECONTEXT(fromDpy, trigger, EnterNotify,     ProcessEnterNotify);
+  XSAVECONTEXT(fromDpy, trigger, ButtonPress,     ProcessButtonPress);
+  XSAVECONTEXT(fromDpy, trigger, ButtonRelease,   ProcessButtonRelease);
+  XSAVECONTEXT(fromDpy, trigger, KeyPress,        ProcessKeyEvent);
+  XSAVECONTEXT(fromDpy, trigger, KeyRelease,      ProcessKeyEvent);
+  XSAVECONTEXT(fromDpy, trigger, ConfigureNotify, ProcessConfigureNotify);
+  XSAVECONTEXT(fromDpy, trigger, ClientMessage,   ProcessClientMessage);
+  XSAVECONTEXT(fromDpy, None,    MappingNotify,   ProcessMapping);
+#ifdef HAVE_BARRIERS
+  if (pDpyInfo->barrier != None)
+    XSAVECONTEXT(fromDpy, None,  GenericEvent,    ProcessGenericEvent);
+#endif
+
+
+  if (doResurface)
+    XSAVECONTEXT(fromDpy, trigger, VisibilityNotify, ProcessVisibility);
+#ifdef HAVE_RANDR
+  SelectScreenChange(fromDpy);
+#endif
+#ifdef WIN_2_X
+  }
+#endif
+
+  toDpy = pDpyInfo->toDpy;
+  propWin = pDpyInfo->toDpyXtra.propWin;
+  for (pNode = nodes; pNode; pNode = pNode->pNext) {
+    XSAVECONTEXT(pNode->dpy, None, MappingNotify, ProcessMapping);
+#ifdef HAVE_RANDR
+    SelectScreenChange(pNode->dpy);
+#endif
+  }
+
+  if (FORWARDS_SEL(pDpyInfo)) {
+#ifdef WIN_2_X
+    if (fromDpy != fromWin) {
+#endif
+    XSAVECONTEXT(fromDpy, trigger, SelectionRequest, ProcessSelectionRequest);
+    XSAVECONTEXT(fromDpy, trigger, PropertyNotify,   ProcessPropertyNotify);
+    XSAVECONTEXT(fromDpy, trigger, SelectionNotify,  ProcessSelectionNotify);
+    XSAVECONTEXT(fromDpy, trigger, SelectionClear,   ProcessSelectionClear);
+    XSAVECONTEXT(toDpy,   propWin, SelectionRequest, ProcessSelectionRequest);
+    XSAVECONTEXT(toDpy,   propWin, PropertyNotify,   ProcessPropertyNotify);
+    XSAVECONTEXT(toDpy,   propWin, SelectionNotify,  ProcessSelectionNotify);
+    XSAVECONTEXT(toDpy,   propWin, SelectionClear,   ProcessSelectionClear);
+#ifdef HAVE_XFIXES
+    if (selCacheMax > 0) {
+      SelectSelectionOwner(fromDpy, pDpyInfo);
+      SelectSelectionOwner(toDpy, pDpyInfo);
+    }
+#endif
+#ifdef WIN_2_X
+    } else {
+      XSAVECONTEXT(toDpy, propWin, SelectionRequest, ProcessSelectionRequestW);
+      // XSAVECONTEXT(toDpy, propWin, PropertyNotify,  ProcessPropertyNotifyW);
+      XSAVECONTEXT(toDpy, propWin, SelectionNotify,ProcessSelectionNotifyW);
+      XSAVECONTEXT(toDpy, propWin, SelectionClear,   ProcessSelectionClearW);
+    }
+#endif
+  } /* END if doSel */
+
+} /* END RegisterEventHandlers */
+
+static Bool ProcessEvent(dpy, pDpyInfo)
+Display  *dpy;
+PDPYINFO pDpyInfo;
+{
+  XEvent    ev;
+  XAnyEvent *pEv = (XAnyEvent *)&ev;
+  HANDLER   handler;
+  Bool      done = False;
+  long long traced, tracedHandler;
+  const char *audited;
+
+#define XFINDCONTEXT(A, B, C, D) XFindContext(A, B, C, (XPointer *)(D))
+
+  TRACE_START(traced);
+  XNextEvent(dpy, &ev);
+  logEventTime = LogNow();
+  handler = 0;
+  if ((!XFINDCONTEXT(dpy, pEv->window, pEv->type, &handler)) ||
+      (!XFINDCONTEXT(dpy, None, pEv->type, &handler))) {
+    /* have handler */
+    audited = AUDIT_ENTER((pEv->type < LASTEvent) ?
+                          eventNames[pEv->type] : "extension event");
+    TRACE_START(tracedHandler);
+    done = (*handler)(dpy, pDpyInfo, &ev);
+    AUDIT_LEAVE(audited);
+    TRACE_END(tracedHandler, (pEv->type < LASTEvent) ?
+              eventNames[pEv->type] : "extension event", DisplayString(dpy));
+  } else {
+    debug("no handler for window 0x%x, event type %d\n",
+           (unsigned int)pEv->window, pEv->type);
+  } /* END if/else */
+  TRACE_END(traced, "ProcessEvent", NULL);
+  logEventTime = 0;
+
+  return done;
+
+} /* END ProcessEvent */
+
+static Bool ProcessMotionNotify(unused, pDpyInfo, pEv)
+Display  *unused;
+PDPYINFO pDpyInfo;
+XMotionEvent *pEv; /* caution: might be pseudo-event!!! */
+{
+  /* Note: ProcessMotionNotify is sometimes called from inside x2x to
+   *       simulate a motion event.  Any new references to pEv fields
+   *       must be checked carefully!
+   */
+
+  int       toScreenNum;
+  PSHADOW   pShadow;
+  int       toCoord, fromCoord;
+  int       crossCoord, fromCross;
+  int       toX, toY;
+  PSCALEMAP pMap;
+  int       edge;
+  Display   *fromDpy;
+  Bool      bAbortedDisconnect;
+  Bool      vert;
+  long long now = 0;
+
+  /* queued before another source took over: its tables are gone */
+  if (pDpyInfo != activeSource)
+    return False;
+
+  /* from before the last warp, where the pointer no longer is */
+  if ((long)(pEv->serial - pDpyInfo->warpSerial) < 0)
+    return False;
+
+  vert = pDpyInfo->vertical;
+
+  /* find the screen */
+  toScreenNum = pDpyInfo->toScreen;
+  fromCoord = vert ? pEv->y_root : pEv->x_root;
+  fromCross = vert ? pEv->x_root : pEv->y_root;
+
+  /* check to make sure the cursor is still on the from screen */
+  if (!(pEv->same_screen)) {
+    toCoord = (pDpyInfo->lastFromCoord < fromCoord) ? COORD_DECR : COORD_INCR;
+  } else {
+    toCoord = (vert?pDpyInfo->yTables:pDpyInfo->xTables)[toScreenNum][fromCoord];
+  }
+
+  if (SPECIAL_COORD(toCoord) != 0) { /* special coordinate */
+    bAbortedDisconnect = False;
+    if (toCoord == COORD_INCR) {
+      edge = vert ? EDGE_SOUTH : EDGE_EAST;
+      if (toScreenNum != (pDpyInfo->nScreens - 1)) { /* next screen */
+        toScreenNum = ++(pDpyInfo->toScreen);
+        fromCoord = pDpyInfo->fromIncrCoord;
+        toCoord = (vert?pDpyInfo->yTables:pDpyInfo->xTables)[toScreenNum][fromCoord];
+      } else if (pDpyInfo->pNode->links[edge]) { /* next node */
+        if (doBtnBlock &&
+            (pEv->state & (Button1Mask | Button2Mask | Button3Mask |
+                           Button4Mask | Button5Mask))) {
+          bAbortedDisconnect = True;
+          toCoord = (vert?pDpyInfo->yTables:pDpyInfo->xTables)[toScreenNum][pDpyInfo->fromDecrCoord];
+        } else {
+          SwitchNode(pDpyInfo, edge);
+          toScreenNum = pDpyInfo->toScreen;
+          fromCoord = pDpyInfo->fromIncrCoord;
+          toCoord = (vert?pDpyInfo->yTables:pDpyInfo->xTables)[toScreenNum][fromCoord];
+        }
+      } else { /* disconnect! */
+        if (doBtnBlock &&
+            (pEv->state & (Button1Mask | Button2Mask | Button3Mask |
+                           Button4Mask | Button5Mask)))
+          bAbortedDisconnect = True;
+        else {
+          DoDisconnect(pDpyInfo);
+          fromCoord = pDpyInfo->fromDiscCoord;
+        }
+        toCoord = (vert?pDpyInfo->yTables:pDpyInfo->xTables)[toScreenNum][pDpyInfo->fromConnCoord];
+      }
+    } else { /* DECR */
+      edge = vert ? EDGE_NORTH : EDGE_WEST;
+      if (toScreenNum != 0) { /* previous screen */
+        toScreenNum = --(pDpyInfo->toScreen);
+        fromCoord = pDpyInfo->fromDecrCoord;
+        toCoord = (vert?pDpyInfo->yTables:pDpyInfo->xTables)[toScreenNum][fromCoord];
+      } else if (pDpyInfo->pNode->links[edge]) { /* previous node */
+        if (doBtnBlock &&
+            (pEv->state & (Button1Mask | Button2Mask | Button3Mask |
+                           Button4Mask | Button5Mask))) {
+          bAbortedDisconnect = True;
+          toCoord = (vert?pDpyInfo->yTables:pDpyInfo->xTables)[toScreenNum][pDpyInfo->fromIncrCoord];
+        } else {
+          SwitchNode(pDpyInfo, edge);
+          toScreenNum = pDpyInfo->toScreen;
+          fromCoord = pDpyInfo->fromDecrCoord;
+          toCoord = (vert?pDpyInfo->yTables:pDpyInfo->xTables)[toScreenNum][fromCoord];
+        }
+      } else { /* disconnect! */
+        if (doBtnBlock &&
+            (pEv->state & (Button1Mask | Button2Mask | Button3Mask |
+                           Button4Mask | Button5Mask)))
+          bAbortedDisconnect = True;
+        else {
+          DoDisconnect(pDpyInfo);
+          fromCoord = pDpyInfo->fromDiscCoord;
+        }
+        toCoord = (vert?pDpyInfo->yTables:pDpyInfo->xTables)[toScreenNum][pDpyInfo->fromConnCoord];
+      }
+    } /* END if toCoord */
+    if (!bAbortedDisconnect) {
+      fromDpy = pDpyInfo->fromDpy;
+      WarpFrom(pDpyInfo, vert ? pEv->x_root : fromCoord,
+               vert ? fromCoord : pEv->y_root);
+      XFlush(fromDpy);
+    }
+  } /* END if SPECIAL_COORD */
+  pDpyInfo->lastFromCoord = fromCoord;
 
-        /* fake horizontal conversion table entries */
-        for (counter = 0; counter < fromWidth; ++counter)
-          xTable[counter] = counter % (toWidth - 1);
+  /* the other axis only has special coordinates at side links */
+  crossCoord = (vert?pDpyInfo->xTables:pDpyInfo->yTables)[toScreenNum][fromCross];
+  if (pEv->same_screen && (SPECIAL_COORD(crossCoord) != 0)) {
+    if (crossCoord == COORD_INCR) {
+      edge = vert ? EDGE_EAST : EDGE_SOUTH;
+      fromCross = pDpyInfo->fromCrossDecrCoord; /* if blocked */
     } else {
-        /* vertical conversion table */
-        for (counter = 0; counter < fromHeight; ++counter)
-          yTable[counter] =
-            (counter < compRegUp) ? 0 :
-            (counter > compRegLow) ? toHeight - 1 :
-            (counter - compRegUp) * toHeight / (compRegLow - compRegUp);
+      edge = vert ? EDGE_WEST : EDGE_NORTH;
+      fromCross = pDpyInfo->fromCrossIncrCoord;
+    }
+    if ((pDpyInfo->mode == X2X_CONNECTED) &&
+        !(doBtnBlock &&
+          (pEv->state & (Button1Mask | Button2Mask | Button3Mask |
+                         Button4Mask | Button5Mask)))) {
+      SwitchNode(pDpyInfo, edge);
+      toScreenNum = pDpyInfo->toScreen;
+      fromCross = (crossCoord == COORD_INCR) ?
+        pDpyInfo->fromCrossIncrCoord : pDpyInfo->fromCrossDecrCoord;
+      toCoord = (vert?pDpyInfo->yTables:pDpyInfo->xTables)[toScreenNum][fromCoord];
+      if (SPECIAL_COORD(toCoord) != 0) /* entered at a corner */
+        toCoord = (vert?pDpyInfo->yTables:pDpyInfo->xTables)[toScreenNum]
+          [(toCoord == COORD_INCR) ?
+           pDpyInfo->fromDecrCoord : pDpyInfo->fromIncrCoord];
 
-        /* vertical conversion table */
-        for (counter = 0; counter < fromWidth; ++counter)
-          xTable[counter] =
-            (counter < compRegLeft) ? 0 :
-            (counter > compRegRight) ? toWidth - 1 :
-            (counter - compRegLeft) * toWidth / (compRegRight - compRegLeft);
+      fromDpy = pDpyInfo->fromDpy;
+      WarpFrom(pDpyInfo, vert ? fromCross : fromCoord,
+               vert ? fromCoord : fromCross);
+      XFlush(fromDpy);
     }
+    crossCoord = (vert?pDpyInfo->xTables:pDpyInfo->yTables)[toScreenNum][fromCross];
+  } /* END if side link */
+  pDpyInfo->lastCrossCoord = fromCross;
+
+  toX = vert ? crossCoord : toCoord;
+  toY = vert ? toCoord : crossCoord;
+  if (tiles && (toX >= 0) && (toY >= 0)) {
+    pShadow = tileGrid[(tileRows[toY] * nTileCols) + tileCols[toX]];
+    if (pShadow && (pShadow != shadows))
+      FocusTile(pDpyInfo, pShadow);
+    /* over a gap between tiles, stay at the edge of the last one */
+    pShadow = shadows;
+    toX = MAX(0, MIN(toX - pShadow->tileX, pShadow->tileWidth - 1));
+    toY = MAX(0, MIN(toY - pShadow->tileY, pShadow->tileHeight - 1));
+    toScreenNum = XDefaultScreen(pShadow->dpy);
+  }
 
-    /* adjustment for boundaries */
-    if (vertical) {
-      if ((screenNum != 0) || (doEdge == EDGE_SOUTH)) {
-        for (counter = 0; counter <= compRegUp; ++counter)
-          yTable[counter] = COORD_DECR;
-      }
-      if (((screenNum + 1) < nScreens) || (doEdge == EDGE_NORTH)) {
-        /* work-around for bug: on at least one tested screen, cursor
-           never moved past fromWidth - 2  (I'll assume this might apply
-           in the vertical case, too. --cpbs) */
-        for (counter = compRegLow - 2; counter < fromHeight; ++counter)
-          yTable[counter] = COORD_INCR;
-      }
-    } else {
-      if ((screenNum != 0) || (doEdge == EDGE_EAST)) {
-        for (counter = 0; counter <= compRegLeft; ++counter)
-          xTable[counter] = COORD_DECR;
-      }
-      if (((screenNum + 1) < nScreens) || (doEdge == EDGE_WEST)) {
-        /* work-around for bug: on at least one tested screen, cursor
-           never moved past fromWidth - 2 */
-        for (counter = compRegRight - 2; counter < fromWidth; ++counter)
-          xTable[counter] = COORD_INCR;
+  if (doDpmsMouse)
+    now = LogNow();
+  for (pShadow = shadows; pShadow; pShadow = pShadow->pNext) {
+    if (doDpmsMouse)
+      DPMSWake(pShadow, now);
+
+#ifdef DEBUG_COMPLREG
+    static unsigned lc;
+
+    if (lc++ % 10 == 0)
+      debug_cmpreg("sj: Call XTestFakeMotionEvent %d/%d to %d/%d\n",
+                      pEv->x_root,
+                      pEv->y_root,
+                      pDpyInfo->xTables[toScreenNum][pEv->x_root],
+                      pDpyInfo->yTables[toScreenNum][pEv->y_root]);
+#endif
+
+    /* another size: its own map (a special coordinate passes as is) */
+    if (pShadow->pMaps && (pMap = pShadow->pMaps[toScreenNum]) &&
+        (toX >= 0) && (toY >= 0))
+      FakeMotion(pShadow, toScreenNum, pMap->xMap[toX], pMap->yMap[toY]);
+    else
+      FakeMotion(pShadow, toScreenNum, toX, toY);
+  } /* END for */
+
+  /* more motion read already: it replaces this one */
+  if (!MotionFollows(pDpyInfo->fromDpy))
+    for (pShadow = shadows; pShadow; pShadow = pShadow->pNext) {
+      FlushShadow(pShadow);
+      pShadow->flush = False;
+    }
+
+  return False;
+
+} /* END ProcessMotionNotify */
+
+static Bool ProcessExpose(dpy, pDpyInfo, pEv)
+Display  *dpy;
+PDPYINFO pDpyInfo;
+XExposeEvent *pEv;
+{
+  XClearWindow(pDpyInfo->fromDpy, pDpyInfo->trigger);
+  DrawWindowText(pDpyInfo);
+  return False;
+
+} /* END ProcessExpose */
+
+/**********
+ * font and size of the text in the x2x window
+ **********/
+static Bool LoadLabelFont(pDpyInfo)
+PDPYINFO pDpyInfo;
+{
+  Display *fromDpy = pDpyInfo->fromDpy;
+  Font    fid;
+  int     ascent, descent, direction;
+  XCharStruct overall;
+
+  if (((fid = XLoadFont(fromDpy, fontName)) == 0) &&
+      ((fid = XLoadFont(fromDpy, defaultFN)) == 0) &&
+      ((fid = XLoadFont(fromDpy, "fixed")) == 0))
+    return False;
+
+  XQueryTextExtents(fromDpy, fid, label, strlen(label),
+                    &direction, &ascent, &descent, &overall);
+  pDpyInfo->twidth = -overall.lbearing + overall.rbearing;
+  pDpyInfo->theight = ascent + descent;
+  pDpyInfo->tascent = ascent;
+
+  pDpyInfo->textGC = XCreateGC(fromDpy, pDpyInfo->root, 0, NULL);
+  XSetState(fromDpy, pDpyInfo->textGC,
+            XBlackPixel(fromDpy, XDefaultScreen(fromDpy)),
+            XWhitePixel(fromDpy, XDefaultScreen(fromDpy)),
+            GXcopy, AllPlanes);
+  XSetFont(fromDpy, pDpyInfo->textGC, fid);
+  pDpyInfo->fid = fid;
+  return True;
+
+} /* END LoadLabelFont */
+
+static void DrawWindowText(pDpyInfo)
+PDPYINFO pDpyInfo;
+{
+  if (pDpyInfo->fontPending) {
+    pDpyInfo->fontPending = False;
+    LoadLabelFont(pDpyInfo);
+  }
+  if (pDpyInfo->fid == 0)
+    return;
+
+  XDrawImageString(pDpyInfo->fromDpy, pDpyInfo->trigger, pDpyInfo->textGC,
+		   MAX(0,((pDpyInfo->width - pDpyInfo->twidth) / 2)),
+		   MAX(0,((pDpyInfo->height - pDpyInfo->theight) / 2)) +
+		   pDpyInfo->tascent, label, strlen(label));
+}
+static Bool ProcessEnterNotify(dpy, pDpyInfo, pEv)
+Display  *dpy;
+PDPYINFO pDpyInfo;
+XCrossingEvent *pEv;
+{
+  if ((pEv->mode == NotifyNormal) &&
+      (pDpyInfo->mode == X2X_DISCONNECTED) && (dpy == pDpyInfo->fromDpy))
+    EdgeConnect(pDpyInfo, pEv->x_root, pEv->y_root, 0);
+  return False;
+
+} /* END ProcessEnterNotify */
+
+/**********
+ * slide onto the "to" display from the edge of the "from" display
+ **********/
+static void EdgeConnect(pDpyInfo, x_root, y_root, carry)
+PDPYINFO pDpyInfo;
+int      x_root, y_root; /* where the edge was reached */
+int      carry;          /* motion past the edge, carried across */
+{
+  XMotionEvent xmev;
+  int connCoord;
+
+  TakeOver(pDpyInfo); /* for its compression region */
+  if (x_root < compRegLeft)
+	  x_root = compRegLeft;
+  if (x_root > compRegRight)
+	  x_root = compRegRight;
+  if (y_root < compRegUp)
+	  y_root = compRegUp;
+  if (y_root > compRegLow)
+	  y_root = compRegLow;
+
+  connCoord = pDpyInfo->fromConnCoord;
+  if (carry)
+    connCoord = MAX(pDpyInfo->fromIncrCoord,
+                    MIN(pDpyInfo->fromDecrCoord, connCoord + carry));
+
+  DoConnect(pDpyInfo);
+  if (pDpyInfo->vertical) {
+    WarpFrom(pDpyInfo, x_root, connCoord);
+    xmev.x_root = pDpyInfo->lastCrossCoord = x_root;
+    xmev.y_root = pDpyInfo->lastFromCoord = connCoord;
+  } else {
+    WarpFrom(pDpyInfo, connCoord, y_root);
+    xmev.x_root = pDpyInfo->lastFromCoord = connCoord;
+    xmev.y_root = pDpyInfo->lastCrossCoord = y_root;
+  }
+  xmev.serial = pDpyInfo->warpSerial;
+  xmev.same_screen = True;
+  ProcessMotionNotify(NULL, pDpyInfo, &xmev);
+
+} /* END EdgeConnect */
+
+/**********
+ * move the pointer of "from"; motion events from before the server
+ * carried this out are told by their serial and dropped
+ **********/
+static void WarpFrom(pDpyInfo, x, y)
+PDPYINFO pDpyInfo;
+int      x, y;
+{
+  pDpyInfo->warpSerial = XNextRequest(pDpyInfo->fromDpy);
+  XWarpPointer(pDpyInfo->fromDpy, None, pDpyInfo->root, 0, 0, 0, 0, x, y);
+
+} /* END WarpFrom */
+
+#ifdef HAVE_BARRIERS
+/**********
+ * put an XFixes pointer barrier along the edge, if the server can
+ **********/
+static Bool CreateEdgeBarrier(pDpyInfo)
+PDPYINFO pDpyInfo;
+{
+  Display *fromDpy = pDpyInfo->fromDpy;
+  int     fixesEvent, fixesError, fixesMajor, fixesMinor;
+  int     xiEvent, xiError, xiMajor, xiMinor;
+  XIEventMask   mask;
+  unsigned char bits[XIMaskLen(XI_BarrierHit)];
+
+  fixesMajor = 5; fixesMinor = 0;
+  xiMajor = 2; xiMinor = 3;
+  if (!XFixesQueryExtension(fromDpy, &fixesEvent, &fixesError) ||
+      !XFixesQueryVersion(fromDpy, &fixesMajor, &fixesMinor) ||
+      (fixesMajor < 5) ||
+      !XQueryExtension(fromDpy, "XInputExtension", &pDpyInfo->xiOpcode,
+                       &xiEvent, &xiError) ||
+      (XIQueryVersion(fromDpy, &xiMajor, &xiMinor) != Success) ||
+      (xiMajor < 2) || ((xiMajor == 2) && (xiMinor < 3))) {
+    debug("no pointer barriers, using a trigger window\n");
+    return False;
+  }
+
+  PlaceEdgeBarrier(pDpyInfo);
+
+  memset(bits, 0, sizeof(bits));
+  XISetMask(bits, XI_BarrierHit);
+  mask.deviceid = XIAllMasterDevices;
+  mask.mask_len = sizeof(bits);
+  mask.mask = bits;
+  XISelectEvents(fromDpy, pDpyInfo->root, &mask, 1);
+  return True;
+
+} /* END CreateEdgeBarrier */
+
+/**********
+ * (re)create the pointer barrier along the edge of the from display
+ **********/
+static void PlaceEdgeBarrier(pDpyInfo)
+PDPYINFO pDpyInfo;
+{
+  Display *fromDpy = pDpyInfo->fromDpy;
+  int     width = pDpyInfo->fromWidth;
+  int     height = pDpyInfo->fromHeight;
+  int     x1, y1, x2, y2, directions;
+
+  if (pDpyInfo->barrier != None)
+    XFixesDestroyPointerBarrier(fromDpy, pDpyInfo->barrier);
+
+  /* barriers lie between pixels: block motion out of the screen, but
+     leave the last row or column reachable for the coordinate tables */
+  if (doEdge == EDGE_NORTH) {
+    x1 = triggerw; x2 = width - triggerw; y1 = y2 = 0;
+    directions = BarrierPositiveY;
+  } else if (doEdge == EDGE_SOUTH) {
+    x1 = triggerw; x2 = width - triggerw; y1 = y2 = height;
+    directions = BarrierNegativeY;
+  } else if (doEdge == EDGE_EAST) {
+    x1 = x2 = width; y1 = triggerw; y2 = height - triggerw;
+    directions = BarrierNegativeX;
+  } else /* doEdge == EDGE_WEST */ {
+    x1 = x2 = 0; y1 = triggerw; y2 = height - triggerw;
+    directions = BarrierPositiveX;
+  } /* END if doEdge == ... */
+
+  pDpyInfo->barrier =
+    XFixesCreatePointerBarrier(fromDpy, pDpyInfo->root, x1, y1, x2, y2,
+                               directions, 0, NULL);
+
+  debug("pointer barrier %lx from %d,%d to %d,%d\n",
+        (unsigned long)pDpyInfo->barrier, x1, y1, x2, y2);
+
+} /* END PlaceEdgeBarrier */
+
+static Bool ProcessGenericEvent(dpy, pDpyInfo, pEv)
+Display  *dpy;
+PDPYINFO pDpyInfo;
+XGenericEventCookie *pEv;
+{
+  XIBarrierEvent *pBarrierEv;
+
+  if ((pEv->extension != pDpyInfo->xiOpcode) || !XGetEventData(dpy, pEv))
+    return False;
+
+  if (pEv->evtype == XI_BarrierHit) {
+    pBarrierEv = (XIBarrierEvent *)pEv->data;
+    /* pushing against the barrier while connected is normal motion */
+    if ((pBarrierEv->barrier == pDpyInfo->barrier) &&
+        (pDpyInfo->mode == X2X_DISCONNECTED)) {
+      debug("barrier hit at %d,%d\n",
+            (int)pBarrierEv->root_x, (int)pBarrierEv->root_y);
+      EdgeConnect(pDpyInfo,
+                  (int)pBarrierEv->root_x, (int)pBarrierEv->root_y,
+                  (int)(pDpyInfo->vertical ?
+                        pBarrierEv->dy : pBarrierEv->dx));
+    }
+  } /* END if barrier hit */
+
+  XFreeEventData(dpy, pEv);
+  return False;
+
+} /* END ProcessGenericEvent */
+#endif /* HAVE_BARRIERS */
+
+static Bool ProcessButtonPress(dpy, pDpyInfo, pEv)
+Display  *dpy;
+PDPYINFO pDpyInfo;
+XButtonEvent *pEv;
+{
+  int state;
+  PSHADOW   pShadow;
+  unsigned int toButton;
+
+  KeySym  keysym;
+  KeyCode keycode;
+  int     eventno;
+
+  switch (pDpyInfo->mode) {
+  case X2X_DISCONNECTED:
+    pDpyInfo->mode = X2X_AWAIT_RELEASE;
+    debug("awaiting button release before connecting\n");
+    break;
+  case X2X_CONNECTED:
+    debug("Got button %d, max is %d (%d)\n", pEv->button, N_BUTTONS, nButtons);
+    if ((pEv->button <= N_BUTTONS) &&
+        (buttonmap[pEv->button][0] != NoSymbol))
+    {
+      debug("Mapped!\n");
+      for (pShadow = shadows; pShadow; pShadow = pShadow->pNext)
+      {
+        debug("Button %d is mapped, sending keys: ", pEv->button);
+        for (eventno = 0;
+             (keysym = buttonmap[pEv->button][eventno]) != NoSymbol;
+             eventno++)
+        {
+          if ((keycode = XKeysymToKeycode(pShadow->dpy, keysym))) {
+            FakeKey(pShadow, keycode, True);
+            FakeKey(pShadow, keycode, False);
+            FlushShadow(pShadow);
+            debug(" (0x%04X)", keycode);
+          }
+          else
+            debug(" (no code)");
+        }
+        debug("\n");
       }
+    } else if (pEv->button <= nButtons) {
+      toButton = pDpyInfo->inverseMap[pEv->button];
+      for (pShadow = shadows; pShadow; pShadow = pShadow->pNext) {
+        FakeButton(pShadow, toButton, True);
+        debug("from button %d down, to button %d down\n", pEv->button,toButton);
+        FlushShadow(pShadow);
+	pShadow->flush = False;
+      } /* END for */
+      if (doAutoUp)
+        FakeAction(pDpyInfo, FAKE_BUTTON, toButton, True);
     }
+    if (doEdge) break;
 
-  } /* END for screenNum */
+    /* check if more than one button pressed */
+    state = pEv->state & (Button1Mask|Button2Mask|Button3Mask|Button4Mask|Button5Mask);
+    switch (pEv->button) {
+    case Button1: state &= ~Button1Mask; break;
+    case Button2: state &= ~Button2Mask; break;
+    case Button3: state &= ~Button3Mask; break;
+    case Button4: state &= ~Button4Mask; break;
+    case Button5: state &= ~Button5Mask; break;
+    default:
+      debug("unknown button %d\n", pEv->button);
+      break;
+    } /* END switch button */
+    if (state) { /* then more than one button pressed */
+      debug("awaiting button release before disconnecting\n");
+      pDpyInfo->mode = X2X_CONN_RELEASE;
+    }
+    break;
+  default:
+    break;
+  } /* END switch mode */
+  return False;
+} /* END ProcessButtonPress */
 
-  free(heights);
-  free(widths);
+static Bool ProcessButtonRelease(dpy, pDpyInfo, pEv)
+Display  *dpy;
+PDPYINFO pDpyInfo;
+XButtonEvent *pEv;
+{
+  int state;
+  PSHADOW   pShadow;
+  XMotionEvent xmev;
+  unsigned int toButton;
 
-  /* always create propWin for events from toDpy */
-  propWin = XCreateWindow(toDpy, toRoot, 0, 0, 1, 1, 0, 0, InputOutput,
-                          CopyFromParent, 0, NULL);
-  pDpyInfo->toDpyXtra.propWin = propWin;
-  debug("Create window %x on todpy\n", (unsigned int)propWin);
-  /* initialize pointer mapping */
-  RefreshPointerMapping(toDpy, pDpyInfo);
+  if ((pDpyInfo->mode == X2X_CONNECTED) ||
+      (pDpyInfo->mode == X2X_CONN_RELEASE)) {
+    if ((pEv->button <= nButtons) &&
+        (buttonmap[pEv->button][0] == NoSymbol))
+      // Do not process button release if it was mapped to keys
+    {
+      toButton = pDpyInfo->inverseMap[pEv->button];
+      for (pShadow = shadows; pShadow; pShadow = pShadow->pNext) {
+        FakeButton(pShadow, toButton, False);
+        debug("from button %d up, to button %d up\n", pEv->button, toButton);
+        FlushShadow(pShadow);
+      } /* END for */
+      if (doAutoUp)
+        FakeAction(pDpyInfo, FAKE_BUTTON, toButton, False);
+    }
+  } /* END if */
 
-  if (doSel) {
-    pDpyInfo->sDpy = NULL;
-    pDpyInfo->sTime = 0;
+  if (doEdge) return False;
+  if ((pDpyInfo->mode == X2X_AWAIT_RELEASE) ||
+      (pDpyInfo->mode == X2X_CONN_RELEASE)) {
+    /* make sure that all buttons are released */
+    state = pEv->state & (Button1Mask|Button2Mask|Button3Mask|Button4Mask|Button5Mask);
+    switch (pEv->button) {
+    case Button1: state &= ~Button1Mask; break;
+    case Button2: state &= ~Button2Mask; break;
+    case Button3: state &= ~Button3Mask; break;
+    case Button4: state &= ~Button4Mask; break;
+    case Button5: state &= ~Button5Mask; break;
+    default:
+      debug("unknown button %d\n", pEv->button);
+      break;
+    } /* END switch button */
+    if (!state) { /* all buttons up: time to (dis)connect */
+      if (pDpyInfo->mode == X2X_AWAIT_RELEASE) { /* connect */
+        DoConnect(pDpyInfo);
+        if (pDpyInfo->vertical) {
+          xmev.x_root = pDpyInfo->lastCrossCoord = pEv->x_root;
+          xmev.y_root = pDpyInfo->lastFromCoord = pEv->y_root;
+        } else {
+          xmev.x_root = pDpyInfo->lastFromCoord = pEv->x_root;
+          xmev.y_root = pDpyInfo->lastCrossCoord = pEv->y_root;
+        }
+        xmev.serial = pDpyInfo->warpSerial;
+        xmev.same_screen = True;
+        ProcessMotionNotify(NULL, pDpyInfo, &xmev);
+      } else { /* disconnect */
+        DoDisconnect(pDpyInfo);
+      } /* END if mode */
+    } /* END if !state */
+  } /* END if mode */
+  return False;
 
-    pDpyInfo->fromDpyXtra.otherDpy   = toDpy;
-    pDpyInfo->fromDpyXtra.sState     = SELSTATE_OFF;
-#ifdef WIN_2_X
-  if (fromDpy != fromWin) {
-#endif
-    pDpyInfo->fromDpyXtra.pingAtom   = XInternAtom(fromDpy, pingStr, False);
-#ifdef WIN_2_X
-  }
-#endif
-    pDpyInfo->fromDpyXtra.pingInProg = False;
-    pDpyInfo->fromDpyXtra.propWin    = trigger;
-    eventMask |= PropertyChangeMask;
+} /* END ProcessButtonRelease */
 
-    pDpyInfo->toDpyXtra.otherDpy     = fromDpy;
-    pDpyInfo->toDpyXtra.sState       = SELSTATE_OFF;
-    pDpyInfo->toDpyXtra.pingAtom     = XInternAtom(toDpy, pingStr, False);
-    pDpyInfo->toDpyXtra.pingInProg   = False;
-#ifdef WIN_2_X
-    if (fromDpy != fromWin)
-#endif
-      XSelectInput(toDpy, propWin, PropertyChangeMask);
-    XSetSelectionOwner(toDpy, XA_PRIMARY, propWin, CurrentTime);
-#ifdef WIN_2_X
-    debug("SelectionOwner to propWin %x\n", (unsigned int)propWin);
-    pDpyInfo->owntoXsel = 1;
-    pDpyInfo->expectSelNotify = 0;
-    pDpyInfo->expectOwnClip = 0;
-    pDpyInfo->winSSave = 0;
-#endif
-  } /* END if doSel */
+static Bool ProcessKeyEvent(dpy, pDpyInfo, pEv)
+Display  *dpy;
+PDPYINFO pDpyInfo;
+XKeyEvent *pEv;
+{
+  KeyCode   keycode;
+  KeySym    keysym;
+  PSHADOW   pShadow;
+  Bool      bPress;
+  PSTICKY   pSticky;
+  Bool      DoFakeShift = False;
+  KeyCode   toShiftCode;
 
-  if (doResurface) /* get visibility events */
-    eventMask |= VisibilityChangeMask;
+  keysym = XkbKeycodeToKeysym(pDpyInfo->fromDpy, pEv->keycode, 0, 0);
+  bPress = (pEv->type == KeyPress);
 
-#ifdef WIN_2_X
-  if (fromDpy != fromWin) {
-#endif
-  XSelectInput(fromDpy, trigger, eventMask);
-  pDpyInfo->eventMask = eventMask; /* save for future munging */
-  if (doSel) XSetSelectionOwner(fromDpy, XA_PRIMARY, trigger, CurrentTime);
-  XMapRaised(fromDpy, trigger);
-  DrawWindowText(pDpyInfo);
-#ifdef WIN_2_X
-  }
+#ifdef DEBUG
+  printf("key '%s' %s (state=0x%x)\n",
+	XKeysymToString(keysym), (bPress ? "pressed" : "released"), pEv->state);
 #endif
 
-  for (pShadow = shadows; pShadow; pShadow = pShadow->pNext)
-    XTestGrabControl(pShadow->dpy, True); /* impervious to grabs! */
-
-  pDpyInfo->selWinTo = None;
-  pDpyInfo->selRevTo = 0;
-  pDpyInfo->selWinFrom = None;
-  pDpyInfo->selRevFrom = 0;
-  pDpyInfo->signal = 0;
+  /* If CapsLock is on, we need to do some funny business to make sure the */
+  /* "to" display does the right thing */
+  if(doCapsLkHack && (pEv->state & 0x2))
+  {
+    /* Throw away any explicit shift events (they're faked as neccessary) */
+    if((keysym == XK_Shift_L) || (keysym == XK_Shift_R)) return False;
 
-} /* END InitDpyInfo */
+      /* If the shift key is pressed, do the shift, unless the keysym */
+      /* is an alpha key, in which case we invert the shift logic */
+      DoFakeShift = (pEv->state & 0x1);
+      if(((keysym >= XK_A) && (keysym <= XK_Z)) ||
+         ((keysym >= XK_a) && (keysym <= XK_z)))
+        DoFakeShift = !DoFakeShift;
+      debug("DoFakeShift %d\n", DoFakeShift);
+    }
 
-static void DoWakeUp(Display *dpy)
-{
-  CARD16 state;
-  BOOL onoff;
-  int dummy;
+  for (pSticky = stickies; pSticky; pSticky = pSticky->pNext)
+    if (keysym == pSticky->keysym)
+      break;
 
-  if (!DPMSQueryExtension(dpy, &dummy, &dummy))
-    return;
+  if (pSticky) {
+    for (pShadow = shadows; pShadow; pShadow = pShadow->pNext) {
+      toShiftCode = XKeysymToKeycode(pShadow->dpy, XK_Shift_L);
+      if ((keycode = XKeysymToKeycode(pShadow->dpy, keysym))) {
+        if(DoFakeShift) FakeKey(pShadow, toShiftCode, True);
+        FakeKey(pShadow, keycode, True);
+        FakeKey(pShadow, keycode, False);
+        if(DoFakeShift) FakeKey(pShadow, toShiftCode, False);
+	FlushShadow(pShadow);
+	pShadow->flush = False;
+      } /* END if */
+    } /* END for */
+  } else {
+    Bool invert = (pEv->state & 0x2) && (pEv->state & 0x1);
+    for (pShadow = shadows; pShadow; pShadow = pShadow->pNext) {
+      toShiftCode = XKeysymToKeycode(pShadow->dpy, XK_Shift_L);
+      if ((keycode = XKeysymToKeycode(pShadow->dpy, keysym))) {
+	if (invert && toShiftCode)
+	  FakeKey(pShadow, toShiftCode, True);
+	FakeKey(pShadow, keycode, bPress);
+	if (invert && toShiftCode)
+	  FakeKey(pShadow, toShiftCode, False);
+	FlushShadow(pShadow);
+	pShadow->flush = False;
+      } /* END if */
+    } /* END for */
+    if (doAutoUp)
+      FakeAction(pDpyInfo, FAKE_KEY, keysym, bPress);
+  }
 
-  if (!DPMSInfo(dpy, &state, &onoff))
-    return;
+  return False;
 
-  if (!onoff)
-    return;
+} /* END ProcessKeyEvent */
 
-  switch (state) {
-  case DPMSModeOn:
-    return;
-  default:
-    break;
-  }
+static Bool ProcessConfigureNotify(dpy, pDpyInfo, pEv)
+Display  *dpy;
+PDPYINFO pDpyInfo;
+XConfigureEvent *pEv;
+{
+  if (pDpyInfo->fid || pDpyInfo->fontPending) {
+    /* reposition text */
+    pDpyInfo->width = pEv->width;
+    pDpyInfo->height = pEv->height;
+  } /* END if font */
+  return False;
 
-#ifdef DEBUG
-  printf("DMPS Wakup\n");
-#endif
-  DPMSForceLevel(dpy, DPMSModeOn);
-}
+} /* END ProcessConfigureNotify */
 
-/*
- * Be sure that on all displays the same keyboard state
- * is active, therefore check for CapsLock and NumLock,
- * compare, and if required change the state on the
- * shadowed displays.
- */
-static void KeyboardState(Display *dpy)
+static Bool ProcessClientMessage(dpy, pDpyInfo, pEv)
+Display  *dpy;
+PDPYINFO pDpyInfo;
+XClientMessageEvent *pEv;
 {
-  PSHADOW pShadow;
-  XKeyboardState toState;
-
-  XGetKeyboardControl(dpy, &toState);
-#ifdef DEBUG
-  printf("  LED mask = %lx\n", toState.led_mask);
-#endif
+  /* terminate if atoms match! */
+  return ((pEv->message_type == pDpyInfo->wmpAtom) &&
+          (pEv->data.l[0]    == pDpyInfo->wmdwAtom));
 
-  for (pShadow = shadows; pShadow; pShadow = pShadow->pNext) {
-    KeyCode keycode;
-    XKeyboardState shState;
+} /* END ProcessClientMessage */
 
-    XGetKeyboardControl(pShadow->dpy, &shState);
+static Bool ProcessSelectionRequest(dpy, pDpyInfo, pEv)
+Display *dpy;
+PDPYINFO pDpyInfo;
+XSelectionRequestEvent *pEv;
+{
+  PDPYXTRA pDpyXtra = GETDPYXTRA(dpy, pDpyInfo);
+  Display *otherDpy;
+  int     sel;
+  PSELCACHE pCache;
+  PXFER   pXfer;
+  PSELREQ pReq;
 
-    if (toState.led_mask == shState.led_mask)
-      continue;
+    debug("selection request\n");
 
-    pShadow->led_mask = shState.led_mask;
+  if (pEv->property == None) /* obsolete requestor */
+    pEv->property = pEv->target;
 
-    if ((toState.led_mask & 1) != (shState.led_mask & 1) &&
-	(keycode = XKeysymToKeycode(pShadow->dpy, XK_Caps_Lock))) {
-      XTestFakeKeyEvent(pShadow->dpy, keycode, True, 0);
-      XTestFakeKeyEvent(pShadow->dpy, keycode, False, 0);
-      pShadow->flush = True;
+  /* any target goes through, but MULTIPLE would need its parameter
+     property relayed too: bribe me to support it,
+     or send me the code to do it. */
+  sel = SelIndex(pDpyXtra, pEv->selection);
+  if ((sel < 0) ||
+      (pDpyXtra->sState[sel] != SELSTATE_ON) ||
+      (pEv->target == pDpyXtra->multipleAtom)) { /* bad request, punt request */
+    pEv->property = None;
+    SendSelectionNotify(pEv); /* blam! */
+  } else if ((pCache = FindSelCache(pDpyInfo, dpy, sel, pEv->target))) {
+    debug("selection request answered from cache\n");
+    QueueBulk(pDpyInfo, pEv, pCache->type, pCache->format, pCache->pData,
+              pCache->pData->data, pCache->nitems, True);
+  } else {
+    otherDpy = pDpyXtra->otherDpy;
+    /* the same conversion not answered yet takes this requestor along */
+    for (pXfer = pDpyInfo->pXfers; pXfer; pXfer = pXfer->pNext)
+      if ((pXfer->dpy == otherDpy) && (pXfer->sel == sel) &&
+          (pXfer->target == pEv->target) && (pXfer->incr == INCR_NONE))
+        break;
+    if (pXfer) {
+      debug("selection request merged\n");
+      for (pReq = pXfer->pReqs; pReq; pReq = pReq->pNext)
+        if ((pReq->ev.requestor == pEv->requestor) &&
+            (pReq->ev.property == pEv->property))
+          break;
+    } else {
+      pXfer = NewXfer(pDpyInfo, otherDpy, sel, pEv->target);
+      SendPing(otherDpy, GETDPYXTRA(otherDpy, pDpyInfo)); /* get started */
+      pReq = NULL;
     }
-
-    if ((toState.led_mask & 2) != (shState.led_mask & 2) &&
-	(keycode = XKeysymToKeycode(pShadow->dpy, XK_Num_Lock))) {
-      XTestFakeKeyEvent(pShadow->dpy, keycode, True, 0);
-      XTestFakeKeyEvent(pShadow->dpy, keycode, False, 0);
-      pShadow->flush = True;
+    if (!pReq) {
+      pReq = (PSELREQ)xmalloc(sizeof(SELREQ));
+      pReq->pNext = pXfer->pReqs;
+      pXfer->pReqs = pReq;
     }
+    pReq->ev = *pEv; /* a repeated request replaces the first */
+  } /* END if relaySel */
+  return False;
 
-    if (pShadow->flush) {
-      XFlush(pShadow->dpy);
-      pShadow->flush = False;
-    }
-  }
-}
+} /* END ProcessSelectionRequest */
 
-static void RestoreKeyboardState(void)
+static void SendPing(dpy, pDpyXtra)
+Display *dpy;
+PDPYXTRA pDpyXtra;
 {
-  PSHADOW pShadow;
+  if (!(pDpyXtra->pingInProg)) {
+    XChangeProperty(dpy, pDpyXtra->propWin, pDpyXtra->pingAtom, XA_PRIMARY,
+                    8, PropModeAppend, NULL, 0);
+    pDpyXtra->pingInProg = True;
+  } /* END if */
+} /* END SendPing */
 
-  for (pShadow = shadows; pShadow; pShadow = pShadow->pNext) {
-    KeyCode keycode;
-    XKeyboardState shState;
+static Bool ProcessPropertyNotify(dpy, pDpyInfo, pEv)
+Display *dpy;
+PDPYINFO pDpyInfo;
+XPropertyEvent *pEv;
+{
+  PDPYXTRA pDpyXtra = GETDPYXTRA(dpy, pDpyInfo);
+  PXFER    pXfer;
+  PSELREQ  pReq;
+  int      sel;
 
-    XGetKeyboardControl(pShadow->dpy, &shState);
+  debug("property notify\n");
 
-#ifdef DEBUG
-    printf("  LED mask = %lx(%lx)\n", shState.led_mask, pShadow->led_mask);
+#ifdef HAVE_XFIXES
+  if (pDpyXtra->pfDrain && (pEv->window == pDpyXtra->propWin) &&
+      (pEv->atom == pDpyXtra->pfAtoms[PF_PROPERTY]) &&
+      (pEv->state == PropertyNewValue)) {
+    DrainPrefetch(dpy, pDpyInfo);
+    return False;
+  }
 #endif
 
-    if (pShadow->led_mask == shState.led_mask)
+  /* INCR transfers */
+  for (pXfer = pDpyInfo->pXfers; pXfer; pXfer = pXfer->pNext) {
+    if (pXfer->incr == INCR_NONE) {
+      /* reading an INCR property deletes it, and the owner can put up
+         the first chunk before the read is in: StartIncr keeps this */
+      if (pXfer->pRead && (dpy == pXfer->dpy) &&
+          (pEv->window == pDpyXtra->propWin) &&
+          (pEv->atom == pXfer->property) &&
+          (pEv->state == PropertyNewValue)) {
+        pXfer->srcReady = True;
+        return False;
+      }
       continue;
-
-    if ((pShadow->led_mask & 1) != (shState.led_mask & 1) &&
-	(keycode = XKeysymToKeycode(pShadow->dpy, XK_Caps_Lock))) {
-      XTestFakeKeyEvent(pShadow->dpy, keycode, True, 0);
-      XTestFakeKeyEvent(pShadow->dpy, keycode, False, 0);
-      pShadow->flush = True;
     }
-
-    if ((pShadow->led_mask & 2) != (shState.led_mask & 2) &&
-	(keycode = XKeysymToKeycode(pShadow->dpy, XK_Num_Lock))) {
-      XTestFakeKeyEvent(pShadow->dpy, keycode, True, 0);
-      XTestFakeKeyEvent(pShadow->dpy, keycode, False, 0);
-      pShadow->flush = True;
+    if ((pXfer->incr == INCR_SRC) && (dpy == pXfer->dpy) &&
+        (pEv->window == pDpyXtra->propWin) &&
+        (pEv->atom == pXfer->property) && (pEv->state == PropertyNewValue)) {
+      pXfer->srcReady = True;
+      PumpIncr(pDpyInfo, pXfer);
+      return False;
     }
-
-    if (pShadow->flush) {
-      XFlush(pShadow->dpy);
-      pShadow->flush = False;
+    if (pEv->state == PropertyDelete) {
+      for (pReq = pXfer->pReqs; pReq; pReq = pReq->pNext) {
+        if ((dpy == pReq->ev.display) && (pEv->window == pReq->ev.requestor) &&
+            (pEv->atom == pReq->ev.property)) {
+          pReq->dstReady = True;
+          PumpIncr(pDpyInfo, pXfer);
+          return False;
+        }
+      } /* END for pReq */
     }
-  }
-}
-
-static int bad_window_handler(Display *disp, XErrorEvent *err)
-{
-  return 0;
-}
+  } /* END for pXfer */
 
-static void DoDPMSForceLevel(pShadow, level)
-PSHADOW pShadow;
-CARD16 level;
-{
-  /* Do a DPMSForceLevel(), but only if the display supports it */
-  if (pShadow->DPMSstatus == -1) {
-    /* Need to see if this display supports the DPMS extension.
-     * If it doesn't then trying DPMSForceLevel() will display
-     * a spurious error message to stderr.
-     */
-    int t1, t2;
-    if (DPMSQueryExtension(pShadow->dpy, &t1, &t2))
-      pShadow->DPMSstatus = 1;
-    else
-      pShadow->DPMSstatus = 0;
-  }
-  
-  if (pShadow->DPMSstatus != 0)
-    DPMSForceLevel(pShadow->dpy, level);
-}
+  if (pEv->atom == pDpyXtra->pingAtom) { /* acking a ping */
+    pDpyXtra->pingInProg = False;
+    for (sel = 0; sel < N_SELECTIONS; ++sel) {
+      if (pDpyXtra->sState[sel] == SELSTATE_WAIT) {
+        pDpyXtra->sState[sel] = SELSTATE_ON;
+        XSetSelectionOwner(dpy, pDpyXtra->selAtom[sel], pDpyXtra->propWin,
+                           pEv->time);
+      }
+    } /* END for sel */
+    /* start the conversions waiting for a time stamp */
+    for (pXfer = pDpyInfo->pXfers; pXfer; pXfer = pXfer->pNext) {
+      if ((pXfer->dpy == dpy) && (pXfer->time == 0)) {
+        pXfer->time = pEv->time;
+        pXfer->asked = TranslateAtom(pDpyInfo, pDpyXtra->otherDpy,
+                                     pXfer->target);
+        XConvertSelection(dpy, pDpyXtra->selAtom[pXfer->sel], pXfer->asked,
+                          pXfer->property, pDpyXtra->propWin, pEv->time);
+      }
+    } /* END for pXfer */
+  } /* END if ping */
+  return False;
 
-static void DoConnect(pDpyInfo)
+} /* END ProcessPropertyNotify */
+
+static Bool ProcessSelectionNotify(dpy, pDpyInfo, pEv)
+Display *dpy;
 PDPYINFO pDpyInfo;
+XSelectionEvent *pEv;
 {
-  Display *fromDpy = pDpyInfo->fromDpy;
-  Window   trigger = pDpyInfo->trigger;
-  PSHADOW pShadow;
+  PDPYXTRA pDpyXtra = GETDPYXTRA(dpy, pDpyInfo);
+  Display  *otherDpy = pDpyXtra->otherDpy;
+  PXFER    pXfer;
 
-  if (pDpyInfo->signal)
-    return;
+  debug("selection notify\n");
 
-  for (pShadow = shadows; pShadow; pShadow = pShadow->pNext) {
-    DoDPMSForceLevel(pShadow, DPMSModeOn);
-    XFlush(pShadow->dpy);
+#ifdef HAVE_XFIXES
+  if ((pDpyXtra->pfSel >= 0) && (pEv->time == pDpyXtra->pfTime) &&
+      ((pEv->property == pDpyXtra->pfAtoms[PF_PROPERTY]) ||
+       ((pEv->property == None) && (pEv->target == pDpyXtra->pfTarget)))) {
+    ProcessPrefetch(dpy, pDpyInfo, pEv);
+    return False;
   }
-
-  debug("connecting\n");
-  pDpyInfo->mode = X2X_CONNECTED;
-
-#ifdef WIN_2_X
-  assert (fromDpy != fromWin);
 #endif
 
-  XGetInputFocus(fromDpy, &pDpyInfo->selWinFrom, &pDpyInfo->selRevFrom);
-  XSetInputFocus(fromDpy, PointerRoot, 0, CurrentTime);
-  XSync(fromDpy, False);
+  /* corresponding conversion: by its property, or if refused, by what
+     was asked */
+  for (pXfer = pDpyInfo->pXfers; pXfer; pXfer = pXfer->pNext)
+    if ((pXfer->dpy == dpy) && (pXfer->time != 0) &&
+        (pXfer->incr == INCR_NONE) && !pXfer->pRead &&
+        ((pEv->property == pXfer->property) ||
+         ((pEv->property == None) && (pEv->time == pXfer->time) &&
+          (pEv->selection == pDpyXtra->selAtom[pXfer->sel]) &&
+          (pEv->target == pXfer->asked))))
+      break;
+  if (!pXfer)
+    return False;
+
+  /* text the owner does not have as asked, it may have as the other
+     text target: ask for that, ConvertText makes it what was asked */
+  if ((pEv->property == None) &&
+      (pXfer->asked == TranslateAtom(pDpyInfo, otherDpy, pXfer->target)) &&
+      ((pXfer->asked = OtherText(pDpyInfo, dpy, pXfer->asked)) != None)) {
+    debug("owner refused text, asking again\n");
+    XConvertSelection(dpy, pDpyXtra->selAtom[pXfer->sel], pXfer->asked,
+                      pXfer->property, pDpyXtra->propWin, pXfer->time);
+    return False;
+  }
 
-  XFlush(pDpyInfo->toDpy);
+  if (pEv->property == None) { /* refused */
+    XferReply(pDpyInfo, pXfer, None, 0, 0, NULL);
+  } else { /* input goes on while the property comes in */
+    pXfer->srcReady = False;
+    StartRead(pDpyInfo, pXfer, dpy, pEv->requestor, pXfer->property);
+  }
+  return False;
 
-  if (pDpyInfo->selWinTo != None) {
-    Display  *toDpy = pDpyInfo->toDpy;
-    Window selWinTo = pDpyInfo->selWinTo;
-    int    selRevTo = pDpyInfo->selRevTo;
-    XErrorHandler old_handler = XSetErrorHandler(bad_window_handler);
+} /* END ProcessSelectionNotify */
 
-    XSetInputFocus(toDpy, selWinTo, selRevTo, CurrentTime);
-    XSync (toDpy, False);
-    (void) XSetErrorHandler(old_handler);
+/**********
+ * the property the owner converted to is in (type None if it could not
+ * be read): answer the requestors
+ **********/
+static void XferReply(pDpyInfo, pXfer, type, format, nitems, prop)
+PDPYINFO pDpyInfo;
+PXFER    pXfer;
+Atom     type;
+int      format;
+unsigned long nitems;
+unsigned char *prop;
+{
+  Display  *dpy = pXfer->dpy;
+  PDPYXTRA pDpyXtra = GETDPYXTRA(dpy, pDpyInfo);
+  Display  *otherDpy = pDpyXtra->otherDpy;
+  PSELREQ  pReq;
+  Bool     success;
+
+  if ((type == pDpyXtra->incrAtom) && (nitems == 1)) {
+    /* reading deleted the INCR property: the owner starts sending
+       chunks, relay them as INCR as well */
+    StartIncr(pDpyInfo, pXfer, INCR_SRC, *(long *)prop);
+    XFree(prop);
+    return;
   }
+  success = ((type != None)
+             && (format != None)
+             && (nitems != 0)
+             && (prop != None));
+
+  if (success) { /* send bits to the requesting dpy/windows */
+    if ((type == XA_ATOM) && (format == 32)) /* e.g. TARGETS */
+      TranslateAtoms(pDpyInfo, dpy, (Atom *)prop, nitems);
+    type = TranslateAtom(pDpyInfo, dpy, type);
+    if (format == 8)
+      type = ConvertText(pDpyInfo, otherDpy, pXfer->target, type,
+                         &prop, &nitems);
+    pXfer->type   = type;
+    pXfer->format = format;
+    pXfer->pData  = NewSelData(prop);
+    pXfer->nitems = nitems;
+    if (nitems * (format >> 3) > INCR_CHUNK(otherDpy)) {
+      /* too large for one request */
+      StartIncr(pDpyInfo, pXfer, INCR_DST, nitems * (format >> 3));
+      return;
+    }
+    /* the reply goes out as it came in, and into the cache: all of
+       them share it */
+    for (pReq = pXfer->pReqs; pReq; pReq = pReq->pNext)
+      QueueBulk(pDpyInfo, &(pReq->ev), type, format, pXfer->pData, prop,
+                nitems, True);
+    StoreSelCache(pDpyInfo, otherDpy, pXfer->sel, pXfer->target,
+                  pXfer->ownerTime, type, format, pXfer->pData, nitems);
+  } else {
+    if (prop)
+      XFree(prop);
+    for (pReq = pXfer->pReqs; pReq; pReq = pReq->pNext) {
+      pReq->ev.property = None;
+      SendSelectionNotify(&(pReq->ev));
+    }
+  } /* END if success */
+  FreeXfer(pDpyInfo, pXfer);
 
-  for (pShadow = shadows; pShadow; pShadow = pShadow->pNext)
-    DoWakeUp(pShadow->dpy);
+} /* END XferReply */
 
-  if (doAutoUp)
-    KeyboardState(fromDpy);
+#ifdef HAVE_XFIXES
+/**********
+ * read (and delete) a selection property in full, with one request if
+ * it is no larger than size, the expected size in bytes (0 if unknown).
+ * Only for prefetching, which reads no more than prefetchMax.
+ **********/
+static Bool GetSelProperty(dpy, win, property, size,
+                           pType, pFormat, pNItems, pProp)
+Display       *dpy;
+Window        win;
+Atom          property;
+long          size;
+Atom          *pType;
+int           *pFormat;
+unsigned long *pNItems;
+unsigned char **pProp;
+{
+  unsigned long after;
+
+  *pProp = NULL;
+  if (size <= 0) { /* a zero length read tells the size */
+    if (XGetWindowProperty(dpy, win, property, 0L, 0L, False,
+                           AnyPropertyType, pType, pFormat, pNItems, &after,
+                           pProp) != Success)
+      return False;
+    if (*pProp)
+      XFree(*pProp);
+    *pProp = NULL;
+    if (*pType == None)
+      return False;
+    size = after;
+  } /* END if size unknown */
+
+  if (XGetWindowProperty(dpy, win, property, 0L, (size + 3) >> 2, True,
+                         AnyPropertyType, pType, pFormat, pNItems, &after,
+                         pProp) != Success)
+    return False;
+  if (after == 0L) /* got everything */
+    return True;
+
+  /* larger than expected: now the size is known, get everything */
+  size = *pNItems * (*pFormat >> 3) + after;
+  if (*pProp)
+    XFree(*pProp);
+  *pProp = NULL;
+  if ((XGetWindowProperty(dpy, win, property, 0L, (size + 3) >> 2,
+                          True, AnyPropertyType, pType, pFormat, pNItems,
+                          &after, pProp) == Success) && (after == 0L))
+    return True;
+  if (*pProp)
+    XFree(*pProp);
+  *pProp = NULL;
+  return False;
 
-  XSync(fromDpy, False);
+} /* END GetSelProperty */
+#endif /* HAVE_XFIXES */
 
-  if (pDpyInfo->big != None) XMapRaised(fromDpy, pDpyInfo->big);
-  XGrabPointer(fromDpy, trigger, True,
-               PointerMotionMask | ButtonPressMask | ButtonReleaseMask,
-               GrabModeAsync, GrabModeAsync,
-               None, pDpyInfo->grabCursor, CurrentTime);
-  XGrabKeyboard(fromDpy, trigger, True,
-                GrabModeAsync, GrabModeAsync,
-                CurrentTime);
-  XSelectInput(fromDpy, trigger, pDpyInfo->eventMask | PointerMotionMask);
+/**********
+ * index of a relayed selection on a display, -1 if not relayed
+ **********/
+static int SelIndex(pDpyXtra, selection)
+PDPYXTRA pDpyXtra;
+Atom     selection;
+{
+  int sel;
 
-  XSync(fromDpy, False);
+  for (sel = 0; sel < N_SELECTIONS; ++sel)
+    if (pDpyXtra->selAtom[sel] == selection)
+      return sel;
+  return -1;
 
-} /* END DoConnect */
+} /* END SelIndex */
 
-static void DoDisconnect(pDpyInfo)
-PDPYINFO pDpyInfo;
+static PATOMMAP FindAtomMap(pDpyXtra, atom)
+PDPYXTRA pDpyXtra;
+Atom     atom;
 {
-  Display *fromDpy = pDpyInfo->fromDpy;
-  Display   *toDpy = pDpyInfo->toDpy;
-  PDPYXTRA pDpyXtra;
-
-  debug("disconnecting\n");
-  pDpyInfo->mode = X2X_DISCONNECTED;
-#ifdef WIN_2_X
-  assert (fromDpy != fromWin);
-#endif
+  PATOMMAP pMap;
 
-  XGetInputFocus(toDpy, &pDpyInfo->selWinTo, &pDpyInfo->selRevTo);
-  XSetInputFocus(toDpy, PointerRoot, 0, CurrentTime);
-  XSync(toDpy, False);
+  for (pMap = pDpyXtra->atomMap[atom % ATOMMAP_SIZE]; pMap;
+       pMap = pMap->pNext)
+    if (pMap->atom == atom)
+      return pMap;
+  return NULL;
 
-  XFlush(fromDpy);
+} /* END FindAtomMap */
 
-  if (pDpyInfo->selWinFrom != None) {
-    Display  *fromDpy = pDpyInfo->fromDpy;
-    Window selWinFrom = pDpyInfo->selWinFrom;
-    int    selRevFrom = pDpyInfo->selRevFrom;
-    XErrorHandler old_handler = XSetErrorHandler(bad_window_handler);
+static void AddAtomMap(pDpyXtra, atom, otherAtom)
+PDPYXTRA pDpyXtra;
+Atom     atom, otherAtom;
+{
+  PATOMMAP pMap = (PATOMMAP)xmalloc(sizeof(ATOMMAP));
 
-    XSetInputFocus(fromDpy, selWinFrom, selRevFrom, CurrentTime);
-    XSync (fromDpy, False);
-    (void) XSetErrorHandler(old_handler);
-  }
+  pMap->atom      = atom;
+  pMap->otherAtom = otherAtom;
+  pMap->pNext     = pDpyXtra->atomMap[atom % ATOMMAP_SIZE];
+  pDpyXtra->atomMap[atom % ATOMMAP_SIZE] = pMap;
 
-  if (pDpyInfo->big != None) XUnmapWindow(fromDpy, pDpyInfo->big);
-  XUngrabKeyboard(fromDpy, CurrentTime);
-  XUngrabPointer(fromDpy, CurrentTime);
-  XSelectInput(fromDpy, pDpyInfo->trigger, pDpyInfo->eventMask);
+} /* END AddAtomMap */
 
-  if (doSel) {
-    pDpyXtra = GETDPYXTRA(fromDpy, pDpyInfo);
-    if (pDpyXtra->sState == SELSTATE_ON) {
-      XSetSelectionOwner(fromDpy, XA_PRIMARY, pDpyXtra->propWin, CurrentTime);
-    }
-  } /* END if */
+/**********
+ * translate atoms of dpy, in place, to the atoms of the same names on
+ * the other display.  Predefined atoms are equal on every server, the
+ * others are looked up once (in one round trip per display) and cached.
+ **********/
+static void TranslateAtoms(pDpyInfo, dpy, atoms, nAtoms)
+PDPYINFO pDpyInfo;
+Display  *dpy;
+Atom     *atoms;
+int      nAtoms;
+{
+  PDPYXTRA pDpyXtra = GETDPYXTRA(dpy, pDpyInfo);
+  PDPYXTRA pOtherXtra = GETDPYXTRA(pDpyXtra->otherDpy, pDpyInfo);
+  Atom     *misses, *otherAtoms;
+  char     **names;
+  int      counter, miss, nMisses, nNames;
+
+  for (nMisses = counter = 0; counter < nAtoms; ++counter)
+    if ((atoms[counter] > XA_LAST_PREDEFINED) &&
+        !FindAtomMap(pDpyXtra, atoms[counter]))
+      ++nMisses;
+
+  if (nMisses) {
+    misses     = (Atom *)xmalloc(sizeof(Atom) * nMisses);
+    otherAtoms = (Atom *)xmalloc(sizeof(Atom) * nMisses);
+    names      = (char **)xmalloc(sizeof(char *) * nMisses);
+    for (nMisses = counter = 0; counter < nAtoms; ++counter) {
+      if ((atoms[counter] <= XA_LAST_PREDEFINED) ||
+          FindAtomMap(pDpyXtra, atoms[counter]))
+        continue;
+      for (miss = 0; miss < nMisses; ++miss)
+        if (misses[miss] == atoms[counter])
+          break;
+      if (miss == nMisses)
+        misses[nMisses++] = atoms[counter];
+    } /* END for */
 
-  XSync(fromDpy, False);
+    /* names that cannot be had translate to None */
+    XGetAtomNames(dpy, misses, nMisses, names);
+    for (nNames = miss = 0; miss < nMisses; ++miss) {
+      if (names[miss]) {
+        names[nNames] = names[miss];
+        misses[nNames++] = misses[miss];
+      } else {
+        AddAtomMap(pDpyXtra, misses[miss], None);
+      }
+    } /* END for */
+    if (nNames)
+      XInternAtoms(pDpyXtra->otherDpy, names, nNames, False, otherAtoms);
+    for (miss = 0; miss < nNames; ++miss) {
+      debug("atom %s: %lu -> %lu\n", names[miss],
+            (unsigned long)misses[miss], (unsigned long)otherAtoms[miss]);
+      AddAtomMap(pDpyXtra, misses[miss], otherAtoms[miss]);
+      if (!FindAtomMap(pOtherXtra, otherAtoms[miss]))
+        AddAtomMap(pOtherXtra, otherAtoms[miss], misses[miss]);
+      XFree(names[miss]);
+    } /* END for */
+    free(names);
+    free(otherAtoms);
+    free(misses);
+  } /* END if nMisses */
 
-  /* force normal state on to display: */
-  if (doAutoUp) {
-    FakeThingsUp(pDpyInfo);
-    RestoreKeyboardState();
-  }
+  for (counter = 0; counter < nAtoms; ++counter)
+    if (atoms[counter] > XA_LAST_PREDEFINED)
+      atoms[counter] = FindAtomMap(pDpyXtra, atoms[counter])->otherAtom;
 
-} /* END DoDisconnect */
+} /* END TranslateAtoms */
 
-static void RegisterEventHandlers(pDpyInfo)
+static Atom TranslateAtom(pDpyInfo, dpy, atom)
 PDPYINFO pDpyInfo;
+Display  *dpy;
+Atom     atom;
 {
-  Display *fromDpy = pDpyInfo->fromDpy;
-  Window  trigger = pDpyInfo->trigger;
-  Display *toDpy;
-  Window  propWin;
+  TranslateAtoms(pDpyInfo, dpy, &atom, 1);
+  return atom;
 
-#define XSAVECONTEXT(A, B, C, D) XSaveContext(A, B, C, (XPointer)(D))
+} /* END TranslateAtom */
 
-#ifdef WIN_2_X
-  if (fromDpy != fromWin) {
-#endif
-  XSAVECONTEXT(fromDpy, trigger, MotionNotify,    ProcessMotionNotify);
-  XSAVECONTEXT(fromDpy, trigger, Expose,          ProcessExpose);
-  XSAVECONTEXT(fromDpy, trigger, EnterNotify,     ProcessEnterNotify);
-  XSAVECONTEXT(fromDpy, trigger, ButtonPress,     ProcessButtonPress);
-  XSAVECONTEXT(fromDpy, trigger, ButtonRelease,   ProcessButtonRelease);
-  XSAVECONTEXT(fromDpy, trigger, KeyPress,        ProcessKeyEvent);
-  XSAVECONTEXT(fromDpy, trigger, KeyRelease,      ProcessKeyEvent);
-  XSAVECONTEXT(fromDpy, trigger, ConfigureNotify, ProcessConfigureNotify);
-  XSAVECONTEXT(fromDpy, trigger, ClientMessage,   ProcessClientMessage);
-  XSAVECONTEXT(fromDpy, None,    MappingNotify,   ProcessMapping);
+/**********
+ * the other text target of dpy, None for what is not text
+ **********/
+static Atom OtherText(pDpyInfo, dpy, target)
+PDPYINFO pDpyInfo;
+Display  *dpy;
+Atom     target;
+{
+  if (target == XA_STRING)
+    return UTF8_ATOM(dpy, pDpyInfo);
+  if (target == UTF8_ATOM(dpy, pDpyInfo))
+    return XA_STRING;
+  return None;
 
+} /* END OtherText */
 
-  if (doResurface)
-    XSAVECONTEXT(fromDpy, trigger, VisibilityNotify, ProcessVisibility);
-#ifdef WIN_2_X
+/**********
+ * text for a requestor on dpy as the target it asked for: STRING is
+ * Latin-1, UTF8_STRING is UTF-8, whatever the owner sent or said it
+ * sent.  What is not well formed UTF-8 is taken as Latin-1.  Returns
+ * the type, with *pProp and *pNItems replaced if converted (the new
+ * *pProp is freed with XFree too).
+ **********/
+static Atom ConvertText(pDpyInfo, dpy, target, type, pProp, pNItems)
+PDPYINFO pDpyInfo;
+Display  *dpy;
+Atom     target, type; /* of dpy */
+unsigned char **pProp;
+unsigned long *pNItems;
+{
+  unsigned char *text;
+  size_t   len, used;
+  int      kind;
+  long long traced;
+
+  if ((OtherText(pDpyInfo, dpy, target) == None) ||
+      (OtherText(pDpyInfo, dpy, type) == None))
+    return type;
+
+  TRACE_START(traced);
+  len = *pNItems;
+  kind = TextKind(*pProp, len);
+  if ((kind == TEXT_ASCII) ||
+      ((kind == TEXT_UTF8) == (target != XA_STRING))) {
+    TRACE_END(traced, "ConvertText", NULL);
+    return target; /* already is */
   }
-#endif
-
-  toDpy = pDpyInfo->toDpy;
-  propWin = pDpyInfo->toDpyXtra.propWin;
-  XSAVECONTEXT(toDpy, None, MappingNotify, ProcessMapping);
-
-  if (doSel) {
-#ifdef WIN_2_X
-    if (fromDpy != fromWin) {
-#endif
-    XSAVECONTEXT(fromDpy, trigger, SelectionRequest, ProcessSelectionRequest);
-    XSAVECONTEXT(fromDpy, trigger, PropertyNotify,   ProcessPropertyNotify);
-    XSAVECONTEXT(fromDpy, trigger, SelectionNotify,  ProcessSelectionNotify);
-    XSAVECONTEXT(fromDpy, trigger, SelectionClear,   ProcessSelectionClear);
-    XSAVECONTEXT(toDpy,   propWin, SelectionRequest, ProcessSelectionRequest);
-    XSAVECONTEXT(toDpy,   propWin, PropertyNotify,   ProcessPropertyNotify);
-    XSAVECONTEXT(toDpy,   propWin, SelectionNotify,  ProcessSelectionNotify);
-    XSAVECONTEXT(toDpy,   propWin, SelectionClear,   ProcessSelectionClear);
-#ifdef WIN_2_X
-    } else {
-      XSAVECONTEXT(toDpy, propWin, SelectionRequest, ProcessSelectionRequestW);
-      // XSAVECONTEXT(toDpy, propWin, PropertyNotify,  ProcessPropertyNotifyW);
-      XSAVECONTEXT(toDpy, propWin, SelectionNotify,ProcessSelectionNotifyW);
-      XSAVECONTEXT(toDpy, propWin, SelectionClear,   ProcessSelectionClearW);
-    }
-#endif
-  } /* END if doSel */
+  if (kind == TEXT_UTF8) {
+    text = (unsigned char *)xXmalloc(len);
+    len = Utf8ToLatin1(*pProp, len, text, &used);
+  } else {
+    text = (unsigned char *)xXmalloc(2 * len);
+    len = Latin1ToUtf8(*pProp, len, text);
+  }
+  debug("converted %lu bytes of text to %lu\n", *pNItems,
+        (unsigned long)len);
+  XFree(*pProp);
+  *pProp = text;
+  *pNItems = len;
+  TRACE_END(traced, "ConvertText", NULL);
+  return target;
 
-} /* END RegisterEventHandlers */
+} /* END ConvertText */
 
-static Bool ProcessEvent(dpy, pDpyInfo)
-Display  *dpy;
+/**********
+ * the same for a chunk of an INCR transfer from the owner, where only
+ * the type it gives can be gone by.  UTF-8 cut between two chunks
+ * waits for the next one, and is dropped at the end.
+ **********/
+static Atom ConvertChunk(pDpyInfo, pXfer, type, pProp, pNItems)
 PDPYINFO pDpyInfo;
+PXFER    pXfer;
+Atom     type; /* translated */
+unsigned char **pProp;
+unsigned long *pNItems;
 {
-  XEvent    ev;
-  XAnyEvent *pEv = (XAnyEvent *)&ev;
-  HANDLER   handler;
-
-#define XFINDCONTEXT(A, B, C, D) XFindContext(A, B, C, (XPointer *)(D))
+  Display *dpy = GETDPYXTRA(pXfer->dpy, pDpyInfo)->otherDpy;
+  unsigned char *in, *text;
+  size_t  len, used;
+
+  if ((type == None) || (type == pXfer->target) ||
+      (OtherText(pDpyInfo, dpy, pXfer->target) != type))
+    return type;
+  if (*pNItems == 0) { /* the end */
+    pXfer->nCarry = 0;
+    return pXfer->target;
+  }
 
-  XNextEvent(dpy, &ev);
-  handler = 0;
-  if ((!XFINDCONTEXT(dpy, pEv->window, pEv->type, &handler)) ||
-      (!XFINDCONTEXT(dpy, None, pEv->type, &handler))) {
-    /* have handler */
-    return ((*handler)(dpy, pDpyInfo, &ev));
+  if (pXfer->target == XA_STRING) { /* UTF-8 to Latin-1 */
+    len = pXfer->nCarry + *pNItems;
+    in = (unsigned char *)xmalloc(len);
+    memcpy(in, pXfer->carry, pXfer->nCarry);
+    memcpy(in + pXfer->nCarry, *pProp, *pNItems);
+    text = (unsigned char *)xXmalloc(len);
+    len = Utf8ToLatin1(in, len, text, &used);
+    pXfer->nCarry = pXfer->nCarry + *pNItems - used; /* at most 3 */
+    memcpy(pXfer->carry, in + used, pXfer->nCarry);
+    free(in);
   } else {
-    debug("no handler for window 0x%x, event type %d\n",
-           (unsigned int)pEv->window, pEv->type);
-  } /* END if/else */
-
-  return False;
+    text = (unsigned char *)xXmalloc(2 * *pNItems);
+    len = Latin1ToUtf8(*pProp, *pNItems, text);
+  }
+  XFree(*pProp);
+  *pProp = text;
+  *pNItems = len;
+  return pXfer->target;
 
-} /* END ProcessEvent */
+} /* END ConvertChunk */
 
-static Bool ProcessMotionNotify(unused, pDpyInfo, pEv)
-Display  *unused;
+/**********
+ * a transfer property on propWin of dpy no conversion is using
+ **********/
+static Atom XferProperty(pDpyInfo, dpy)
 PDPYINFO pDpyInfo;
-XMotionEvent *pEv; /* caution: might be pseudo-event!!! */
+Display  *dpy;
 {
-  /* Note: ProcessMotionNotify is sometimes called from inside x2x to
-   *       simulate a motion event.  Any new references to pEv fields
-   *       must be checked carefully!
-   */
-
-  int       toScreenNum;
-  PSHADOW   pShadow;
-  int       toCoord, fromCoord, delta;
-  Display   *fromDpy;
-  Bool      bAbortedDisconnect;
-  Bool      vert;
-
-  vert = pDpyInfo->vertical;
-
-  /* find the screen */
-  toScreenNum = pDpyInfo->toScreen;
-  fromCoord = vert ? pEv->y_root : pEv->x_root;
-
-  /* check to make sure the cursor is still on the from screen */
-  if (!(pEv->same_screen)) {
-    toCoord = (pDpyInfo->lastFromCoord < fromCoord) ? COORD_DECR : COORD_INCR;
-  } else {
-    toCoord = (vert?pDpyInfo->yTables:pDpyInfo->xTables)[toScreenNum][fromCoord];
+  PDPYXTRA pDpyXtra = GETDPYXTRA(dpy, pDpyInfo);
+  PXFER    pXfer;
+  Atom     *xferAtoms;
+  char     name[32];
+  int      counter;
+
+  for (counter = 0; counter < pDpyXtra->nXferAtoms; ++counter) {
+    for (pXfer = pDpyInfo->pXfers; pXfer; pXfer = pXfer->pNext)
+      if ((pXfer->dpy == dpy) &&
+          (pXfer->property == pDpyXtra->xferAtoms[counter]))
+        break;
+    if (!pXfer)
+      return pDpyXtra->xferAtoms[counter];
+  } /* END for */
 
-    /* sanity check motion: necessary for nondeterminism surrounding warps */
-    delta = pDpyInfo->lastFromCoord - fromCoord;
-    if (delta < 0) delta = -delta;
-    if (delta > pDpyInfo->unreasonableDelta) return False;
+  /* all in use: one more */
+  xferAtoms = (Atom *)xmalloc(sizeof(Atom) * (counter + 1));
+  if (counter) {
+    memcpy(xferAtoms, pDpyXtra->xferAtoms, sizeof(Atom) * counter);
+    free(pDpyXtra->xferAtoms);
   }
+  sprintf(name, "_X2X_XFER_%d", counter);
+  xferAtoms[counter] = XInternAtom(dpy, name, False);
+  pDpyXtra->xferAtoms = xferAtoms;
+  pDpyXtra->nXferAtoms = counter + 1;
+  return xferAtoms[counter];
 
-  if (SPECIAL_COORD(toCoord) != 0) { /* special coordinate */
-    bAbortedDisconnect = False;
-    if (toCoord == COORD_INCR) {
-      if (toScreenNum != (pDpyInfo->nScreens - 1)) { /* next screen */
-        toScreenNum = ++(pDpyInfo->toScreen);
-        fromCoord = pDpyInfo->fromIncrCoord;
-        toCoord = (vert?pDpyInfo->yTables:pDpyInfo->xTables)[toScreenNum][fromCoord];
-      } else { /* disconnect! */
-        if (doBtnBlock &&
-            (pEv->state & (Button1Mask | Button2Mask | Button3Mask |
-                           Button4Mask | Button5Mask)))
-          bAbortedDisconnect = True;
-        else {
-          DoDisconnect(pDpyInfo);
-          fromCoord = pDpyInfo->fromDiscCoord;
-        }
-        toCoord = (vert?pDpyInfo->yTables:pDpyInfo->xTables)[toScreenNum][pDpyInfo->fromConnCoord];
-      }
-    } else { /* DECR */
-      if (toScreenNum != 0) { /* previous screen */
-        toScreenNum = --(pDpyInfo->toScreen);
-        fromCoord = pDpyInfo->fromDecrCoord;
-        toCoord = (vert?pDpyInfo->yTables:pDpyInfo->xTables)[toScreenNum][fromCoord];
-      } else { /* disconnect! */
-        if (doBtnBlock &&
-            (pEv->state & (Button1Mask | Button2Mask | Button3Mask |
-                           Button4Mask | Button5Mask)))
-          bAbortedDisconnect = True;
-        else {
-          DoDisconnect(pDpyInfo);
-          fromCoord = pDpyInfo->fromDiscCoord;
-        }
-        toCoord = (vert?pDpyInfo->yTables:pDpyInfo->xTables)[toScreenNum][pDpyInfo->fromConnCoord];
-      }
-    } /* END if toCoord */
-    if (!bAbortedDisconnect) {
-      fromDpy = pDpyInfo->fromDpy;
-      XWarpPointer(fromDpy, None, pDpyInfo->root, 0, 0, 0, 0,
-                   vert ? pEv->x_root : fromCoord,
-                   vert ? fromCoord : pEv->y_root);
-      XFlush(fromDpy);
-    }
-  } /* END if SPECIAL_COORD */
-  pDpyInfo->lastFromCoord = fromCoord;
+} /* END XferProperty */
+
+/**********
+ * enter a new conversion in the table, waiting for a time stamp
+ **********/
+static PXFER NewXfer(pDpyInfo, dpy, sel, target)
+PDPYINFO pDpyInfo;
+Display  *dpy;
+int      sel;
+Atom     target;
+{
+  PXFER pXfer, *ppXfer;
+  int   nXfers;
+
+  /* an owner that never answers must not fill the table */
+  for (nXfers = 0, pXfer = pDpyInfo->pXfers; pXfer; pXfer = pXfer->pNext)
+    ++nXfers;
+  if (nXfers >= MAX_XFERS) {
+    for (pXfer = pDpyInfo->pXfers; pXfer; pXfer = pXfer->pNext)
+      if (pXfer->incr == INCR_NONE)
+        break;
+    if (pXfer)
+      CancelXfer(pDpyInfo, pXfer);
+  }
 
-  for (pShadow = shadows; pShadow; pShadow = pShadow->pNext) {
-    if (doDpmsMouse)
-    {
-      DoDPMSForceLevel(pShadow, DPMSModeOn);
+  pXfer = (PXFER)xmalloc(sizeof(XFER));
+  pXfer->dpy       = dpy;
+  pXfer->sel       = sel;
+  pXfer->target    = target;
+  pXfer->property  = XferProperty(pDpyInfo, dpy);
+  pXfer->time      = 0;
+  pXfer->ownerTime = GETDPYXTRA(dpy, pDpyInfo)->ownerTime[sel];
+  pXfer->incr      = INCR_NONE;
+  pXfer->pRead     = NULL;
+  pXfer->pData     = NULL;
+  pXfer->pReqs     = NULL;
+  pXfer->pNext     = NULL;
+  for (ppXfer = &(pDpyInfo->pXfers); *ppXfer; ppXfer = &((*ppXfer)->pNext));
+  *ppXfer = pXfer;
+  return pXfer;
+
+} /* END NewXfer */
+
+static void FreeXfer(pDpyInfo, pXfer)
+PDPYINFO pDpyInfo;
+PXFER    pXfer;
+{
+  PXFER   *ppXfer;
+  PSELREQ pReq;
+
+  for (ppXfer = &(pDpyInfo->pXfers); *ppXfer != pXfer;
+       ppXfer = &((*ppXfer)->pNext));
+  *ppXfer = pXfer->pNext;
+
+  while ((pReq = pXfer->pReqs)) {
+    pXfer->pReqs = pReq->pNext;
+    EndReq(pDpyInfo, pReq, pXfer->incr != INCR_NONE);
+  }
+  if (pXfer->pRead) /* its replies are still to come */
+    pXfer->pRead->pXfer = NULL;
+  ReleaseSelData(pXfer->pData);
+  free(pXfer);
+
+} /* END FreeXfer */
+
+/**********
+ * give up on a conversion
+ **********/
+static void CancelXfer(pDpyInfo, pXfer)
+PDPYINFO pDpyInfo;
+PXFER    pXfer;
+{
+  PSELREQ pReq;
+
+  /* after INCR started, the requestors have their SelectionNotify */
+  if (pXfer->incr == INCR_NONE) {
+    for (pReq = pXfer->pReqs; pReq; pReq = pReq->pNext) {
+      pReq->ev.property = None;
+      SendSelectionNotify(&(pReq->ev)); /* blam! */
     }
+  }
+  FreeXfer(pDpyInfo, pXfer);
 
-#ifdef DEBUG_COMPLREG
-    static unsigned lc;
+} /* END CancelXfer */
 
-    if (lc++ % 10 == 0)
-      debug_cmpreg("sj: Call XTestFakeMotionEvent %d/%d to %d/%d\n",
-                      pEv->x_root,
-                      pEv->y_root,
-                      pDpyInfo->xTables[toScreenNum][pEv->x_root],
-                      pDpyInfo->yTables[toScreenNum][pEv->y_root]);
-#endif
+/**********
+ * answer the requestors with an INCR property and follow their deletes
+ **********/
+static void StartIncr(pDpyInfo, pXfer, incr, size)
+PDPYINFO pDpyInfo;
+PXFER    pXfer;
+int      incr;
+long     size;
+{
+  PSELREQ  pReq;
+  Display  *dpy;
+  PSELDATA pSize;
+
+  debug("INCR transfer of %ld bytes\n", size);
+  pXfer->incr     = incr;
+  if (incr == INCR_SRC) {
+    /* srcReady stays as the read left it: the first chunk may be up
+       already.  Type and format until that chunk tells. */
+    pXfer->type   = pXfer->target;
+    pXfer->format = 8;
+  }
 
-    XTestFakeMotionEvent(pShadow->dpy, toScreenNum,
-                      vert?pDpyInfo->xTables[toScreenNum][pEv->x_root]:toCoord,
-                      vert?toCoord:pDpyInfo->yTables[toScreenNum][pEv->y_root],
-                      0);
-    XFlush(pShadow->dpy);
-    pShadow->flush = False;
+  pSize = NewSelData(xXmalloc(sizeof(long)));
+  *(long *)pSize->data = size;
+  for (pReq = pXfer->pReqs; pReq; pReq = pReq->pNext) {
+    dpy = pReq->ev.display;
+    pReq->dstReady = False;
+    pReq->offset   = 0;
+    XSelectInput(dpy, pReq->ev.requestor, PropertyChangeMask);
+    XSAVECONTEXT(dpy, pReq->ev.requestor, PropertyNotify,
+                 ProcessPropertyNotify);
+    QueueBulk(pDpyInfo, &(pReq->ev), GETDPYXTRA(dpy, pDpyInfo)->incrAtom,
+              32, pSize, pSize->data, 1, True);
   } /* END for */
+  ReleaseSelData(pSize);
 
-  return False;
-
-} /* END ProcessMotionNotify */
+} /* END StartIncr */
 
-static Bool ProcessExpose(dpy, pDpyInfo, pEv)
-Display  *dpy;
+/**********
+ * move the next chunk of an INCR transfer once both sides are ready
+ **********/
+static void PumpIncr(pDpyInfo, pXfer)
 PDPYINFO pDpyInfo;
-XExposeEvent *pEv;
+PXFER    pXfer;
 {
-  XClearWindow(pDpyInfo->fromDpy, pDpyInfo->trigger);
-  DrawWindowText(pDpyInfo);
-  return False;
+  Display  *dpy = pXfer->dpy;
+  PSELREQ  pReq, *ppReq;
+  unsigned long nitems;
+  long long traced;
+
+  TRACE_START(traced); /* only kept if something was moved */
+  if (pXfer->incr == INCR_SRC) {
+    /* every requestor moves at the pace of the slowest */
+    if (!pXfer->srcReady || pXfer->pRead)
+      return;
+    for (pReq = pXfer->pReqs; pReq; pReq = pReq->pNext)
+      if (!pReq->dstReady)
+        return;
+    /* reading the chunk deletes it, which asks the owner for the next:
+       only one chunk is ever held.  XferChunk relays it. */
+    pXfer->srcReady = False;
+    StartRead(pDpyInfo, pXfer, dpy, GETDPYXTRA(dpy, pDpyInfo)->propWin,
+              pXfer->property);
+  } else { /* INCR_DST: every requestor at its own pace */
+    for (ppReq = &(pXfer->pReqs); (pReq = *ppReq);) {
+      if (!pReq->dstReady) {
+        ppReq = &(pReq->pNext);
+        continue;
+      }
+      /* a chunk is read as soon as it is there: it goes whole */
+      nitems = (MIN(INCR_CHUNK(pReq->ev.display), BULK_CHUNK) << 3) /
+        pXfer->format;
+      if (nitems > pXfer->nitems - pReq->offset)
+        nitems = pXfer->nitems - pReq->offset;
+      QueueBulk(pDpyInfo, &(pReq->ev), pXfer->type, pXfer->format,
+                pXfer->pData,
+                pXfer->pData->data + pReq->offset * ITEM_SIZE(pXfer->format),
+                nitems, False);
+      pReq->offset += nitems;
+      pReq->dstReady = False;
+      if (nitems == 0) { /* zero length chunk ends the transfer */
+        *ppReq = pReq->pNext;
+        EndReq(pDpyInfo, pReq, True);
+      } else {
+        ppReq = &(pReq->pNext);
+      }
+    } /* END for */
+    if (!pXfer->pReqs)
+      FreeXfer(pDpyInfo, pXfer);
+  } /* END if INCR_SRC ... else ... */
+  TRACE_END(traced, "PumpIncr", NULL);
 
-} /* END ProcessExpose */
+} /* END PumpIncr */
 
-static void DrawWindowText(pDpyInfo)
+/**********
+ * a chunk of an INCR_SRC transfer is in (format 0 if it could not be
+ * read): relay it to every requestor
+ **********/
+static void XferChunk(pDpyInfo, pXfer, type, format, nitems, prop)
 PDPYINFO pDpyInfo;
+PXFER    pXfer;
+Atom     type;
+int      format;
+unsigned long nitems;
+unsigned char *prop;
 {
-  if (pDpyInfo->fid == 0)
-    return;
+  Display  *dpy = pXfer->dpy;
+  PSELREQ  pReq;
+  PSELDATA pData;
+  unsigned long got;
+  long long traced;
+
+  TRACE_START(traced);
+  if (format != 0) {
+    if ((type == XA_ATOM) && (format == 32))
+      TranslateAtoms(pDpyInfo, dpy, (Atom *)prop, nitems);
+    type = TranslateAtom(pDpyInfo, dpy, type);
+    if (format == 8) {
+      got = nitems;
+      type = ConvertChunk(pDpyInfo, pXfer, type, &prop, &nitems);
+      if (got && !nitems) { /* all of it waits for the next chunk */
+        if (prop)
+          XFree(prop);
+        PumpIncr(pDpyInfo, pXfer); /* which may be there already */
+        return;
+      }
+    }
+    pXfer->type   = type;
+    pXfer->format = format;
+  } else { /* owner went away: end the transfer here */
+    type   = pXfer->type;
+    format = pXfer->format;
+    nitems = 0;
+  }
+  /* one chunk for all of them */
+  pData = prop ? NewSelData(prop) : NULL;
+  for (pReq = pXfer->pReqs; pReq; pReq = pReq->pNext) {
+    QueueBulk(pDpyInfo, &(pReq->ev), type, format, pData, prop, nitems,
+              False);
+    pReq->dstReady = False;
+  }
+  ReleaseSelData(pData);
+  TRACE_END(traced, "XferChunk", NULL);
+  if (nitems == 0) /* zero length chunk ends the transfer */
+    FreeXfer(pDpyInfo, pXfer);
 
-  XDrawImageString(pDpyInfo->fromDpy, pDpyInfo->trigger, pDpyInfo->textGC,
-		   MAX(0,((pDpyInfo->width - pDpyInfo->twidth) / 2)),
-		   MAX(0,((pDpyInfo->height - pDpyInfo->theight) / 2)) +
-		   pDpyInfo->tascent, label, strlen(label));
-}
-static Bool ProcessEnterNotify(dpy, pDpyInfo, pEv)
-Display  *dpy;
+} /* END XferChunk */
+
+/**********
+ * read a property of win on dpy for a conversion, deleting it, without
+ * waiting: PumpReads hands it to XferReply or XferChunk
+ **********/
+static void StartRead(pDpyInfo, pXfer, dpy, win, property)
 PDPYINFO pDpyInfo;
-XCrossingEvent *pEv;
+PXFER    pXfer;
+Display  *dpy;
+Window   win;
+Atom     property;
 {
-  Display *fromDpy = pDpyInfo->fromDpy;
-  XMotionEvent xmev;
+  PPROPREAD pRead;
 
-  if (pEv->x_root < compRegLeft)
-	  pEv->x_root = compRegLeft;
-  if (pEv->x_root > compRegRight)
-	  pEv->x_root = compRegRight;
-  if (pEv->y_root < compRegUp)
-	  pEv->y_root = compRegUp;
-  if (pEv->y_root > compRegLow)
-	  pEv->y_root = compRegLow;
+  pRead = (PPROPREAD)xmalloc(sizeof(PROPREAD));
+  pRead->pDpyInfo = pDpyInfo;
+  pRead->pXfer    = pXfer;
+  pRead->dpy      = dpy;
+  pRead->win      = win;
+  pRead->property = property;
+  pRead->pNext    = pReads;
+  pReads = pRead;
+  pXfer->pRead = pRead;
 
-  if ((pEv->mode == NotifyNormal) &&
-      (pDpyInfo->mode == X2X_DISCONNECTED) && (dpy == pDpyInfo->fromDpy)) {
-    DoConnect(pDpyInfo);
-    if (pDpyInfo->vertical) {
-      XWarpPointer(fromDpy, None, pDpyInfo->root, 0, 0, 0, 0,
-                   pEv->x_root, pDpyInfo->fromConnCoord);
-      xmev.x_root = pEv->x_root;
-      xmev.y_root = pDpyInfo->lastFromCoord = pDpyInfo->fromConnCoord;
-    } else {
-      XWarpPointer(fromDpy, None, pDpyInfo->root, 0, 0, 0, 0,
-                   pDpyInfo->fromConnCoord, pEv->y_root);
-      xmev.x_root = pDpyInfo->lastFromCoord = pDpyInfo->fromConnCoord;
-      xmev.y_root = pEv->y_root;
-    }
-    xmev.same_screen = True;
-    ProcessMotionNotify(NULL, pDpyInfo, &xmev);
-  }  /* END if NotifyNormal... */
-  return False;
+  /* the first slice tells the size, then the others go out */
+  AskSlice(pRead, &(pRead->slices[0]), 0);
+  pRead->asked = BULK_CHUNK;
+  XFlush(dpy);
 
-} /* END ProcessEnterNotify */
+} /* END StartRead */
 
-static Bool ProcessButtonPress(dpy, pDpyInfo, pEv)
-Display  *dpy;
-PDPYINFO pDpyInfo;
-XButtonEvent *pEv;
+/**********
+ * GetProperty of BULK_CHUNK bytes from offset, whose reply goes to
+ * ReadHandler.  Each slice deletes the property, which the server only
+ * does for the one that reaches its end.
+ **********/
+static void AskSlice(pRead, pSlice, offset)
+PPROPREAD pRead;
+SLICE     *pSlice;
+long      offset;
 {
-  int state;
-  PSHADOW   pShadow;
-  unsigned int toButton;
+  Display *dpy = pRead->dpy;
+  xGetPropertyReq *req;
+
+  LockDisplay(dpy);
+  GetReq(GetProperty, req);
+  req->window = pRead->win;
+  req->property = pRead->property;
+  req->type = AnyPropertyType;
+  req->delete = True;
+  req->longOffset = offset;
+  req->longLength = BULK_CHUNK >> 2;
+  pSlice->pRead = pRead;
+  pSlice->seq = dpy->request;
+  pSlice->offset = offset;
+  pSlice->pending = True;
+  pSlice->handler.next = dpy->async_handlers;
+  pSlice->handler.handler = ReadHandler;
+  pSlice->handler.data = (XPointer)pSlice;
+  dpy->async_handlers = &(pSlice->handler);
+  UnlockDisplay(dpy);
+
+} /* END AskSlice */
 
-  KeySym  keysym;
-  KeyCode keycode;
-  int     eventno;
+/**********
+ * take in the reply to a slice, at most BULK_CHUNK bytes to wait for;
+ * called by Xlib as it reads, so no requests here
+ **********/
+static Bool ReadHandler(dpy, rep, buf, len, data)
+Display *dpy;
+xReply  *rep;
+char    *buf;
+int     len;
+XPointer data;
+{
+  SLICE     *pSlice = (SLICE *)data;
+  PPROPREAD pRead = pSlice->pRead;
+  xGetPropertyReply *pRep = (xGetPropertyReply *)rep;
+  unsigned char *pTo = NULL;
+  CARD32 *raw;
+  long   bytes, at, counter;
+
+  if (dpy->last_request_read != pSlice->seq)
+    return False;
+  DeqAsyncHandler(dpy, &(pSlice->handler));
+  pSlice->pending = False;
+  if (rep->generic.type == X_Error) { /* goes to ErrorHandler */
+    pRead->failed = True;
+    return False;
+  }
 
-  switch (pDpyInfo->mode) {
-  case X2X_DISCONNECTED:
-    pDpyInfo->mode = X2X_AWAIT_RELEASE;
-    debug("awaiting button release before connecting\n");
-    break;
-  case X2X_CONNECTED:
-    debug("Got button %d, max is %d (%d)\n", pEv->button, N_BUTTONS, nButtons);
-    if ((pEv->button <= N_BUTTONS) &&
-        (buttonmap[pEv->button][0] != NoSymbol))
-    {
-      debug("Mapped!\n");
-      for (pShadow = shadows; pShadow; pShadow = pShadow->pNext)
-      {
-        debug("Button %d is mapped, sending keys: ", pEv->button);
-        for (eventno = 0;
-             (keysym = buttonmap[pEv->button][eventno]) != NoSymbol;
-             eventno++)
-        {
-          if ((keycode = XKeysymToKeycode(pShadow->dpy, keysym))) {
-            XTestFakeKeyEvent(pShadow->dpy, keycode, True, 0);
-            XTestFakeKeyEvent(pShadow->dpy, keycode, False, 0);
-            XFlush(pShadow->dpy);
-            debug(" (0x%04X)", keycode);
-          }
-          else
-            debug(" (no code)");
-        }
-        debug("\n");
+  bytes = pRep->nItems * (pRep->format >> 3);
+  at = pSlice->offset << 2;
+  if (!pRead->sized) { /* the first, from 0 */
+    pRead->sized  = True;
+    pRead->type   = pRep->propertyType;
+    pRead->format = pRep->format;
+    pRead->size   = bytes + pRep->bytesAfter;
+    if (pRead->format) {
+      pRead->nitems = pRead->size / (pRead->format >> 3);
+      /* with a 0 after it, as from XGetWindowProperty */
+      pRead->data = (unsigned char *)
+        xmalloc(pRead->nitems * ITEM_SIZE(pRead->format) + 1);
+    }
+  }
+  if (!pRead->failed && pRead->data && (pRep->format == pRead->format) &&
+      (at + bytes <= pRead->size))
+    pTo = pRead->data + (at / (pRead->format >> 3)) *
+      ITEM_SIZE(pRead->format);
+  else if (bytes || (pRep->format != pRead->format))
+    pRead->failed = True; /* changed while read: not as ICCCM has it */
+
+  if (pTo && (pRead->format == 32) && (sizeof(long) != 4)) {
+    raw = (CARD32 *)xmalloc(bytes);
+    _XGetAsyncData(dpy, (char *)raw, buf, len, SIZEOF(xReply), bytes,
+                   rep->generic.length << 2);
+    for (counter = 0; counter < (bytes >> 2); ++counter)
+      ((long *)pTo)[counter] = raw[counter];
+    free(raw);
+  } else {
+    _XGetAsyncData(dpy, (char *)pTo, buf, len, SIZEOF(xReply),
+                   pTo ? bytes : 0, rep->generic.length << 2);
+  }
+  return True;
+
+} /* END ReadHandler */
+
+/**********
+ * ask for the next slices of the reads whose replies came in, and hand
+ * over those complete; False if there was nothing to do
+ **********/
+static Bool PumpReads()
+{
+  PPROPREAD pRead, *ppRead;
+  PXFER     pXfer;
+  int       counter, nPending;
+  Bool      asked;
+  Bool      moved = False;
+
+  for (ppRead = &pReads; (pRead = *ppRead);) {
+    nPending = 0;
+    asked = False;
+    for (counter = 0; counter < READ_SLICES; ++counter) {
+      if (!pRead->slices[counter].pending && pRead->pXfer &&
+          pRead->sized && !pRead->failed && (pRead->asked < pRead->size)) {
+        AskSlice(pRead, &(pRead->slices[counter]), pRead->asked >> 2);
+        pRead->asked += BULK_CHUNK;
+        asked = True;
       }
-    } else if (pEv->button <= nButtons) {
-      toButton = pDpyInfo->inverseMap[pEv->button];
-      for (pShadow = shadows; pShadow; pShadow = pShadow->pNext) {
-        XTestFakeButtonEvent(pShadow->dpy, toButton, True, 0);
-        debug("from button %d down, to button %d down\n", pEv->button,toButton);
-        XFlush(pShadow->dpy);
-	pShadow->flush = False;
-      } /* END for */
-      if (doAutoUp)
-        FakeAction(pDpyInfo, FAKE_BUTTON, toButton, True);
+      if (pRead->slices[counter].pending)
+        ++nPending;
+    } /* END for */
+    if (asked) {
+      XFlush(pRead->dpy);
+      moved = True;
+    }
+    if (nPending) {
+      ppRead = &(pRead->pNext);
+      continue;
     }
-    if (doEdge) break;
 
-    /* check if more than one button pressed */
-    state = pEv->state & (Button1Mask|Button2Mask|Button3Mask|Button4Mask|Button5Mask);
-    switch (pEv->button) {
-    case Button1: state &= ~Button1Mask; break;
-    case Button2: state &= ~Button2Mask; break;
-    case Button3: state &= ~Button3Mask; break;
-    case Button4: state &= ~Button4Mask; break;
-    case Button5: state &= ~Button5Mask; break;
-    default:
-      debug("unknown button %d\n", pEv->button);
-      break;
-    } /* END switch button */
-    if (state) { /* then more than one button pressed */
-      debug("awaiting button release before disconnecting\n");
-      pDpyInfo->mode = X2X_CONN_RELEASE;
+    /* all in */
+    *ppRead = pRead->pNext;
+    moved = True;
+    if ((pXfer = pRead->pXfer)) {
+      pXfer->pRead = NULL;
+      if (pRead->failed) {
+        if (pRead->data)
+          free(pRead->data);
+        pRead->data = NULL;
+        pRead->type = None;
+        pRead->format = 0;
+        pRead->nitems = 0;
+      }
+      if (pXfer->incr == INCR_SRC)
+        XferChunk(pRead->pDpyInfo, pXfer, pRead->type, pRead->format,
+                  pRead->nitems, pRead->data);
+      else
+        XferReply(pRead->pDpyInfo, pXfer, pRead->type, pRead->format,
+                  pRead->nitems, pRead->data);
+    } else if (pRead->data) { /* given up */
+      free(pRead->data);
     }
-    break;
-  default:
-    break;
-  } /* END switch mode */
-  return False;
-} /* END ProcessButtonPress */
+    free(pRead);
+  } /* END for */
+  return moved;
 
-static Bool ProcessButtonRelease(dpy, pDpyInfo, pEv)
-Display  *dpy;
+} /* END PumpReads */
+
+/**********
+ * a requestor is done: stop following its window unless another INCR
+ * transfer still goes there
+ **********/
+static void EndReq(pDpyInfo, pReq, following)
 PDPYINFO pDpyInfo;
-XButtonEvent *pEv;
+PSELREQ  pReq;
+Bool     following;
 {
-  int state;
-  PSHADOW   pShadow;
-  XMotionEvent xmev;
-  unsigned int toButton;
+  PXFER   pXfer;
+  PSELREQ pOther;
+
+  if (following) {
+    for (pXfer = pDpyInfo->pXfers; pXfer; pXfer = pXfer->pNext)
+      if (pXfer->incr != INCR_NONE)
+        for (pOther = pXfer->pReqs; pOther; pOther = pOther->pNext)
+          if ((pOther->ev.display == pReq->ev.display) &&
+              (pOther->ev.requestor == pReq->ev.requestor))
+            following = False;
+  }
+  if (following) {
+    XSelectInput(pReq->ev.display, pReq->ev.requestor, NoEventMask);
+    XDeleteContext(pReq->ev.display, pReq->ev.requestor, PropertyNotify);
+  }
+  free(pReq);
 
-  if ((pDpyInfo->mode == X2X_CONNECTED) ||
-      (pDpyInfo->mode == X2X_CONN_RELEASE)) {
-    if ((pEv->button <= nButtons) &&
-        (buttonmap[pEv->button][0] == NoSymbol))
-      // Do not process button release if it was mapped to keys
-    {
-      toButton = pDpyInfo->inverseMap[pEv->button];
-      for (pShadow = shadows; pShadow; pShadow = pShadow->pNext) {
-        XTestFakeButtonEvent(pShadow->dpy, toButton, False, 0);
-        debug("from button %d up, to button %d up\n", pEv->button, toButton);
-        XFlush(pShadow->dpy);
-      } /* END for */
-      if (doAutoUp)
-        FakeAction(pDpyInfo, FAKE_BUTTON, toButton, False);
-    }
-  } /* END if */
+} /* END EndReq */
 
-  if (doEdge) return False;
-  if ((pDpyInfo->mode == X2X_AWAIT_RELEASE) ||
-      (pDpyInfo->mode == X2X_CONN_RELEASE)) {
-    /* make sure that all buttons are released */
-    state = pEv->state & (Button1Mask|Button2Mask|Button3Mask|Button4Mask|Button5Mask);
-    switch (pEv->button) {
-    case Button1: state &= ~Button1Mask; break;
-    case Button2: state &= ~Button2Mask; break;
-    case Button3: state &= ~Button3Mask; break;
-    case Button4: state &= ~Button4Mask; break;
-    case Button5: state &= ~Button5Mask; break;
-    default:
-      debug("unknown button %d\n", pEv->button);
+/**********
+ * write a property for a requestor, and notify it if notify, behind the
+ * input to its display: FlushOutput writes it out a piece at a time.
+ * The items are in pData, which is held until then, not copied.
+ **********/
+static void QueueBulk(pDpyInfo, pEv, type, format, pData, data, nitems,
+                      notify)
+PDPYINFO pDpyInfo;
+XSelectionRequestEvent *pEv;
+Atom     type;
+int      format;
+PSELDATA pData;
+unsigned char *data;
+unsigned long nitems;
+Bool     notify;
+{
+  PDPYXTRA pDpyXtra = GETDPYXTRA(pEv->display, pDpyInfo);
+  PBULK    pBulk;
+
+  pBulk = (PBULK)xmalloc(sizeof(BULK));
+  pBulk->ev     = *pEv;
+  pBulk->type   = type;
+  pBulk->format = format;
+  pBulk->nitems = nitems;
+  pBulk->notify = notify;
+  if (nitems) {
+    pBulk->pData = HoldSelData(pData);
+    pBulk->data  = data;
+  }
+  if (pDpyXtra->pBulk)
+    pDpyXtra->pBulkLast->pNext = pBulk;
+  else
+    pDpyXtra->pBulk = pBulk;
+  pDpyXtra->pBulkLast = pBulk;
+
+} /* END QueueBulk */
+
+/**********
+ * write the next BULK_CHUNK bytes queued for dpy: all of a property the
+ * requestor reads on SelectionNotify, in pieces, or a whole INCR chunk
+ **********/
+static void PumpBulk(pDpyInfo, dpy)
+PDPYINFO pDpyInfo;
+Display  *dpy;
+{
+  PDPYXTRA pDpyXtra = GETDPYXTRA(dpy, pDpyInfo);
+  PBULK    pBulk;
+  unsigned long nitems;
+  long     budget = BULK_CHUNK;
+  long long traced;
+
+  TRACE_START(traced);
+  while ((pBulk = pDpyXtra->pBulk) && (budget > 0)) {
+    nitems = pBulk->nitems - pBulk->offset;
+    if (pBulk->notify && (nitems > (budget << 3) / pBulk->format)) {
+      if ((nitems = (budget << 3) / pBulk->format) == 0)
+        break;
+    }
+    /* the first piece replaces, the others add to it */
+    XChangeProperty(dpy, pBulk->ev.requestor, pBulk->ev.property,
+                    pBulk->type, pBulk->format,
+                    pBulk->offset ? PropModeAppend : PropModeReplace,
+                    pBulk->data + pBulk->offset * ITEM_SIZE(pBulk->format),
+                    nitems);
+    pBulk->offset += nitems;
+    budget -= nitems * (pBulk->format >> 3) + 24; /* request header */
+    if (pBulk->offset < pBulk->nitems)
       break;
-    } /* END switch button */
-    if (!state) { /* all buttons up: time to (dis)connect */
-      if (pDpyInfo->mode == X2X_AWAIT_RELEASE) { /* connect */
-        DoConnect(pDpyInfo);
-        if (pDpyInfo->vertical) {
-          xmev.x_root = pEv->x_root;
-          xmev.y_root = pDpyInfo->lastFromCoord = pEv->y_root;
-        } else {
-          xmev.x_root = pDpyInfo->lastFromCoord = pEv->x_root;
-          xmev.y_root = pEv->y_root;
-        }
-        xmev.same_screen = True;
-        ProcessMotionNotify(NULL, pDpyInfo, &xmev);
-      } else { /* disconnect */
-        DoDisconnect(pDpyInfo);
-      } /* END if mode */
-    } /* END if !state */
-  } /* END if mode */
-  return False;
+    if (pBulk->notify)
+      SendSelectionNotify(&(pBulk->ev));
+    pDpyXtra->pBulk = pBulk->pNext;
+    ReleaseSelData(pBulk->pData);
+    free(pBulk);
+  } /* END while */
+  XFlush(dpy);
+  TRACE_END(traced, "PumpBulk", DisplayString(dpy));
+
+} /* END PumpBulk */
+
+/**********
+ * selection data taking data (from Xlib or xXmalloc) over, held once
+ **********/
+static PSELDATA NewSelData(data)
+unsigned char *data;
+{
+  PSELDATA pData;
+
+  pData = (PSELDATA)xmalloc(sizeof(SELDATA));
+  pData->refs = 1;
+  pData->data = data;
+  return pData;
+
+} /* END NewSelData */
+
+static PSELDATA HoldSelData(pData)
+PSELDATA pData;
+{
+  if (pData)
+    ++(pData->refs);
+  return pData;
+
+} /* END HoldSelData */
+
+static void ReleaseSelData(pData)
+PSELDATA pData;
+{
+  if (pData && (--(pData->refs) == 0)) {
+    XFree(pData->data);
+    free(pData);
+  }
 
-} /* END ProcessButtonRelease */
+} /* END ReleaseSelData */
 
-static Bool ProcessKeyEvent(dpy, pDpyInfo, pEv)
-Display  *dpy;
+/**********
+ * selection cache: conversions are kept per requesting display,
+ * selection, target and timestamp of the owner on the other display,
+ * which is only known with XFixes.  Only what fits one request is kept.
+ **********/
+static PSELCACHE FindSelCache(pDpyInfo, dpy, sel, target)
 PDPYINFO pDpyInfo;
-XKeyEvent *pEv;
+Display  *dpy;
+int      sel;
+Atom     target;
 {
-  KeyCode   keycode;
-  KeySym    keysym;
-  PSHADOW   pShadow;
-  Bool      bPress;
-  PSTICKY   pSticky;
-  Bool      DoFakeShift = False;
-  KeyCode   toShiftCode;
-
-  keysym = XkbKeycodeToKeysym(pDpyInfo->fromDpy, pEv->keycode, 0, 0);
-  bPress = (pEv->type == KeyPress);
-
-#ifdef DEBUG
-  printf("key '%s' %s (state=0x%x)\n",
-	XKeysymToString(keysym), (bPress ? "pressed" : "released"), pEv->state);
-#endif
+  Time      ownerTime;
+  PSELCACHE pCache, *ppCache;
 
-  /* If CapsLock is on, we need to do some funny business to make sure the */
-  /* "to" display does the right thing */
-  if(doCapsLkHack && (pEv->state & 0x2))
-  {
-    /* Throw away any explicit shift events (they're faked as neccessary) */
-    if((keysym == XK_Shift_L) || (keysym == XK_Shift_R)) return False;
+  ownerTime = GETDPYXTRA(GETDPYXTRA(dpy, pDpyInfo)->otherDpy,
+                         pDpyInfo)->ownerTime[sel];
+  if (ownerTime == 0)
+    return NULL;
 
-      /* If the shift key is pressed, do the shift, unless the keysym */
-      /* is an alpha key, in which case we invert the shift logic */
-      DoFakeShift = (pEv->state & 0x1);
-      if(((keysym >= XK_A) && (keysym <= XK_Z)) ||
-         ((keysym >= XK_a) && (keysym <= XK_z)))
-        DoFakeShift = !DoFakeShift;
-      debug("DoFakeShift %d\n", DoFakeShift);
+  for (ppCache = &(pDpyInfo->pSelCache); (pCache = *ppCache);
+       ppCache = &(pCache->pNext)) {
+    if ((pCache->dpy == dpy) && (pCache->sel == sel) &&
+        (pCache->target == target) && (pCache->ownerTime == ownerTime)) {
+      /* move to front */
+      *ppCache = pCache->pNext;
+      pCache->pNext = pDpyInfo->pSelCache;
+      pDpyInfo->pSelCache = pCache;
+      return pCache;
     }
+  } /* END for */
+  return NULL;
 
-  for (pSticky = stickies; pSticky; pSticky = pSticky->pNext)
-    if (keysym == pSticky->keysym)
-      break;
-
-  if (pSticky) {
-    for (pShadow = shadows; pShadow; pShadow = pShadow->pNext) {
-      toShiftCode = XKeysymToKeycode(pShadow->dpy, XK_Shift_L);
-      if ((keycode = XKeysymToKeycode(pShadow->dpy, keysym))) {
-        if(DoFakeShift) XTestFakeKeyEvent(pShadow->dpy, toShiftCode, True, 0);
-        XTestFakeKeyEvent(pShadow->dpy, keycode, True, 0);
-        XTestFakeKeyEvent(pShadow->dpy, keycode, False, 0);
-        if(DoFakeShift) XTestFakeKeyEvent(pShadow->dpy, toShiftCode, False, 0);
-	XFlush(pShadow->dpy);
-	pShadow->flush = False;
-      } /* END if */
-    } /* END for */
-  } else {
-    Bool invert = (pEv->state & 0x2) && (pEv->state & 0x1);
-    for (pShadow = shadows; pShadow; pShadow = pShadow->pNext) {
-      toShiftCode = XKeysymToKeycode(pShadow->dpy, XK_Shift_L);
-      if ((keycode = XKeysymToKeycode(pShadow->dpy, keysym))) {
-	if (invert && toShiftCode)
-	  XTestFakeKeyEvent(pShadow->dpy, toShiftCode, True, 0);
-	XTestFakeKeyEvent(pShadow->dpy, keycode, bPress, 0);
-	if (invert && toShiftCode)
-	  XTestFakeKeyEvent(pShadow->dpy, toShiftCode, False, 0);
-	XFlush(pShadow->dpy);
-	pShadow->flush = False;
-      } /* END if */
-    } /* END for */
-    if (doAutoUp)
-      FakeAction(pDpyInfo, FAKE_KEY, keysym, bPress);
-  }
+} /* END FindSelCache */
 
-  return False;
+/**********
+ * the cache holds pData as it is if it takes it
+ **********/
+static Bool StoreSelCache(pDpyInfo, dpy, sel, target, ownerTime,
+                          type, format, pData, nitems)
+PDPYINFO      pDpyInfo;
+Display       *dpy;
+int           sel;
+Atom          target;
+Time          ownerTime;
+Atom          type;
+int           format;
+PSELDATA      pData;
+unsigned long nitems;
+{
+  PSELCACHE pCache, *ppCache;
+  long      size;
+
+  size = nitems * ITEM_SIZE(format);
+  if ((ownerTime == 0) ||
+      ((long)(size + sizeof(SELCACHE)) > selCacheMax) ||
+      (nitems * (format >> 3) > INCR_CHUNK(dpy)))
+    return False;
+  if (FindSelCache(pDpyInfo, dpy, sel, target))
+    return False; /* concurrent request */
+
+  pCache = (PSELCACHE)xmalloc(sizeof(SELCACHE));
+  pCache->dpy       = dpy;
+  pCache->sel       = sel;
+  pCache->target    = target;
+  pCache->ownerTime = ownerTime;
+  pCache->type      = type;
+  pCache->format    = format;
+  pCache->nitems    = nitems;
+  pCache->pData     = HoldSelData(pData);
+  pCache->size      = size + sizeof(SELCACHE);
+
+  /* least recently used go first */
+  pDpyInfo->selCacheSize += pCache->size;
+  while (pDpyInfo->selCacheSize > selCacheMax) {
+    for (ppCache = &(pDpyInfo->pSelCache); (*ppCache)->pNext;
+         ppCache = &((*ppCache)->pNext));
+    pDpyInfo->selCacheSize -= (*ppCache)->size;
+    ReleaseSelData((*ppCache)->pData);
+    free(*ppCache);
+    *ppCache = NULL;
+  } /* END while */
+  pCache->pNext = pDpyInfo->pSelCache;
+  pDpyInfo->pSelCache = pCache;
+  return True;
 
-} /* END ProcessKeyEvent */
+} /* END StoreSelCache */
 
-static Bool ProcessConfigureNotify(dpy, pDpyInfo, pEv)
-Display  *dpy;
+/**********
+ * drop what was cached for a selection on dpy, except for the given
+ * owner time
+ **********/
+static void DropSelCache(pDpyInfo, dpy, sel, ownerTime)
 PDPYINFO pDpyInfo;
-XConfigureEvent *pEv;
+Display  *dpy;
+int      sel;
+Time     ownerTime;
 {
-  if (pDpyInfo->fid) {
-    /* reposition text */
-    pDpyInfo->width = pEv->width;
-    pDpyInfo->height = pEv->height;
-  } /* END if font */
-  return False;
+  PSELCACHE pCache, *ppCache;
+
+  for (ppCache = &(pDpyInfo->pSelCache); (pCache = *ppCache);) {
+    if ((pCache->dpy == dpy) && (pCache->sel == sel) &&
+        ((ownerTime == 0) || (pCache->ownerTime != ownerTime))) {
+      *ppCache = pCache->pNext;
+      pDpyInfo->selCacheSize -= pCache->size;
+      ReleaseSelData(pCache->pData);
+      free(pCache);
+    } else {
+      ppCache = &(pCache->pNext);
+    }
+  } /* END for */
 
-} /* END ProcessConfigureNotify */
+} /* END DropSelCache */
 
-static Bool ProcessClientMessage(dpy, pDpyInfo, pEv)
+#ifdef HAVE_XFIXES
+/**********
+ * have XFixes report every change of owner of the relayed selections
+ **********/
+static void SelectSelectionOwner(dpy, pDpyInfo)
 Display  *dpy;
 PDPYINFO pDpyInfo;
-XClientMessageEvent *pEv;
 {
-  /* terminate if atoms match! */
-  return ((pEv->message_type == pDpyInfo->wmpAtom) &&
-          (pEv->data.l[0]    == pDpyInfo->wmdwAtom));
-
-} /* END ProcessClientMessage */
+  PDPYXTRA pDpyXtra = GETDPYXTRA(dpy, pDpyInfo);
+  int      fixesEvent, fixesError;
+  int      sel;
 
-static Bool ProcessSelectionRequest(dpy, pDpyInfo, pEv)
-Display *dpy;
+  if (!XFixesQueryExtension(dpy, &fixesEvent, &fixesError))
+    return;
+  if (prefetchMax > 0)
+    XInternAtoms(dpy, pfAtomNames, N_PFATOMS, False, pDpyXtra->pfAtoms);
+  for (sel = 0; sel < N_SELECTIONS; ++sel)
+    XFixesSelectSelectionInput(dpy, XDefaultRootWindow(dpy),
+                               pDpyXtra->selAtom[sel],
+                               XFixesSetSelectionOwnerNotifyMask);
+  XSAVECONTEXT(dpy, None, fixesEvent + XFixesSelectionNotify,
+               ProcessSelectionOwner);
+
+} /* END SelectSelectionOwner */
+
+static Bool ProcessSelectionOwner(dpy, pDpyInfo, pEv)
+Display  *dpy;
 PDPYINFO pDpyInfo;
-XSelectionRequestEvent *pEv;
+XFixesSelectionNotifyEvent *pEv;
 {
   PDPYXTRA pDpyXtra = GETDPYXTRA(dpy, pDpyInfo);
-  Display *otherDpy;
-  Atom utf8string;
-
-  if (dpy == pDpyInfo->fromDpy) {
-    utf8string = pDpyInfo->fromDpyUtf8String;
-  } else {
-    utf8string = pDpyInfo->toDpyUtf8String;
-  }
-
-    debug("selection request\n");
-
-  /* bribe me to support more general selection requests,
-     or send me the code to do it. */
-  if ((pDpyXtra->sState != SELSTATE_ON) ||
-      (pEv->selection != XA_PRIMARY) ||
-      (pEv->target > XA_LAST_PREDEFINED && pEv->target != utf8string)) { /* bad request, punt request */
-    pEv->property = None;
-    SendSelectionNotify(pEv); /* blam! */
-  } else {
-    otherDpy = pDpyXtra->otherDpy;
-    SendPing(otherDpy, GETDPYXTRA(otherDpy, pDpyInfo)); /* get started */
-    if (pDpyInfo->sDpy) {
-      /* nuke the old one */
-      pDpyInfo->sEv.property = None;
-      SendSelectionNotify(&(pDpyInfo->sEv)); /* blam! */
-    } /* END if InProg */
-    pDpyInfo->sDpy  = otherDpy;
-    pDpyInfo->sEv = *pEv;
-  } /* END if relaySel */
+  int      sel;
+
+  if ((sel = SelIndex(pDpyXtra, pEv->selection)) < 0)
+    return False;
+  debug("selection owner %lx since %lu\n", (unsigned long)pEv->owner,
+        (unsigned long)pEv->selection_timestamp);
+
+  /* what the other display got from the previous owner is stale */
+  pDpyXtra->ownerTime[sel] =
+    (pEv->owner == None) ? 0 : pEv->selection_timestamp;
+  DropSelCache(pDpyInfo, pDpyXtra->otherDpy, sel, pDpyXtra->ownerTime[sel]);
+
+  if ((prefetchMax > 0) && (pEv->owner != None) &&
+      (pEv->owner != pDpyXtra->propWin))
+    StartPrefetch(dpy, pDpyInfo, sel, pEv->timestamp);
+  else if (pDpyXtra->pfSel == sel)
+    pDpyXtra->pfSel = -1; /* late replies get ignored */
   return False;
 
-} /* END ProcessSelectionRequest */
+} /* END ProcessSelectionOwner */
 
-static void SendPing(dpy, pDpyXtra)
-Display *dpy;
-PDPYXTRA pDpyXtra;
+/**********
+ * convert a new selection to every target it offers (up to prefetchMax
+ * bytes each) into the cache, so pastes on the other display are
+ * answered from memory.  Conversions go one after the other; a new
+ * owner restarts the round.
+ **********/
+static void StartPrefetch(dpy, pDpyInfo, sel, time)
+Display  *dpy;
+PDPYINFO pDpyInfo;
+int      sel;
+Time     time;
 {
-  if (!(pDpyXtra->pingInProg)) {
-    XChangeProperty(dpy, pDpyXtra->propWin, pDpyXtra->pingAtom, XA_PRIMARY,
-                    8, PropModeAppend, NULL, 0);
-    pDpyXtra->pingInProg = True;
-  } /* END if */
-} /* END SendPing */
+  PDPYXTRA pDpyXtra = GETDPYXTRA(dpy, pDpyInfo);
 
-static Bool ProcessPropertyNotify(dpy, pDpyInfo, pEv)
-Display *dpy;
+  debug("prefetching selection %d\n", sel);
+  if (pDpyXtra->pfTargets)
+    free(pDpyXtra->pfTargets);
+  pDpyXtra->pfTargets   = NULL;
+  pDpyXtra->pfNTargets  = pDpyXtra->pfNext = 0;
+  pDpyXtra->pfDrain     = False;
+  pDpyXtra->pfSel       = sel;
+  pDpyXtra->pfTime      = time;
+  pDpyXtra->pfOwnerTime = pDpyXtra->ownerTime[sel];
+  pDpyXtra->pfTarget    = pDpyXtra->pfAtoms[PF_TARGETS];
+  XConvertSelection(dpy, pDpyXtra->selAtom[sel], pDpyXtra->pfTarget,
+                    pDpyXtra->pfAtoms[PF_PROPERTY], pDpyXtra->propWin, time);
+
+} /* END StartPrefetch */
+
+static void ProcessPrefetch(dpy, pDpyInfo, pEv)
+Display  *dpy;
 PDPYINFO pDpyInfo;
-XPropertyEvent *pEv;
+XSelectionEvent *pEv;
 {
-  Atom target;
   PDPYXTRA pDpyXtra = GETDPYXTRA(dpy, pDpyInfo);
+  Atom     property = pDpyXtra->pfAtoms[PF_PROPERTY];
+  Atom     type;
+  int      format;
+  unsigned long nitems, after;
+  unsigned char *prop;
+  PSELDATA pData;
+
+  /* a zero length read tells type and size without fetching: an INCR
+     answer or a large one is left to be fetched on demand, and the
+     transfer abandoned */
+  if ((pEv->property != None) &&
+      (XGetWindowProperty(dpy, pDpyXtra->propWin, property, 0L, 0L, False,
+                          AnyPropertyType, &type, &format, &nitems, &after,
+                          &prop) == Success)) {
+    if (prop)
+      XFree(prop);
+    if (type == pDpyXtra->incrAtom) {
+      /* the owner waits for the deletion of each chunk, and the next
+         conversion into property waits until it is done */
+      debug("prefetch drains an INCR answer\n");
+      XDeleteProperty(dpy, pDpyXtra->propWin, property);
+      pDpyXtra->pfDrain = True;
+      return;
+    }
+    if ((type != None) && ((long)after > prefetchMax)) {
+      XDeleteProperty(dpy, pDpyXtra->propWin, property); /* not kept */
+    } else if ((type != None) &&
+               GetSelProperty(dpy, pDpyXtra->propWin, property, (long)after,
+                              &type, &format, &nitems, &prop)) {
+      if ((pEv->target == pDpyXtra->pfAtoms[PF_TARGETS]) &&
+          (type == XA_ATOM) && (format == 32) && !pDpyXtra->pfTargets) {
+        pDpyXtra->pfTargets = (Atom *)xmalloc(sizeof(Atom) * nitems);
+        memcpy(pDpyXtra->pfTargets, prop, sizeof(Atom) * nitems);
+        pDpyXtra->pfNTargets = nitems;
+      }
+      if ((nitems != 0) && (prop != NULL)) {
+        if ((type == XA_ATOM) && (format == 32))
+          TranslateAtoms(pDpyInfo, dpy, (Atom *)prop, nitems);
+        pData = NewSelData(prop);
+        StoreSelCache(pDpyInfo, pDpyXtra->otherDpy, pDpyXtra->pfSel,
+                      TranslateAtom(pDpyInfo, dpy, pEv->target),
+                      pDpyXtra->pfOwnerTime,
+                      TranslateAtom(pDpyInfo, dpy, type), format,
+                      pData, nitems);
+        ReleaseSelData(pData); /* the cache may have it */
+      } else if (prop) {
+        XFree(prop);
+      }
+    } /* END if small enough */
+  } /* END if converted */
 
-  debug("property notify\n");
-
-  if (pEv->atom == pDpyXtra->pingAtom) { /* acking a ping */
-    pDpyXtra->pingInProg = False;
-    if (pDpyXtra->sState == SELSTATE_WAIT) {
-      pDpyXtra->sState = SELSTATE_ON;
-      XSetSelectionOwner(dpy, XA_PRIMARY, pDpyXtra->propWin, pEv->time);
-      XSync(dpy, False);
-    } else if (dpy == pDpyInfo->sDpy) {
-      if (pDpyInfo->sTime == pEv->time) {
-        /* oops, need to ensure uniqueness */
-        SendPing(dpy, pDpyXtra); /* try for another time stamp */
-      } else {
-        target = pDpyInfo->sEv.target;
-        if (dpy == pDpyInfo->fromDpy && target == pDpyInfo->toDpyUtf8String) {
-          target = pDpyInfo->fromDpyUtf8String;
-        } else if (dpy == pDpyInfo->toDpy && target == pDpyInfo->fromDpyUtf8String) {
-          target = pDpyInfo->toDpyUtf8String;
-        }
-
-        pDpyInfo->sTime = pEv->time;
-        XConvertSelection(dpy, pDpyInfo->sEv.selection, target,
-                          XA_PRIMARY, pDpyXtra->propWin, pEv->time);
-      } /* END if ... ensure uniqueness */
-    } /* END if sState... */
-  } /* END if ping */
-  return False;
+  NextPrefetch(dpy, pDpyInfo);
 
-} /* END ProcessPropertyNotify */
+} /* END ProcessPrefetch */
 
-static Bool ProcessSelectionNotify(dpy, pDpyInfo, pEv)
-Display *dpy;
+/**********
+ * a chunk of an abandoned INCR answer: deleted unread.  The empty one
+ * at the end frees the property for the next target.
+ **********/
+static void DrainPrefetch(dpy, pDpyInfo)
+Display  *dpy;
 PDPYINFO pDpyInfo;
-XSelectionEvent *pEv;
 {
-  Atom type;
-  int  format;
+  PDPYXTRA pDpyXtra = GETDPYXTRA(dpy, pDpyInfo);
+  Atom     property = pDpyXtra->pfAtoms[PF_PROPERTY];
+  Atom     type;
+  int      format;
   unsigned long nitems, after;
   unsigned char *prop;
-  Bool success;
-  XSelectionRequestEvent *pSelReq;
-  Atom utf8string;
 
-#define DEFAULT_PROP_SIZE 1024L
+  if (XGetWindowProperty(dpy, pDpyXtra->propWin, property, 0L, 0L, False,
+                         AnyPropertyType, &type, &format, &nitems, &after,
+                         &prop) != Success)
+    return;
+  if (prop)
+    XFree(prop);
+  XDeleteProperty(dpy, pDpyXtra->propWin, property);
+  if ((type != None) && (after != 0))
+    return;
+  pDpyXtra->pfDrain = False;
+  if (pDpyXtra->pfSel >= 0)
+    NextPrefetch(dpy, pDpyInfo);
 
-  debug("selection notify\n");
+} /* END DrainPrefetch */
 
-  if (dpy == pDpyInfo->fromDpy) {
-    utf8string = pDpyInfo->fromDpyUtf8String;
+/**********
+ * on to the next target worth having, or done
+ **********/
+static void NextPrefetch(dpy, pDpyInfo)
+Display  *dpy;
+PDPYINFO pDpyInfo;
+{
+  PDPYXTRA pDpyXtra = GETDPYXTRA(dpy, pDpyInfo);
+  Atom     target;
+  int      counter;
+
+  for (; pDpyXtra->pfNext < pDpyXtra->pfNTargets; ++(pDpyXtra->pfNext)) {
+    target = pDpyXtra->pfTargets[pDpyXtra->pfNext];
+    for (counter = PF_TARGETS; counter < N_PFATOMS; ++counter)
+      if (target == pDpyXtra->pfAtoms[counter])
+        break;
+    if (counter == N_PFATOMS)
+      break;
+  } /* END for */
+  if (pDpyXtra->pfNext < pDpyXtra->pfNTargets) {
+    pDpyXtra->pfTarget = pDpyXtra->pfTargets[(pDpyXtra->pfNext)++];
+    XConvertSelection(dpy, pDpyXtra->selAtom[pDpyXtra->pfSel],
+                      pDpyXtra->pfTarget, pDpyXtra->pfAtoms[PF_PROPERTY],
+                      pDpyXtra->propWin, pDpyXtra->pfTime);
   } else {
-    utf8string = pDpyInfo->toDpyUtf8String;
+    debug("prefetch done\n");
+    pDpyXtra->pfSel = -1;
   }
 
-  if ((dpy == pDpyInfo->sDpy) && (pDpyInfo->sTime == pEv->time)) {
-    success = False;
-    /* corresponding select */
-    if (XGetWindowProperty(dpy, pEv->requestor, XA_PRIMARY, 0L,
-                           DEFAULT_PROP_SIZE, True, AnyPropertyType,
-                           &type, &format, &nitems, &after, &prop)
-        == Success) { /* got property */
-      if ((type != None)
-          && (format != None)
-          && (nitems != 0)
-          && (prop != None)
-          /* known type */
-          && (type <= XA_LAST_PREDEFINED || type == utf8string)) {
-        if (after == 0L) { /* got everything */
-          success = True;
-        } else { /* try to get everything */
-          XFree(prop);
-          success =
-            ((XGetWindowProperty(dpy, pEv->requestor, XA_PRIMARY, 0L,
-                                 DEFAULT_PROP_SIZE + after + 1,
-                                 True, AnyPropertyType,
-                                 &type, &format, &nitems, &after, &prop)
-              == Success) &&
-             (type != None) && (format != None) && (nitems != 0) &&
-             (after == 0L) && (prop != None));
-        } /* END if got everything ... else ...*/
-      } /* END if known type */
-    } /* END if got property */
-
-    pSelReq = &(pDpyInfo->sEv);
-    if (success) { /* send bits to the requesting dpy/window */
-      if (type == utf8string) {
-        if (dpy == pDpyInfo->fromDpy) {
-          type = pDpyInfo->toDpyUtf8String;
-        } else {
-          type = pDpyInfo->fromDpyUtf8String;
-        }
-      }
-      XChangeProperty(pSelReq->display, pSelReq->requestor,
-                      pSelReq->property, type, format, PropModeReplace,
-                      prop, nitems);
-      XFree(prop);
-      SendSelectionNotify(pSelReq);
-    } else {
-      pSelReq->property = None;
-      SendSelectionNotify(pSelReq);
-    } /* END if success */
-    pDpyInfo->sDpy = NULL;
-  } /* END if corresponding select */
-  return False;
-
-} /* END ProcessSelectionNotify */
+} /* END NextPrefetch */
+#endif /* HAVE_XFIXES */
 
 static void SendSelectionNotify(pSelReq)
 XSelectionRequestEvent *pSelReq;
@@ -2482,23 +6927,28 @@ XSelectionClearEvent *pEv;
 {
   Display  *otherDpy;
   PDPYXTRA pDpyXtra, pOtherXtra;
+  PXFER    pXfer, pNext;
+  int      sel;
 
   debug("selection clear\n");
 
-  if (pEv->selection == XA_PRIMARY) {
-    /* track primary selection */
-    pDpyXtra = GETDPYXTRA(dpy, pDpyInfo);
-    pDpyXtra->sState = SELSTATE_OFF;
+  pDpyXtra = GETDPYXTRA(dpy, pDpyInfo);
+  if ((sel = SelIndex(pDpyXtra, pEv->selection)) >= 0) {
+    /* track relayed selection */
+    pDpyXtra->sState[sel] = SELSTATE_OFF;
+    DropSelCache(pDpyInfo, dpy, sel, 0); /* not ours to answer anymore */
     otherDpy = pDpyXtra->otherDpy;
     pOtherXtra = GETDPYXTRA(otherDpy, pDpyInfo);
-    pOtherXtra->sState = SELSTATE_WAIT;
+    pOtherXtra->sState[sel] = SELSTATE_WAIT;
     SendPing(otherDpy, pOtherXtra);
-    if (pDpyInfo->sDpy) { /* nuke the selection in progress */
-      pDpyInfo->sEv.property = None;
-      SendSelectionNotify(&(pDpyInfo->sEv)); /* blam! */
-      pDpyInfo->sDpy = NULL;
-    } /* END if nuke */
-  } /* END if primary */
+    /* nuke the conversions not answered yet */
+    for (pXfer = pDpyInfo->pXfers; pXfer; pXfer = pNext) {
+      pNext = pXfer->pNext;
+      if ((pXfer->dpy == otherDpy) && (pXfer->sel == sel) &&
+          (pXfer->incr == INCR_NONE))
+        CancelXfer(pDpyInfo, pXfer);
+    }
+  } /* END if relayed */
   return False;
 
 } /* END ProcessSelectionClear */
@@ -2545,6 +6995,90 @@ XMappingEvent       *pEv;
 
 } /* END ProcessMapping */
 
+#ifdef HAVE_RANDR
+/**********
+ * follow RandR reconfiguration of a display
+ **********/
+static void SelectScreenChange(dpy)
+Display *dpy;
+{
+  int rrEvent, rrError;
+  int screenNum;
+
+  if (!XRRQueryExtension(dpy, &rrEvent, &rrError))
+    return;
+  for (screenNum = 0; screenNum < XScreenCount(dpy); ++screenNum)
+    XRRSelectInput(dpy, XRootWindow(dpy, screenNum), RRScreenChangeNotifyMask);
+  XSAVECONTEXT(dpy, None, rrEvent + RRScreenChangeNotify, ProcessScreenChange);
+
+} /* END SelectScreenChange */
+
+static Bool ProcessScreenChange(dpy, pDpyInfo, pEv)
+Display  *dpy;
+PDPYINFO pDpyInfo;
+XEvent   *pEv;
+{
+  PNODE pNode;
+
+  /* updates the screen sizes Xlib reports */
+  XRRUpdateConfiguration(pEv);
+  debug("screen change on %s\n", DisplayString(dpy));
+
+  /* events queued behind this one already use the new geometry, so
+     the new tables are swapped in before they are processed */
+  if (dpy == pDpyInfo->fromDpy) {
+    ResizeFrom(pDpyInfo);
+  } else {
+    for (pNode = nodes; pNode; pNode = pNode->pNext)
+      if (pNode->dpy == dpy)
+        BuildTables(activeSource, pNode);
+  }
+  return False;
+
+} /* END ProcessScreenChange */
+
+/**********
+ * the from display changed size: every node maps from it
+ **********/
+static void ResizeFrom(pDpyInfo)
+PDPYINFO pDpyInfo;
+{
+  Display *fromDpy = pDpyInfo->fromDpy;
+  Screen  *fromScreen = XDefaultScreenOfDisplay(fromDpy);
+  int     fromWidth = XWidthOfScreen(fromScreen);
+  int     fromHeight = XHeightOfScreen(fromScreen);
+  Bool    vertical = pDpyInfo->vertical;
+  int     triggerLoc;
+  PNODE   pNode;
+
+  if ((fromWidth == pDpyInfo->fromWidth) &&
+      (fromHeight == pDpyInfo->fromHeight))
+    return; /* other screen, or rotation only */
+
+  debug("from display resized to %dx%d\n", fromWidth, fromHeight);
+  triggerLoc = SetFromGeometry(pDpyInfo, fromWidth, fromHeight);
+  if (pDpyInfo == activeSource) /* else when it takes over */
+    for (pNode = nodes; pNode; pNode = pNode->pNext)
+      BuildTables(pDpyInfo, pNode);
+
+  if (doEdge) {
+#ifdef HAVE_BARRIERS
+    if (pDpyInfo->barrier != None)
+      PlaceEdgeBarrier(pDpyInfo);
+    else
+#endif
+    XMoveResizeWindow(fromDpy, pDpyInfo->trigger,
+                      vertical ? triggerw : triggerLoc,
+                      vertical ? triggerLoc : triggerw,
+                      vertical ? fromWidth - (2*triggerw) : triggerw,
+                      vertical ? triggerw : fromHeight - (2*triggerw));
+  }
+  if (pDpyInfo->big != None)
+    XResizeWindow(fromDpy, pDpyInfo->big, fromWidth, fromHeight);
+
+} /* END ResizeFrom */
+#endif /* HAVE_RANDR */
+
 static void FakeAction(pDpyInfo, type, thing, bDown)
 PDPYINFO pDpyInfo;
 int type;
@@ -2602,12 +7136,12 @@ PDPYINFO pDpyInfo;
       for (pShadow = shadows; pShadow; pShadow = pShadow->pNext) {
         if (type == FAKE_KEY) { /* key goes up */
           if ((keycode = XKeysymToKeycode(pShadow->dpy, pFake->thing))) {
-            XTestFakeKeyEvent(pShadow->dpy, keycode, False, 0);
+            FakeKey(pShadow, keycode, False);
 	    pShadow->flush = True;
             debug("key 0x%lx up\n", (unsigned long)pFake->thing);
           } /* END if */
         } else { /* button goes up */
-          XTestFakeButtonEvent(pShadow->dpy, pFake->thing, False, 0);
+          FakeButton(pShadow, pFake->thing, False);
 	  pShadow->flush = True;
           debug("button %ld up\n", (long)pFake->thing);
         } /* END if/else */
@@ -2624,7 +7158,7 @@ PDPYINFO pDpyInfo;
   /* flush everything at once */
   for (pShadow = shadows; pShadow; pShadow = pShadow->pNext)
     if (pShadow->flush) {
-      XFlush(pShadow->dpy);
+      FlushShadow(pShadow);
       pShadow->flush = False;
     }
 
@@ -2636,26 +7170,36 @@ PDPYINFO            pDpyInfo;
 {
   unsigned int buttCtr;
   unsigned char buttonMap[N_BUTTONS];
+  PNODE pNode;
+
+  /* only care about the displays of the layout graph */
+  for (pNode = nodes; pNode; pNode = pNode->pNext)
+    if (pNode->dpy == dpy)
+      break;
 
-  if (dpy == pDpyInfo->toDpy) { /* only care about toDpy */
+  if (pNode) {
     /* straightforward mapping */
     for (buttCtr = 1; buttCtr <= N_BUTTONS; ++buttCtr) {
-      pDpyInfo->inverseMap[buttCtr] = buttCtr;
+      pNode->inverseMap[buttCtr] = buttCtr;
     } /* END for */
 
-    nButtons = MIN(N_BUTTONS, XGetPointerMapping(dpy, buttonMap, N_BUTTONS));
-        debug("got button mapping: %d items\n", nButtons);
+    pNode->nButtons =
+      MIN(N_BUTTONS, XGetPointerMapping(dpy, buttonMap, N_BUTTONS));
+        debug("got button mapping: %d items\n", pNode->nButtons);
+    if (pNode == activeSource->pNode)
+      nButtons = pNode->nButtons;
 #ifdef WIN_2_X
-    pDpyInfo->nXbuttons = nButtons;
+    if (pNode == nodes)
+      pDpyInfo->nXbuttons = pNode->nButtons;
 #endif
     if (doPointerMap) {
-      for (buttCtr = 0; buttCtr < nButtons; ++buttCtr) {
+      for (buttCtr = 0; buttCtr < pNode->nButtons; ++buttCtr) {
         debug("button %d -> %d\n", buttCtr + 1, buttonMap[buttCtr]);
         if (buttonMap[buttCtr] <= N_BUTTONS)
-          pDpyInfo->inverseMap[buttonMap[buttCtr]] = buttCtr + 1;
+          pNode->inverseMap[buttonMap[buttCtr]] = buttCtr + 1;
       } /* END for */
     } /* END if */
-  } /* END if toDpy */
+  } /* END if node */
 
 } /* END RefreshPointerMapping */
 
@@ -2747,7 +7291,7 @@ int x,y;
 
   for (pShadow = shadows; pShadow; pShadow = pShadow->pNext) {
     DoDPMSForceLevel(pShadow, DPMSModeOn);
-    XFlush(pShadow->dpy);
+    FlushShadow(pShadow);
   }
 
   debug("connecting (Win2x)\n");
@@ -2936,7 +7480,8 @@ WinProcessMessage (HWND hwnd, UINT iMsg, WPARAM wParam, LPARAM lParam)
 #endif
         delta = pDpyInfo->lastFromCoord - ((pDpyInfo->vertical) ? y : x);
         if (delta < 0) delta = -delta;
-        if (delta > pDpyInfo->unreasonableDelta) {
+        if (delta > ((pDpyInfo->vertical) ?
+                     pDpyInfo->fromHeight : pDpyInfo->fromWidth) / 2) {
           /* Guess that the warp failed and try it again... */
           debug("Retry warp to (%d, %d)\n",
                 (doEdge == EDGE_EAST) ? 1 : pDpyInfo->fromWidth - 3,
@@ -3150,7 +7695,7 @@ WinProcessMessage (HWND hwnd, UINT iMsg, WPARAM wParam, LPARAM lParam)
 	pDpyInfo->winSSave = 1;
 	for (pShadow = shadows; pShadow; pShadow = pShadow->pNext) {
 	  XActivateScreenSaver(pShadow->dpy);
-	  XFlush(pShadow->dpy);
+	  FlushShadow(pShadow);
 	  pShadow->flush = False;
 	} /* END for shadow */
       }
@@ -3204,7 +7749,10 @@ void WinPointerEvent(PDPYINFO pDpyInfo,
   unsigned int button, toButton;
   int       toScreenNum;
   PSHADOW   pShadow;
-  int       toCoord, fromCoord, fromX, fromY, delta;
+  int       toCoord, fromCoord, fromX, fromY;
+  int       toX, toY;
+  PSCALEMAP pMap;
+  long long now = 0;
   short **coordTables;
 
   button = 0;
@@ -3227,18 +7775,6 @@ void WinPointerEvent(PDPYINFO pDpyInfo,
 
     toCoord = coordTables[toScreenNum][fromCoord];
 
-    /* sanity check motion: necessary for nondeterminism surrounding warps */
-    delta = pDpyInfo->lastFromCoord - fromCoord;
-    if (delta < 0) delta = -delta;
-    if (delta > pDpyInfo->unreasonableDelta) {
-      if (pDpyInfo->unreasonableCount++ < MAX_UNREASONABLES) {
-	debug("Unreasonable x delta last = %d this = %d\n",
-	      pDpyInfo->lastFromX, fromX);
-	return;
-      }
-      pDpyInfo->unreasonableCount = 0;
-    }
-
     if (SPECIAL_COORD(toCoord) != 0) { /* special coordinate */
       if (toCoord == COORD_INCR) {
         if (toScreenNum != (pDpyInfo->nScreens - 1)) { /* next screen */
@@ -3274,14 +7810,19 @@ void WinPointerEvent(PDPYINFO pDpyInfo,
     pDpyInfo->lastFromX = fromX;
     pDpyInfo->lastFromY = fromY;
 
+    if (doDpmsMouse)
+      now = LogNow();
     for (pShadow = shadows; pShadow; pShadow = pShadow->pNext) {
       if (doDpmsMouse)
-      {
-        DoDPMSForceLevel(pShadow, DPMSModeOn);
-      }
-      XTestFakeMotionEvent(pShadow->dpy, toScreenNum, pDpyInfo->xTables[toScreenNum][x],
-        pDpyInfo->yTables[toScreenNum][y], 0);
-      XFlush(pShadow->dpy);
+        DPMSWake(pShadow, now);
+      toX = pDpyInfo->xTables[toScreenNum][x];
+      toY = pDpyInfo->yTables[toScreenNum][y];
+      if (pShadow->pMaps && (pMap = pShadow->pMaps[toScreenNum]) &&
+          (toX >= 0) && (toY >= 0))
+        FakeMotion(pShadow, toScreenNum, pMap->xMap[toX], pMap->yMap[toY]);
+      else
+        FakeMotion(pShadow, toScreenNum, toX, toY);
+      FlushShadow(pShadow);
       pShadow->flush = False;
     } /* END for */
     return;
@@ -3300,10 +7841,10 @@ void WinPointerEvent(PDPYINFO pDpyInfo,
   if (button <= N_BUTTONS) {
     toButton = pDpyInfo->inverseMap[button];
     for (pShadow = shadows; pShadow; pShadow = pShadow->pNext) {
-      XTestFakeButtonEvent(pShadow->dpy, toButton, down, 0);
+      FakeButton(pShadow, toButton, down);
       debug("from button %d %s, to button %d %s\n",
             button, down ? "down":"up", toButton, down ? "down":"up");
-      XFlush(pShadow->dpy);
+      FlushShadow(pShadow);
       pShadow->flush = False;
     } /* END for */
     if (doAutoUp)
@@ -3325,11 +7866,11 @@ void SendButtonClick(pDpyInfo, button)
     toButton = pDpyInfo->inverseMap[button];
     if (toButton <= pDpyInfo->nXbuttons)
       for (pShadow = shadows; pShadow; pShadow = pShadow->pNext) {
-        XTestFakeButtonEvent(pShadow->dpy, toButton, True, 0);
-        XTestFakeButtonEvent(pShadow->dpy, toButton, False, 0);
+        FakeButton(pShadow, toButton, True);
+        FakeButton(pShadow, toButton, False);
         debug("Click from button %d, to button %d\n",
                button, toButton);
-        XFlush(pShadow->dpy);
+        FlushShadow(pShadow);
 	pShadow->flush = False;
       } /* END for */
     else
@@ -3523,44 +8064,44 @@ void SendKeyEvent(PDPYINFO pDpyInfo, KeySym keysym, int down,
         /* XXX mdh - and only restore on up? */
 
         if (winShift == 0) { // Need to press, choose left
-          XTestFakeKeyEvent(pShadow->dpy, toShiftLCode, True, 0);
+          FakeKey(pShadow, toShiftLCode, True);
           debug("LSdown ");
         } else {
           // Release whichever is pressed or both
 #ifdef USING_RSHIFT
           if (winShift & 1) {
-                      XTestFakeKeyEvent(pShadow->dpy, toShiftLCode, False, 0);
+                      FakeKey(pShadow, toShiftLCode, False);
                   debug("LSup ");
           }
           if (winShift & 2) {
-                      XTestFakeKeyEvent(pShadow->dpy, toShiftRCode, False, 0);
+                      FakeKey(pShadow, toShiftRCode, False);
                   debug("RSup ");
           }
 #else /* not USING_RSHIFT */
           /* Since we only ever send Left shifts, thats all we need release */
-          XTestFakeKeyEvent(pShadow->dpy, toShiftLCode, False, 0);
+          FakeKey(pShadow, toShiftLCode, False);
           debug("LSup ");
 #endif /* USING_RSHIFT */
         }
-        XTestFakeKeyEvent(pShadow->dpy, keycode, down, 0);
+        FakeKey(pShadow, keycode, down);
         if (winShift == 0) // Needed to press, so release
-          XTestFakeKeyEvent(pShadow->dpy, toShiftLCode, False, 0);
+          FakeKey(pShadow, toShiftLCode, False);
         else {
 #ifdef USING_RSHIFT
           // Restore whichever is pressed
           if (winShift & 1)
-                      XTestFakeKeyEvent(pShadow->dpy, toShiftLCode, True, 0);
+                      FakeKey(pShadow, toShiftLCode, True);
           if (winShift & 2)
-                      XTestFakeKeyEvent(pShadow->dpy, toShiftRCode, True, 0);
+                      FakeKey(pShadow, toShiftRCode, True);
 #else /* not USING_RSHIFT */
-          XTestFakeKeyEvent(pShadow->dpy, toShiftLCode, True, 0);
+          FakeKey(pShadow, toShiftLCode, True);
 #endif /* USING_RSHIFT */
         }
       }
       else
-        XTestFakeKeyEvent(pShadow->dpy, keycode, down, 0);
+        FakeKey(pShadow, keycode, down);
 
-      XFlush(pShadow->dpy);
+      FlushShadow(pShadow);
       pShadow->flush = False;
     } /* END if */
   } /* END for */
@@ -3697,3 +8238,19 @@ size_t size;
   }
   return memset(ptr, 0, size);
 }
+
+/**********
+ * xmalloc for what goes to XFree with the properties Xlib read
+ **********/
+static void *xXmalloc(size)
+size_t size;
+{
+  void *ptr = Xmalloc(size);
+
+  if (!ptr) {
+    fprintf(stderr, "%s - error: %s\n", programStr, strerror(errno));
+    exit(1);
+  }
+  return ptr;
+
+} /* END xXmalloc */